@@ -0,0 +1,620 @@
+#include "batch.hpp"
+#include "blob.hpp"
+#include "chr2png.hpp"
+#include "filesys.hpp"
+#include "gfxdefman.hpp"
+#include "imageformat_png.hpp"
+#include "interleave.hpp"
+#include "mappedfile.hpp"
+#include "pipeline.hpp"
+#include "setup.hpp"
+#include "strutil.hpp"
+#include <chrgfx/chrgfx.hpp>
+
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef DEBUG
+#include <chrono>
+#endif
+
+using namespace std;
+using namespace chrgfx;
+using namespace motoi;
+
+namespace chr2png
+{
+
+/**
+ * @brief Decode the requested palette line, or generate a random palette if there is no palette data
+ */
+static palette load_palette(runtime_config_chr2png const & cfg, gfxdef_manager & defs)
+{
+	palette out;
+	if (cfg.paldata_path.empty())
+	{
+		out = make_pal_random();
+		return out;
+	}
+
+	if (defs.paldef() == nullptr)
+		throw runtime_error("no paldef loaded");
+	if (defs.coldef() == nullptr)
+		throw runtime_error("no coldef loaded");
+
+	ifstream paldata {ifstream_checked(cfg.paldata_path)};
+	size_t pal_size {defs.paldef()->datasize_bytes()};
+	auto palbuffer {unique_ptr<byte_t>(new byte_t[pal_size])};
+
+	paldata.seekg(cfg.pal_line * pal_size, ios::beg);
+	paldata.read(reinterpret_cast<char *>(palbuffer.get()), pal_size);
+	if (! paldata.good())
+		throw runtime_error("Cannot read specified palette line index");
+
+	decode_pal(*defs.paldef(), *defs.coldef(), palbuffer.get(), &out);
+	return out;
+}
+
+/**
+ * @brief Decode every palette line from the requested one to the end of the palette data, one after another
+ */
+static vector<rgb_color> load_palette_bank(runtime_config_chr2png const & cfg, gfxdef_manager & defs)
+{
+	if (cfg.paldata_path.empty())
+		throw invalid_argument("Rendering with a palette line map requires palette data");
+	if (defs.paldef() == nullptr)
+		throw runtime_error("no paldef loaded");
+	if (defs.coldef() == nullptr)
+		throw runtime_error("no coldef loaded");
+
+	ifstream paldata_file {ifstream_checked(cfg.paldata_path)};
+	blob const paldata {paldata_file};
+	size_t const pal_size {defs.paldef()->datasize_bytes()}, pal_length {defs.paldef()->length()},
+		first_offset {cfg.pal_line * pal_size};
+	if (paldata.size() < first_offset + pal_size)
+		throw runtime_error("Cannot read specified palette line index");
+
+	vector<rgb_color> out;
+	palette workpal;
+	for (size_t offset {first_offset}; offset + pal_size <= paldata.size(); offset += pal_size)
+	{
+		decode_pal(*defs.paldef(), *defs.coldef(), static_cast<byte_t const *>(paldata.data()) + offset, &workpal);
+		out.insert(out.end(), workpal.begin(), workpal.begin() + min(pal_length, workpal.size()));
+	}
+	return out;
+}
+
+/**
+ * @brief Run a single conversion with gfxdefs that have already been loaded
+ * @note Must not modify shared state, as batch jobs are run on multiple threads
+ *
+ * @param threads Number of threads available for decoding and compression
+ */
+static void convert(runtime_config_chr2png const & cfg, gfxdef_manager & defs, uint const threads)
+{
+#ifdef DEBUG
+	chrono::high_resolution_clock::time_point t1, t2;
+#endif
+
+	/*******************************************************
+	 *            SETUP & SANITY CHECKING
+	 *******************************************************/
+
+#ifdef DEBUG
+	t1 = chrono::high_resolution_clock::now();
+#endif
+	if (defs.chrdef() == nullptr)
+		throw runtime_error("no chrdef loaded");
+
+	auto const & chrdef {*defs.chrdef()};
+	// the lookup tables are built once for each chrdef, and shared by batch jobs using the same one
+	auto const chr_decoder {defs.decoder()};
+	size_t const
+		// byte size of one encoded tile
+		in_chunksize {chrdef.datasize_bytes()},
+		// the window of the input to convert
+		window_offset {cfg.data_offset.bytes(in_chunksize)},
+		window_size {cfg.data_count ? cfg.data_count->bytes(in_chunksize) : mapped_file::npos};
+
+	/*
+		Only the requested window of the input is read. Files are mapped, so that pages outside the window are never
+		touched; piped input must be read up to the window, but nothing beyond it is kept.
+	*/
+	optional<mapped_file> mapped_chr_data;
+	optional<interleaved_files> interleaved_chr_data;
+	blob piped_chr_data;
+	byte_t const * chr_data {nullptr};
+	size_t chr_datasize;
+	if (cfg.chr_interleave > 0)
+	{
+		if (cfg.chrdata_path.empty())
+			throw invalid_argument("Interleaved tile data must be read from files");
+
+		vector<string> paths;
+		for (auto const & path : split_container<vector<string_view>>(cfg.chrdata_path))
+			paths.emplace_back(path);
+		interleaved_chr_data.emplace(paths, cfg.chr_interleave, window_offset, window_size);
+		chr_datasize = interleaved_chr_data->size();
+	}
+	else if (cfg.chrdata_path.empty())
+	{
+		if (window_offset > 0)
+		{
+			cin.ignore(window_offset);
+			if (static_cast<size_t>(cin.gcount()) < window_offset)
+				throw out_of_range("Offset is beyond the end of the input");
+		}
+
+		if (cfg.data_count)
+		{
+			// read in blocks rather than allocating the whole window up front, in case the input is shorter
+			chr_datasize = 0;
+			while (chr_datasize < window_size && cin.good())
+			{
+				piped_chr_data.append(min(window_size - chr_datasize, (size_t) 0x80000));
+				cin.read(static_cast<char *>(piped_chr_data.data()) + chr_datasize, piped_chr_data.size() - chr_datasize);
+				chr_datasize += cin.gcount();
+			}
+		}
+		else
+		{
+			cin >> piped_chr_data;
+			chr_datasize = piped_chr_data.size();
+		}
+		chr_data = piped_chr_data;
+	}
+	else
+	{
+		mapped_chr_data.emplace(cfg.chrdata_path, window_offset, window_size);
+		chr_data = mapped_chr_data->data();
+		chr_datasize = mapped_chr_data->size();
+	}
+
+	/*
+		Compressed data is decompressed in full before decoding, as the PNG header needs the image height, which is not
+		known until the end of the data. The input is fed in pieces so that mapped pages are only read as needed.
+	*/
+	vector<byte_t> decompressed;
+	if (auto decompressor {make_decompressor(cfg.compression)})
+	{
+		vector<byte_t> piece;
+		for (size_t pos {0}; pos < chr_datasize && ! decompressor->finished(); pos += 0x10000)
+		{
+			size_t const piece_size {min(chr_datasize - pos, (size_t) 0x10000)};
+			if (interleaved_chr_data)
+			{
+				piece.resize(piece_size);
+				interleaved_chr_data->read(pos, piece_size, piece.data());
+				decompressor->decompress(piece.data(), piece_size, decompressed);
+			}
+			else
+			{
+				decompressor->decompress(chr_data + pos, piece_size, decompressed);
+			}
+		}
+		if (! decompressor->finished())
+			throw runtime_error("Compressed tile data is incomplete");
+
+		interleaved_chr_data.reset();
+		mapped_chr_data.reset();
+		chr_data = decompressed.data();
+		chr_datasize = decompressed.size();
+	}
+
+	/*
+		Transforms which work within words are applied to each tile row as it is decoded. Those which move data across the
+		whole window (deinterleaving) need all of it at once, so the window is copied and transformed in one pass here.
+	*/
+	size_t const transform_block {transform_block_size(cfg.transforms)};
+	bool const transform_chrrows {! cfg.transforms.empty() && transform_block > 0 && in_chunksize % transform_block == 0};
+	if (! cfg.transforms.empty() && ! transform_chrrows)
+	{
+		if (! decompressed.empty())
+		{
+			apply_transforms(cfg.transforms, decompressed.data(), chr_datasize);
+		}
+		else
+		{
+			if (interleaved_chr_data)
+			{
+				piped_chr_data.append(chr_datasize);
+				interleaved_chr_data->read(0, chr_datasize, piped_chr_data);
+				interleaved_chr_data.reset();
+			}
+			else if (mapped_chr_data)
+			{
+				piped_chr_data.append(chr_data, chr_datasize);
+				mapped_chr_data.reset();
+			}
+			apply_transforms(cfg.transforms, piped_chr_data, chr_datasize);
+			chr_data = piped_chr_data;
+		}
+	}
+
+#ifdef DEBUG
+	t2 = chrono::high_resolution_clock::now();
+	auto duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+	cerr << "SETUP: " << duration << "ms\n";
+#endif
+
+	/*******************************************************
+	 *                PALETTE CONVERSION
+	 *******************************************************/
+#ifdef DEBUG
+	t1 = chrono::high_resolution_clock::now();
+#endif
+
+	/*
+		With a line map, each tile is drawn in its own palette line, so the output is direct color rather than indexed,
+		and every line from the requested one onward is loaded
+	*/
+	bool const render_lines {! cfg.linemap_path.empty()};
+	palette workpal;
+	vector<rgb_color> pal_bank;
+	vector<uint8> tile_lines;
+	if (render_lines)
+	{
+		pal_bank = load_palette_bank(cfg, defs);
+		ifstream linemap_file {ifstream_checked(cfg.linemap_path)};
+		tile_lines.assign(istreambuf_iterator<char>(linemap_file), istreambuf_iterator<char>());
+	}
+	else
+	{
+		workpal = load_palette(cfg, defs);
+	}
+
+#ifdef DEBUG
+	t2 = chrono::high_resolution_clock::now();
+	duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+	cerr << "PALETTE GENERATION: " << duration << "ms\n";
+#endif
+
+	/*******************************************************
+	 *       TILE CONVERSION, IMAGE RENDER & OUTPUT
+	 *******************************************************/
+
+#ifdef DEBUG
+	t1 = chrono::high_resolution_clock::now();
+#endif
+
+	size_t const
+		// byte size of one basic (decoded) tile
+		out_chunksize {(size_t) (chrdef.width() * chrdef.height())},
+		// as before, a partial tile at the end of the data is ignored
+		chr_count {chr_datasize / in_chunksize};
+
+	if (chr_count == 0)
+		throw invalid_argument("Not enough data in buffer to render a single tile");
+
+	/*
+		Tiles are rendered a band at a time: a row of tiles, or of tile groups if an arrangement groups them. Groups placed
+		in columns may reach any row of the image, in which case the whole tileset is a single band.
+	*/
+	size_t const arranged_band_size {band_tile_count(cfg.render_cfg.arrangement, cfg.render_cfg.row_size)},
+		band_size {arranged_band_size > 0 ? arranged_band_size : chr_count},
+		band_count {(chr_count + band_size - 1) / band_size};
+
+	// this checks the arrangement against the tiles, which must be done before the output is opened and truncated
+	auto const [outimg_pxlwidth, outimg_pxlheight] {
+		tileset_dimensions(chrdef, chr_count * out_chunksize, cfg.render_cfg)};
+
+	ostream * png_out {&cout};
+	ofstream ofs_png_out;
+	if (! cfg.out_png_path.empty())
+	{
+		ofs_png_out = ofstream_checked(cfg.out_png_path);
+		png_out = &ofs_png_out;
+	}
+
+	// compression generally dominates, so it gets all threads; leave cores for the reader and writer when decoding
+	png_compression png_cfg {cfg.png_cfg};
+	png_cfg.threads = threads;
+	size_t const decode_workers {max(threads, 3u) - 2};
+
+	optional<png_row_writer> writer;
+	if (render_lines)
+		writer.emplace(*png_out, outimg_pxlwidth, outimg_pxlheight, png_cfg);
+	else
+		writer.emplace(*png_out, outimg_pxlwidth, outimg_pxlheight, workpal, cfg.render_cfg.trns_index, png_cfg);
+
+	/*
+		The work is split into stages connected by bounded queues, with one band of tiles as the unit of work:
+		- the reader thread hands out the encoded data for each band
+		- decode workers decode the tiles and render them into pixel rows
+		- this thread passes the pixel rows to the PNG writer, in order, with the gutter rows between bands
+		This way reading, decoding and compression all overlap. The queues keep only a few bands in memory at once, and
+		if any stage fails, aborting the queues stops the others.
+	*/
+	struct encoded_chrrow
+	{
+		size_t index;
+		tileset_view tiles;
+		// holds the tile data gathered from interleaved input; tiles points into it
+		vector<byte_t> gathered;
+	};
+
+	size_t const queue_depth {decode_workers * 4};
+	bounded_queue<encoded_chrrow> encoded_rows(queue_depth);
+	reorder_queue<chrgfx::image> rendered_rows(queue_depth);
+	reorder_queue<motoi::image<rgba_color>> rendered_line_rows(queue_depth);
+
+	mutex error_mutex;
+	exception_ptr error;
+	auto fail = [&]() {
+		{
+			lock_guard<mutex> lock {error_mutex};
+			if (! error)
+				error = current_exception();
+		}
+		encoded_rows.abort();
+		rendered_rows.abort();
+		rendered_line_rows.abort();
+	};
+
+	/*
+		Contiguous data is already in memory (or mapped), so the reader only hands out the bands. Interleaved data is
+		gathered one band at a time.
+	*/
+	auto reader = [&]() {
+		try
+		{
+			for (size_t i_chrrow {0}; i_chrrow < band_count; ++i_chrrow)
+			{
+				size_t const first_chr {i_chrrow * band_size},
+					chrrow_datasize {min(band_size, chr_count - first_chr) * in_chunksize};
+				vector<byte_t> gathered;
+				if (interleaved_chr_data)
+				{
+					gathered.resize(chrrow_datasize);
+					interleaved_chr_data->read(first_chr * in_chunksize, chrrow_datasize, gathered.data());
+				}
+				// moving the vector into the queue does not move its buffer, so the view remains valid
+				encoded_chrrow chrrow {i_chrrow,
+					tileset_view(*chr_decoder,
+						interleaved_chr_data ? gathered.data() : chr_data + (first_chr * in_chunksize),
+						chrrow_datasize),
+					std::move(gathered)};
+				if (! encoded_rows.push(std::move(chrrow)))
+					return;
+			}
+			encoded_rows.close();
+		}
+		catch (...)
+		{
+			fail();
+		}
+	};
+
+	auto decoder = [&]() {
+		try
+		{
+			vector<byte_t> tiles;
+			while (auto chrrow {encoded_rows.pop()})
+			{
+				if (transform_chrrows)
+				{
+					auto & transformed {chrrow->gathered};
+					if (transformed.empty())
+						transformed.assign(chrrow->tiles.encoded(0), chrrow->tiles.encoded(0) + chrrow->tiles.datasize());
+					apply_transforms(cfg.transforms, transformed.data(), transformed.size());
+					chrrow->tiles = tileset_view(*chr_decoder, transformed.data(), transformed.size());
+				}
+
+				tiles.resize(chrrow->tiles.size() * out_chunksize);
+				chrrow->tiles.decode(0, chrrow->tiles.size(), tiles.data());
+
+				if (render_lines)
+				{
+					// tiles beyond the end of the line map use the first line
+					size_t const first_chr {chrrow->index * band_size},
+						listed_count {first_chr < tile_lines.size() ? tile_lines.size() - first_chr : 0};
+					if (! rendered_line_rows.push(chrrow->index,
+								render_tileset_rgba(chrdef,
+									tiles.data(),
+									tiles.size(),
+									cfg.render_cfg,
+									pal_bank,
+									defs.paldef()->length(),
+									listed_count > 0 ? tile_lines.data() + first_chr : nullptr,
+									listed_count)))
+						return;
+				}
+				else if (! rendered_rows.push(
+									 chrrow->index, render_tileset(chrdef, tiles.data(), tiles.size(), cfg.render_cfg)))
+					return;
+			}
+		}
+		catch (...)
+		{
+			fail();
+		}
+	};
+
+	vector<thread> stages;
+	stages.emplace_back(reader);
+	for (size_t i {0}; i < decode_workers; ++i)
+		stages.emplace_back(decoder);
+
+	try
+	{
+		// gutter rows are left blank, as they are by render_tileset
+		uint const gutter {cfg.render_cfg.arrangement.gutter};
+		vector<pixel> const gutter_row(render_lines ? 0 : outimg_pxlwidth);
+		vector<rgba_color> const gutter_line_row(render_lines ? outimg_pxlwidth : 0);
+		for (size_t i_chrrow {0}; i_chrrow < band_count; ++i_chrrow)
+		{
+			for (uint i_gutter {0}; i_chrrow > 0 && i_gutter < gutter; ++i_gutter)
+			{
+				if (render_lines)
+					writer->write_row(gutter_line_row.data());
+				else
+					writer->write_row(gutter_row.data());
+			}
+
+			if (render_lines)
+			{
+				auto rendered {rendered_line_rows.pop()};
+				if (! rendered)
+					break;
+				writer->write_rows(*rendered);
+			}
+			else
+			{
+				auto rendered {rendered_rows.pop()};
+				if (! rendered)
+					break;
+				writer->write_rows(*rendered);
+			}
+		}
+	}
+	catch (...)
+	{
+		fail();
+	}
+
+	for (auto & stage : stages)
+		stage.join();
+	if (error)
+		rethrow_exception(error);
+
+	writer->finish();
+
+#ifdef DEBUG
+	t2 = chrono::high_resolution_clock::now();
+	duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+	cerr << "TILE CONVERSION/RENDER/OUTPUT: " << duration << "ms\n";
+#endif
+}
+
+/**
+ * @brief Search the input file for tile graphics with each of the chrdefs listed for scanning
+ * @details The best candidates are listed on stdout, and a thumbnail of each is written if an output path is given
+ */
+static void scan(runtime_config_chr2png & cfg, uint const threads)
+{
+	if (cfg.chrdata_path.empty())
+		throw invalid_argument("Scan mode must read tile data from a file");
+	if (cfg.chr_interleave > 0 || cfg.compression != compression_format::none || ! cfg.transforms.empty())
+		throw invalid_argument("Scan mode cannot be combined with interleaving, transforms or compression");
+	if (cfg.data_offset.in_tiles || (cfg.data_count && cfg.data_count->in_tiles))
+		throw invalid_argument("The offset and count must be given in bytes in scan mode");
+
+	/*
+		Each chrdef is loaded by its own manager, set up as if it were the only one requested. The configs are kept in a
+		list as the managers refer back to them.
+	*/
+	list<runtime_config> def_cfgs;
+	vector<unique_ptr<gfxdef_manager>> defs;
+	vector<shared_ptr<tile_decoder const>> decoders;
+	for (auto const & id : split_container<vector<string_view>>(cfg.scan_chrdefs))
+	{
+		auto & def_cfg {def_cfgs.emplace_back()};
+		def_cfg.gfxdefs_path = cfg.gfxdefs_path;
+		def_cfg.chrdef_id = id;
+		decoders.push_back(defs.emplace_back(make_unique<gfxdef_manager>(def_cfg))->decoder());
+	}
+
+	mapped_file chr_data(cfg.chrdata_path,
+		cfg.data_offset.value,
+		cfg.data_count ? cfg.data_count->value : mapped_file::npos);
+
+#ifdef DEBUG
+	auto t1 = chrono::high_resolution_clock::now();
+#endif
+
+	scan_config scan_cfg;
+	scan_cfg.max_results = cfg.scan_results;
+	scan_cfg.alignment_step = cfg.scan_alignment_step;
+	scan_cfg.threads = threads;
+	auto const candidates {scan_tiles(decoders, chr_data.data(), chr_data.size(), scan_cfg)};
+
+#ifdef DEBUG
+	auto t2 = chrono::high_resolution_clock::now();
+	cerr << "SCAN: " << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << "ms\n";
+#endif
+
+	optional<palette> workpal;
+	if (! cfg.out_png_path.empty())
+	{
+		// the chrdefs are not used for the palette, so load only what was asked for by the usual options
+		if (cfg.paldata_path.empty())
+		{
+			workpal = make_pal_random();
+		}
+		else
+		{
+			gfxdef_manager pal_defs(cfg);
+			workpal = load_palette(cfg, pal_defs);
+		}
+	}
+
+	cout << "offset\tchrdef\tscore\tentropy\tplanes\tblank\n";
+	for (auto const & candidate : candidates)
+	{
+		auto const offset {cfg.data_offset.value + candidate.offset};
+		auto const & id {candidate.chrdef->id()};
+		auto const & score {candidate.score};
+		cout << "0x" << hex << offset << dec << '\t' << id << '\t' << score.score << '\t' << score.entropy << '\t'
+				 << score.plane_correlation << '\t' << score.blank_ratio << '\n';
+
+		if (! workpal)
+			continue;
+
+		auto const thumbnail {
+			tileset_view(*candidate.chrdef, chr_data.data() + candidate.offset, candidate.datasize).render(cfg.render_cfg)};
+		ostringstream filename;
+		filename << hex << setw(8) << setfill('0') << offset << '_' << id << ".png";
+		auto out {ofstream_checked(concat_paths(cfg.out_png_path, filename.str()))};
+		png_row_writer writer(out, thumbnail.width(), thumbnail.height(), *workpal, cfg.render_cfg.trns_index);
+		writer.write_rows(thumbnail);
+		writer.finish();
+	}
+}
+
+int run(int argc, char ** argv)
+{
+	try
+	{
+		process_args(argc, argv);
+
+		if (! cfg.batch_path.empty())
+		{
+			return run_batch(cfg, parse_args, [](runtime_config_chr2png const & job_cfg, gfxdef_manager & defs) {
+				// there is only one stdin/stdout, so batch jobs must use files
+				if (job_cfg.chrdata_path.empty())
+					throw invalid_argument("No input tile data path specified");
+				if (job_cfg.out_png_path.empty())
+					throw invalid_argument("No output PNG path specified");
+				// the batch jobs already keep every core busy
+				convert(job_cfg, defs, 1);
+			});
+		}
+
+		if (! cfg.scan_chrdefs.empty())
+		{
+			scan(cfg, cfg.batch_threads > 0 ? cfg.batch_threads : max(thread::hardware_concurrency(), 1u));
+			return 0;
+		}
+
+		gfxdef_manager defs(cfg);
+		convert(cfg, defs, cfg.batch_threads > 0 ? cfg.batch_threads : max(thread::hardware_concurrency(), 1u));
+		return 0;
+	}
+	catch (exception const & e)
+	{
+		cerr << "Error: " << e.what() << '\n';
+		return -1;
+	}
+}
+
+} // namespace chr2png
@@ -0,0 +1,24 @@
+/**
+ * @file chr2png.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2022 Motoi Productions / Released under MIT License
+ * @brief Convert encoded tile graphics to PNG image
+ */
+
+#ifndef __CHRGFX__CHR2PNG_HPP
+#define __CHRGFX__CHR2PNG_HPP
+
+namespace chr2png
+{
+
+/**
+ * @brief Parses the command line and runs a single conversion
+ * @note Kept separate from main() so that the job can also be run by chrgfxd
+ *
+ * @return int Program exit code
+ */
+int run(int argc, char ** argv);
+
+} // namespace chr2png
+
+#endif
@@ -1,37 +1,41 @@
+#include "imageformat_png.hpp"
 #include "imaging.hpp"
 #include "shared.hpp"
 #include <getopt.h>
+#include <optional>
 #include <stdexcept>
 #include <string>
 
+namespace chr2png
+{
+
 struct runtime_config_chr2png : runtime_config
 {
 	std::string chrdata_path;
 	std::string paldata_path;
 	chrgfx::render_config render_cfg;
 	std::string out_png_path;
+	chrgfx::png_compression png_cfg;
 	uint pal_line {0};
+	std::string linemap_path;
+	data_extent data_offset;
+	std::optional<data_extent> data_count;
+	uint chr_interleave {0};
+	chrgfx::transform_chain transforms;
+	chrgfx::compression_format compression {chrgfx::compression_format::none};
+	std::string scan_chrdefs;
+	size_t scan_results {20};
+	uint scan_alignment_step {1};
+	std::string batch_path;
+	uint batch_threads {0};
 } cfg;
 
-void process_args(int argc, char ** argv)
+/**
+ * @brief Parse command line arguments into the given config
+ * @note The options must already have been added to the shared lists by process_args
+ */
+void parse_args(int argc, char ** argv, runtime_config_chr2png & cfg)
 {
-	// add chr2png specific options
-	long_opts.push_back({"chr-data", required_argument, nullptr, 'c'});
-	long_opts.push_back({"pal-data", required_argument, nullptr, 'p'});
-	long_opts.push_back({"pal-line", required_argument, nullptr, 'l'});
-	long_opts.push_back({"trns-index", required_argument, nullptr, 'i'});
-	long_opts.push_back({"row-size", required_argument, nullptr, 'r'});
-	long_opts.push_back({"output", required_argument, nullptr, 'o'});
-	long_opts.push_back({nullptr, 0, nullptr, 0});
-	short_opts.append("c:p:l:i:r:o:");
-
-	opt_details.push_back({false, "Path to input encoded tiles", nullptr});
-	opt_details.push_back({false, "Path to input encoded palette", nullptr});
-	opt_details.push_back({false, "Palette line to use for PNG output", nullptr});
-	opt_details.push_back({false, "Palette index to use for transparency", nullptr});
-	opt_details.push_back({false, "Number of tiles per row in output image", nullptr});
-	opt_details.push_back({false, "Path to output PNG image", nullptr});
-
 	// read/parse arguments
 	while (true)
 	{
@@ -72,6 +76,11 @@ void process_args(int argc, char ** argv)
 				}
 				break;
 
+			// palette line of each tile
+			case 'm':
+				cfg.linemap_path = optarg;
+				break;
+
 			// palette entry index for transparency
 			case 'i':
 				try
@@ -100,10 +109,219 @@ void process_args(int argc, char ** argv)
 				}
 				break;
 
+			// placement of the tiles in the image
+			case 'a':
+				cfg.render_cfg.arrangement = parse_arrangement(optarg);
+				break;
+
 			// png output path
 			case 'o':
 				cfg.out_png_path = optarg;
 				break;
+
+			// png compression level
+			case 'z':
+				try
+				{
+					auto level {std::stoi(optarg)};
+					if (level < 0 || level > 9)
+						throw std::invalid_argument("Invalid compression level value");
+					cfg.png_cfg.level = level;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid compression level value");
+				}
+				break;
+
+			// png scanline filter
+			case 'f':
+			{
+				std::string filter {optarg};
+				if (filter == "none")
+					cfg.png_cfg.filter = chrgfx::png_filter::none;
+				else if (filter == "sub")
+					cfg.png_cfg.filter = chrgfx::png_filter::sub;
+				else if (filter == "up")
+					cfg.png_cfg.filter = chrgfx::png_filter::up;
+				else if (filter == "average")
+					cfg.png_cfg.filter = chrgfx::png_filter::average;
+				else if (filter == "paeth")
+					cfg.png_cfg.filter = chrgfx::png_filter::paeth;
+				else if (filter == "adaptive")
+					cfg.png_cfg.filter = chrgfx::png_filter::adaptive;
+				else
+					throw std::invalid_argument("Invalid PNG filter value");
+				break;
+			}
+
+			// zlib compression strategy
+			case 's':
+			{
+				std::string strategy {optarg};
+				if (strategy == "default")
+					cfg.png_cfg.strategy = chrgfx::png_strategy::standard;
+				else if (strategy == "filtered")
+					cfg.png_cfg.strategy = chrgfx::png_strategy::filtered;
+				else if (strategy == "huffman")
+					cfg.png_cfg.strategy = chrgfx::png_strategy::huffman_only;
+				else if (strategy == "rle")
+					cfg.png_cfg.strategy = chrgfx::png_strategy::rle;
+				else
+					throw std::invalid_argument("Invalid compression strategy value");
+				break;
+			}
+
+			// start of the tile data to convert
+			case 'O':
+				cfg.data_offset = parse_data_extent(optarg);
+				break;
+
+			// amount of tile data to convert
+			case 'n':
+				cfg.data_count = parse_data_extent(optarg);
+				break;
+
+			// interleave width for split tile data
+			case 'I':
+				try
+				{
+					auto width {std::stoi(optarg)};
+					if (width < 1)
+						throw std::invalid_argument("Invalid interleave width value");
+					cfg.chr_interleave = width;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid interleave width value");
+				}
+				break;
+
+			// transforms to apply to the tile data before decoding
+			case 'X':
+				cfg.transforms = parse_transforms(optarg);
+				break;
+
+			// compression of the tile data
+			case 'Z':
+				cfg.compression = parse_compression(optarg);
+				break;
+
+			// chrdefs to search the tile data with
+			case 'S':
+				cfg.scan_chrdefs = optarg;
+				break;
+
+			// number of scan results to report
+			case 'R':
+				try
+				{
+					auto results {std::stoi(optarg)};
+					if (results < 1)
+						throw std::invalid_argument("Invalid scan result count value");
+					cfg.scan_results = results;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid scan result count value");
+				}
+				break;
+
+			// distance between the alignments tried in scan mode
+			case 'A':
+				try
+				{
+					auto step {std::stoi(optarg)};
+					if (step < 1)
+						throw std::invalid_argument("Invalid scan alignment value");
+					cfg.scan_alignment_step = step;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid scan alignment value");
+				}
+				break;
+
+			// batch manifest path
+			case 'B':
+				cfg.batch_path = optarg;
+				break;
+
+			// batch worker threads
+			case 't':
+				try
+				{
+					auto threads {std::stoi(optarg)};
+					if (threads < 0)
+						throw std::invalid_argument("Invalid thread count value");
+					cfg.batch_threads = threads;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid thread count value");
+				}
+				break;
 		}
 	}
-}
\ No newline at end of file
+}
+
+void process_args(int argc, char ** argv)
+{
+	// add chr2png specific options
+	long_opts.push_back({"chr-data", required_argument, nullptr, 'c'});
+	long_opts.push_back({"pal-data", required_argument, nullptr, 'p'});
+	long_opts.push_back({"pal-line", required_argument, nullptr, 'l'});
+	long_opts.push_back({"line-map", required_argument, nullptr, 'm'});
+	long_opts.push_back({"trns-index", required_argument, nullptr, 'i'});
+	long_opts.push_back({"row-size", required_argument, nullptr, 'r'});
+	long_opts.push_back({"arrange", required_argument, nullptr, 'a'});
+	long_opts.push_back({"output", required_argument, nullptr, 'o'});
+	long_opts.push_back({"png-level", required_argument, nullptr, 'z'});
+	long_opts.push_back({"png-filter", required_argument, nullptr, 'f'});
+	long_opts.push_back({"png-strategy", required_argument, nullptr, 's'});
+	long_opts.push_back({"offset", required_argument, nullptr, 'O'});
+	long_opts.push_back({"count", required_argument, nullptr, 'n'});
+	long_opts.push_back({"interleave", required_argument, nullptr, 'I'});
+	long_opts.push_back({"transform", required_argument, nullptr, 'X'});
+	long_opts.push_back({"compression", required_argument, nullptr, 'Z'});
+	long_opts.push_back({"scan", required_argument, nullptr, 'S'});
+	long_opts.push_back({"scan-results", required_argument, nullptr, 'R'});
+	long_opts.push_back({"scan-align", required_argument, nullptr, 'A'});
+	long_opts.push_back({"batch", required_argument, nullptr, 'B'});
+	long_opts.push_back({"threads", required_argument, nullptr, 't'});
+	long_opts.push_back({nullptr, 0, nullptr, 0});
+	short_opts.append("c:p:l:m:i:r:a:o:z:f:s:O:n:I:X:Z:S:R:A:B:t:");
+
+	opt_details.push_back({false, "Path to input encoded tiles", nullptr});
+	opt_details.push_back({false, "Path to input encoded palette", nullptr});
+	opt_details.push_back({false, "Palette line to use for PNG output", nullptr});
+	opt_details.push_back(
+		{false, "Path to the palette line of each tile, one byte per tile; renders each tile in its own line as an RGBA PNG", "PATH"});
+	opt_details.push_back({false, "Palette index to use for transparency", nullptr});
+	opt_details.push_back({false, "Number of tiles per row in output image", nullptr});
+	opt_details.push_back(
+		{false, "Place tiles in groups: <W>x<H>, rows/columns, seq=<list>, down, gutter=<N> (e.g. 2x2,columns)", "LIST"});
+	opt_details.push_back({false, "Path to output PNG image", nullptr});
+	opt_details.push_back({false, "PNG compression level, 0 (none) to 9 (best); default 6", nullptr});
+	opt_details.push_back({false, "PNG scanline filter: none (default), sub, up, average, paeth, adaptive", nullptr});
+	opt_details.push_back({false, "PNG compression strategy: default, filtered, huffman, rle", nullptr});
+	opt_details.push_back(
+		{false, "Start of the tile data to convert, in bytes, or in tiles with a t suffix (e.g. 0x8000, 512t)", nullptr});
+	opt_details.push_back({false, "Amount of tile data to convert, in bytes or tiles (default: to the end)", nullptr});
+	opt_details.push_back(
+		{false, "Interleave width in bytes for tile data split across files; list the files with commas in --chr-data", nullptr});
+	opt_details.push_back({false, "Transforms to apply to the tile data before decoding: swap16, swap32, bitrev, deint<N>", "LIST"});
+	opt_details.push_back(
+		{false, "Decompress the tile data first: gzip, lz77, kosinski, nemesis; the offset and count select the compressed data", "FORMAT"});
+	opt_details.push_back(
+		{false, "Search the tile data for graphics with each of a comma separated list of chrdefs; --output names a directory for thumbnails", "LIST"});
+	opt_details.push_back({false, "Number of candidates to report in scan mode (default 20)", nullptr});
+	opt_details.push_back(
+		{false, "Distance in bytes between the tile alignments tried in scan mode (default 1, every alignment)", nullptr});
+	opt_details.push_back({false, "Path to batch manifest; each line holds the options for one conversion", "PATH"});
+	opt_details.push_back({false, "Number of worker threads for batch and scan modes (default: one per core)", nullptr});
+
+	parse_args(argc, argv, cfg);
+}
+
+} // namespace chr2png
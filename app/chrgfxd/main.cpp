@@ -0,0 +1,224 @@
+#include "../chr2png/chr2png.hpp"
+#include "../png2chr/png2chr.hpp"
+#include "daemon.hpp"
+#include "gfxdefman.hpp"
+#include "setup.hpp"
+#include "xdgdirs.hpp"
+#include <chrgfx/chrgfx.hpp>
+
+#include <csignal>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+	Each accepted connection is handed to a forked child which runs the job with the client's standard streams and
+	working directory. Everything the daemon loads at startup (the library, parsed gfxdefs files, and the chrdefs and
+	tile decoders built from them and the library) is inherited by the child, so a job costs a fork instead of a process
+	launch and setup.
+
+	The parent keeps the connection open and reports the exit status of the child back to the client.
+*/
+
+// written to by the signal handlers to wake up the main loop
+static int signal_pipe[2];
+static volatile sig_atomic_t stop_requested {0};
+static volatile sig_atomic_t reload_requested {0};
+
+static void on_signal(int signal)
+{
+	if (signal == SIGTERM || signal == SIGINT)
+		stop_requested = 1;
+	else if (signal == SIGHUP)
+		reload_requested = 1;
+
+	auto const saved_errno {errno};
+	char const c {0};
+	[[maybe_unused]] auto result {write(signal_pipe[1], &c, 1)};
+	errno = saved_errno;
+}
+
+static void preload_gfxdefs()
+{
+	gfxdef_manager::clear_preloaded();
+
+	if (! cfg.gfxdefs_path.empty())
+		gfxdef_manager::preload_file(cfg.gfxdefs_path);
+	else
+		for (auto const & path : motoi::data_filepaths(GFXDEF_SUBDIR))
+			gfxdef_manager::preload_file(path);
+
+	// as with the chrdefs from the files above, the decoders for the library's chrdefs are then inherited by every job
+	chrgfx::gfxdef_registry::global().build_decoders();
+}
+
+[[noreturn]] static void run_job(int conn)
+{
+	int status {-1};
+	try
+	{
+		auto job {receive_job(conn)};
+		close(conn);
+
+		if (chdir(job.cwd.c_str()) != 0)
+			throw system_error(errno, generic_category(), "Could not change to client directory " + job.cwd);
+
+		vector<char *> argv;
+		for (auto & arg : job.args)
+			argv.push_back(arg.data());
+		argv.push_back(nullptr);
+		int const argc {static_cast<int>(job.args.size())};
+
+		if (job.tool == "chr2png")
+			status = chr2png::run(argc, argv.data());
+		else if (job.tool == "png2chr")
+			status = png2chr::run(argc, argv.data());
+		else
+			throw runtime_error("Unsupported tool: " + job.tool);
+	}
+	catch (exception const & e)
+	{
+		cerr << "Error: " << e.what() << '\n';
+	}
+
+	// exit (rather than _exit) so the client's streams are flushed
+	exit(status);
+}
+
+// keeps the sockets and pipes opened below out of the standard stream slots if the daemon was started with any of
+// them closed, where messages to cerr would otherwise be sent to (and fail on) a socket
+static void reserve_std_streams()
+{
+	for (int fd {0}; fd <= STDERR_FILENO; ++fd)
+		if (fcntl(fd, F_GETFD) < 0)
+			open("/dev/null", O_RDWR);
+}
+
+int main(int argc, char ** argv)
+{
+	reserve_std_streams();
+
+	try
+	{
+		process_args(argc, argv);
+
+		if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+			throw system_error(errno, generic_category(), "Could not create signal pipe");
+
+		struct sigaction action {};
+		action.sa_handler = on_signal;
+		sigemptyset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		sigaction(SIGCHLD, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGHUP, &action, nullptr);
+		signal(SIGPIPE, SIG_IGN);
+
+		preload_gfxdefs();
+
+		int const listener {daemon_listen(cfg.socket_path)};
+		cerr << "chrgfxd listening on " << cfg.socket_path << '\n';
+
+		// connections waiting on a job, by the pid of the child running it
+		map<pid_t, int> jobs;
+
+		pollfd fds[2] {{listener, POLLIN, 0}, {signal_pipe[0], POLLIN, 0}};
+		while (! stop_requested)
+		{
+			if (poll(fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw system_error(errno, generic_category(), "poll failed");
+			}
+
+			if (fds[1].revents & POLLIN)
+			{
+				char drain[64];
+				while (read(signal_pipe[0], drain, sizeof(drain)) > 0)
+					;
+
+				// report finished jobs back to their clients
+				int wait_status;
+				pid_t pid;
+				while ((pid = waitpid(-1, &wait_status, WNOHANG)) > 0)
+				{
+					auto job {jobs.find(pid)};
+					if (job == jobs.end())
+						continue;
+
+					int status {-1};
+					if (WIFEXITED(wait_status))
+						status = WEXITSTATUS(wait_status);
+					else if (WIFSIGNALED(wait_status))
+						status = 128 + WTERMSIG(wait_status);
+
+					try
+					{
+						send_status(job->second, status);
+					}
+					catch (exception const &)
+					{
+						// the client went away; nothing more to do for it
+					}
+					close(job->second);
+					jobs.erase(job);
+				}
+
+				if (reload_requested)
+				{
+					reload_requested = 0;
+					cerr << "Reloading gfxdefs\n";
+					preload_gfxdefs();
+				}
+			}
+
+			if (fds[0].revents & POLLIN)
+			{
+				int const conn {accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)};
+				if (conn < 0)
+					continue;
+
+				cerr.flush();
+				auto const pid {fork()};
+				if (pid < 0)
+				{
+					cerr << "Could not fork for job: " << strerror(errno) << '\n';
+					close(conn);
+					continue;
+				}
+
+				if (pid == 0)
+				{
+					close(listener);
+					close(signal_pipe[0]);
+					close(signal_pipe[1]);
+					signal(SIGCHLD, SIG_DFL);
+					signal(SIGTERM, SIG_DFL);
+					signal(SIGINT, SIG_DFL);
+					signal(SIGHUP, SIG_DFL);
+					signal(SIGPIPE, SIG_DFL);
+					run_job(conn);
+				}
+
+				jobs.emplace(pid, conn);
+			}
+		}
+
+		close(listener);
+		unlink(cfg.socket_path.c_str());
+		return 0;
+	}
+	catch (exception const & e)
+	{
+		cerr << "Error: " << e.what() << '\n';
+		return -1;
+	}
+}
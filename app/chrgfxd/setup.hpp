@@ -0,0 +1,69 @@
+#ifndef __MOTOI__SETUP_HPP
+#define __MOTOI__SETUP_HPP
+
+#include "daemon.hpp"
+#include "usage.hpp"
+#include <getopt.h>
+#include <iostream>
+#include <string>
+
+struct runtime_config_chrgfxd
+{
+	std::string socket_path {default_daemon_socket_path()};
+	std::string gfxdefs_path;
+} cfg;
+
+void process_args(int argc, char ** argv)
+{
+	/*
+		These are kept local rather than added to the shared option lists, since the jobs run by the daemon build their
+		options from the shared lists as they were at startup
+	*/
+	option const long_opts[] {
+		{"socket", required_argument, nullptr, 's'},
+		{"gfxdefs-path", required_argument, nullptr, 'G'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0},
+	};
+
+	motoi::option_details const opt_details[] {
+		{false, "Path to the socket to listen on (default: $CHRGFXD_SOCKET, or chrgfxd.sock in $XDG_RUNTIME_DIR)", "PATH"},
+		{false, "Filepath to graphics encoding definitions file to preload", "PATH"},
+		{false, "Display program usage", nullptr},
+	};
+
+	while (true)
+	{
+		const auto this_opt = getopt_long(argc, argv, ":s:G:h", long_opts, nullptr);
+		if (this_opt == -1)
+			break;
+
+		switch (this_opt)
+		{
+			case 's':
+				cfg.socket_path = optarg;
+				break;
+
+			case 'G':
+				cfg.gfxdefs_path = optarg;
+				break;
+
+			case 'h':
+				motoi::show_usage(long_opts, opt_details, std::cout);
+				exit(0);
+
+			case ':':
+				std::cerr << "Missing arg for option: " << std::to_string(optopt) << '\n';
+				exit(-1);
+
+			default:
+				std::cerr << "Unknown argument" << '\n';
+				exit(-2);
+		}
+	}
+
+	// jobs are parsed with getopt in the child processes, so reset it for them
+	optind = 1;
+}
+
+#endif
@@ -0,0 +1,497 @@
+#include "batch.hpp"
+#include "filesys.hpp"
+#include "gfxdefman.hpp"
+#include "png2chr.hpp"
+#include "setup.hpp"
+#include "tilemanifest.hpp"
+#include <chrgfx/chrgfx.hpp>
+#include <cerrno>
+#include <getopt.h>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+#ifdef DEBUG
+#include <chrono>
+#endif
+
+using namespace std;
+using namespace chrgfx;
+using namespace motoi;
+
+namespace png2chr
+{
+
+static void append_encoding_fields(chrdef const & chrdef, vector<uint32> & fields)
+{
+	fields.insert(fields.end(), {chrdef.width(), chrdef.height(), chrdef.bpp()});
+	for (auto const * offsets : {&chrdef.pixel_offsets(), &chrdef.row_offsets(), &chrdef.plane_offsets()})
+	{
+		fields.push_back(offsets->size());
+		fields.insert(fields.end(), offsets->begin(), offsets->end());
+	}
+
+	// tiles made of sub-tiles which are not on a regular grid have no pixel offsets of their own
+	if (chrdef.pixel_offsets().empty() && chrdef.subtile() != nullptr)
+	{
+		fields.insert(fields.end(), {chrdef.subtile_columns(), chrdef.subtile_rows()});
+		fields.insert(fields.end(), chrdef.subtile_offsets().begin(), chrdef.subtile_offsets().end());
+		append_encoding_fields(*chrdef.subtile(), fields);
+	}
+}
+
+/**
+ * @brief Identifies the tile encoding and transforms; tiles from separate runs can only be compared if these match
+ */
+static uint64_t encoding_settings_hash(chrdef const & chrdef, transform_chain const & transforms)
+{
+	vector<uint32> fields;
+	append_encoding_fields(chrdef, fields);
+	for (auto const & transform : transforms)
+	{
+		fields.push_back(static_cast<uint32>(transform.op));
+		fields.push_back(transform.ways);
+	}
+
+	// hashed as little endian bytes so that manifests can be shared between platforms
+	uint64_t hash {FNV1A_64_BASIS};
+	for (auto const field : fields)
+	{
+		byte_t const bytes[4] {
+			(byte_t) field, (byte_t) (field >> 8), (byte_t) (field >> 16), (byte_t) (field >> 24)};
+		hash = fnv1a_64(bytes, sizeof(bytes), hash);
+	}
+	return hash;
+}
+
+/**
+ * @brief Load a PNG image of any color type
+ * @details Indexed color images are used as they are. Any other kind is quantized to a palette that fits both the
+ * tile and palette formats, made up of colors the color format can represent; transparent pixels are given entry 0.
+ *
+ * With palette lines, the image is always quantized, with the tiles divided between the lines, and the line of each
+ * tile is returned in tile_lines.
+ */
+static chrgfx::image load_png(istream & png_data,
+	runtime_config_png2chr const & cfg,
+	gfxdef_manager & defs,
+	uint const threads,
+	vector<uint8> & tile_lines)
+{
+	// the color type is in the header, so the data is buffered to check it before choosing how to decode
+	string const png_buffer {istreambuf_iterator<char>(png_data), istreambuf_iterator<char>()};
+	istringstream png_stream(png_buffer);
+	uint const quantize_threads {threads == 0 ? max(1u, thread::hardware_concurrency()) : threads};
+
+	if (cfg.pal_lines > 0)
+	{
+		if (defs.chrdef() == nullptr)
+			throw runtime_error("no chrdef loaded");
+		if (cfg.dither != dither_mode::none)
+			throw invalid_argument("Dithering cannot be used with palette lines");
+
+		palette_line_config line_cfg;
+		line_cfg.tile_width = defs.chrdef()->width();
+		line_cfg.tile_height = defs.chrdef()->height();
+		line_cfg.lines = cfg.pal_lines;
+		// the line is selected by the index bits above those stored in the tile
+		line_cfg.line_colors = 1u << min(defs.chrdef()->bpp(), 8u);
+		line_cfg.trns_index = 0;
+		line_cfg.threads = quantize_threads;
+
+		png::image<png::rgba_pixel> png_image {png_stream, png::convert_color_space<png::rgba_pixel>()};
+		auto const & png_pixbuf {png_image.get_pixbuf()};
+		uint const width {png_pixbuf.get_width()}, height {png_pixbuf.get_height()};
+		vector<byte_t> rgba_data((size_t) width * height * 4);
+		auto ptr {rgba_data.data()};
+		for (uint i_row {0}; i_row < height; ++i_row)
+		{
+			for (auto const & png_pixel : png_pixbuf.get_row(i_row))
+			{
+				*ptr++ = png_pixel.red;
+				*ptr++ = png_pixel.green;
+				*ptr++ = png_pixel.blue;
+				*ptr++ = png_pixel.alpha;
+			}
+		}
+
+		auto result {quantize_tile_lines(defs.coldef(), rgba_data.data(), width, height, line_cfg)};
+
+		// the lines are found for the tiles of the image from left to right; put them in the order the tiles are stored
+		auto const layout {
+			layout_image_tiles(cfg.arrangement, line_cfg.tile_width, line_cfg.tile_height, width, height)};
+		size_t const grid_columns {width / line_cfg.tile_width};
+		tile_lines.resize(layout.positions.size());
+		for (size_t i_tile {0}; i_tile < layout.positions.size(); ++i_tile)
+		{
+			auto const & position {layout.positions[i_tile]};
+			if (position.x % line_cfg.tile_width != 0 || position.y % line_cfg.tile_height != 0)
+				throw invalid_argument("With palette lines, the arrangement gutter must be a whole number of tiles");
+			tile_lines[i_tile] = result.tile_lines[((position.y / line_cfg.tile_height) * grid_columns) +
+																						 (position.x / line_cfg.tile_width)];
+		}
+
+		return std::move(result.bitmap);
+	}
+
+	size_t constexpr COLOR_TYPE_OFFSET {25};
+	byte_t constexpr COLOR_TYPE_PALETTE {3};
+	if (png_buffer.size() <= COLOR_TYPE_OFFSET || png_buffer[COLOR_TYPE_OFFSET] == COLOR_TYPE_PALETTE)
+		return from_png({png_stream, png::require_color_space<png::index_pixel>()});
+
+	quantize_config quantize_cfg;
+	if (! cfg.out_chrdata_path.empty() && defs.chrdef() != nullptr && defs.chrdef()->bpp() < 8)
+		quantize_cfg.colors = 1u << defs.chrdef()->bpp();
+	if (! cfg.out_paldata_path.empty() && defs.paldef() != nullptr)
+		quantize_cfg.colors = min(quantize_cfg.colors, defs.paldef()->length());
+	quantize_cfg.trns_index = 0;
+	quantize_cfg.dither = cfg.dither;
+	quantize_cfg.threads = quantize_threads;
+
+	return from_png({png_stream, png::convert_color_space<png::rgba_pixel>()}, defs.coldef(), quantize_cfg);
+}
+
+/**
+ * @brief Run a single conversion with gfxdefs that have already been loaded
+ * @param threads Number of threads for image processing, or 0 for one per core
+ * @note Must not modify shared state, as batch jobs are run on multiple threads
+ */
+static void convert(runtime_config_png2chr const & cfg, gfxdef_manager & defs, uint const threads)
+{
+#ifdef DEBUG
+	chrono::high_resolution_clock::time_point t1, t2;
+#endif
+
+	/*******************************************************
+	 *            SETUP & SANITY CHECKING
+	 *******************************************************/
+
+#ifdef DEBUG
+	t1 = chrono::high_resolution_clock::now();
+#endif
+	istream * png_data;
+	ifstream ifs_png_data;
+	if (cfg.pngdata_path.empty())
+	{
+		png_data = &cin;
+	}
+	else
+	{
+		ifs_png_data = ifstream_checked(cfg.pngdata_path);
+		png_data = &ifs_png_data;
+	}
+
+#ifdef DEBUG
+	t2 = chrono::high_resolution_clock::now();
+	auto duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+	cerr << "SETUP: " << duration << "ms\n";
+#endif
+
+	/*******************************************************
+	 *             LOAD IMAGE
+	 *******************************************************/
+
+#ifdef DEBUG
+	t1 = chrono::high_resolution_clock::now();
+#endif
+
+	vector<uint8> tile_lines;
+	auto image_data {load_png(*png_data, cfg, defs, threads, tile_lines)};
+
+#ifdef DEBUG
+	t2 = chrono::high_resolution_clock::now();
+	duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+	cerr << "LOAD PNG: " << to_string(duration) << "ms\n";
+#endif
+
+	if (! cfg.out_linedata_path.empty())
+	{
+		if (cfg.pal_lines == 0)
+			throw invalid_argument("Palette line output requires a number of palette lines");
+
+		auto line_outfile {ofstream_checked(cfg.out_linedata_path)};
+		line_outfile.write(reinterpret_cast<char const *>(tile_lines.data()), tile_lines.size());
+		if (! line_outfile.good())
+			throw runtime_error("Failed to write palette line data");
+	}
+
+	/*******************************************************
+	 *                 TILE SEGMENTATION
+	 *******************************************************/
+
+	if (! cfg.out_chrdata_path.empty())
+	{
+		if (defs.chrdef() == nullptr)
+			throw runtime_error("no chrdef loaded");
+
+#ifdef DEBUG
+		t1 = chrono::high_resolution_clock::now();
+#endif
+
+		auto const chr_layout {layout_image_tiles(
+			cfg.arrangement, defs.chrdef()->width(), defs.chrdef()->height(), image_data.width(), image_data.height())};
+		size_t const chr_datasize {defs.chrdef()->width() * defs.chrdef()->height()},
+			tileset_datasize {chr_layout.positions.size() * chr_datasize};
+		vector<byte_t> tileset_data(tileset_datasize);
+		make_tileset(*defs.chrdef(), image_data, tileset_data.data(), cfg.arrangement);
+
+#ifdef DEBUG
+		t2 = chrono::high_resolution_clock::now();
+		duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+		cerr << "TILE SEGMENTATION: " << to_string(duration) << "ms\n";
+		cerr << "TILE COUNT: " << (tileset_data.size() / (defs.chrdef()->width() * defs.chrdef()->height())) << '\n';
+#endif
+
+		/*
+			Pixel values which need more bits than the tile format stores would otherwise be cut down silently by the
+			encoder. With palette lines, the high bits are the line and are meant to be dropped.
+		*/
+		if (cfg.pal_lines == 0 && ! cfg.mask_pixels)
+		{
+			auto const bad_tiles {find_out_of_range_tiles(*defs.chrdef(), tileset_data.data(), tileset_data.size())};
+			if (! bad_tiles.empty())
+			{
+				size_t const max_listed {8};
+				ostringstream msg;
+				msg << bad_tiles.size() << " tile(s) have pixel values too large for a " << defs.chrdef()->bpp()
+						<< "bpp tile format, at pixel position:";
+				for (size_t i {0}; i < bad_tiles.size() && i < max_listed; ++i)
+				{
+					auto const & position {chr_layout.positions[bad_tiles[i]]};
+					msg << " (" << position.x << ", " << position.y << ")";
+				}
+				if (bad_tiles.size() > max_listed)
+					msg << " ...";
+				msg << "; use --mask-pixels to keep only the low bits";
+				throw runtime_error(msg.str());
+			}
+		}
+
+		/*******************************************************
+		 *            TILE CONVERSION & OUTPUT
+		 *******************************************************/
+
+#ifdef DEBUG
+		t1 = chrono::high_resolution_clock::now();
+#endif
+		size_t in_chunksize {(size_t) (defs.chrdef()->width() * defs.chrdef()->height())},
+			out_chunksize {(uint) (defs.chrdef()->datasize_bytes())}, chr_count {tileset_data.size() / in_chunksize};
+
+		// the transforms describe how the data is stored, so the reverse is applied to store it
+		auto const store_transforms {inverse_transforms(cfg.transforms)};
+		auto encode_tiles = [&](size_t const first_chr, size_t const count, byte_t * out) {
+			auto ptr_in_tile {tileset_data.data() + (first_chr * in_chunksize)};
+			auto ptr_out_tile {out};
+			for (size_t i_chr {0}; i_chr < count; ++i_chr)
+			{
+				encode_chr(*defs.chrdef(), ptr_in_tile, ptr_out_tile);
+				ptr_in_tile += in_chunksize;
+				ptr_out_tile += out_chunksize;
+			}
+			apply_transforms(store_transforms, out, count * out_chunksize);
+		};
+
+		/*
+			In incremental mode, the tiles are compared with the hashes recorded when the output was last written. If the
+			output is unchanged since then, only the tiles which differ are encoded and written over the old ones.
+		*/
+		tile_manifest manifest;
+		string const manifest_path {cfg.out_chrdata_path + ".tilehash"};
+		bool patched {false};
+		if (cfg.incremental)
+		{
+			// tiles are written individually, so each must be stored independently of the others
+			size_t const transform_block {transform_block_size(cfg.transforms)};
+			if (cfg.chr_offset)
+				throw invalid_argument("Incremental output cannot be used with a tile data offset");
+			if (cfg.compression != compression_format::none ||
+					(! cfg.transforms.empty() && (transform_block == 0 || out_chunksize % transform_block != 0)))
+				throw invalid_argument("Incremental output cannot be used with compression or transforms across tiles");
+
+			manifest.settings_hash = encoding_settings_hash(*defs.chrdef(), cfg.transforms);
+			manifest.tile_hashes = hash_tileset(*defs.chrdef(), tileset_data.data(), tileset_data.size());
+
+			auto const previous {tile_manifest::load(manifest_path)};
+			if (previous && previous->settings_hash == manifest.settings_hash && previous->matches(cfg.out_chrdata_path) &&
+					previous->data_size == previous->tile_hashes.size() * out_chunksize)
+			{
+				auto const & previous_hashes {previous->tile_hashes};
+				auto const is_changed = [&](size_t const i_chr) {
+					return i_chr >= previous_hashes.size() || manifest.tile_hashes[i_chr] != previous_hashes[i_chr];
+				};
+
+				auto chr_outfile {fstream_checked(cfg.out_chrdata_path)};
+				vector<byte_t> changed_data;
+				size_t changed_count {0};
+				for (size_t i_chr {0}; i_chr < chr_count;)
+				{
+					if (! is_changed(i_chr))
+					{
+						++i_chr;
+						continue;
+					}
+
+					// consecutive changed tiles are written together
+					size_t run_end {i_chr + 1};
+					while (run_end < chr_count && is_changed(run_end))
+						++run_end;
+
+					changed_data.resize((run_end - i_chr) * out_chunksize);
+					encode_tiles(i_chr, run_end - i_chr, changed_data.data());
+					chr_outfile.seekp(i_chr * out_chunksize);
+					chr_outfile.write(reinterpret_cast<char const *>(changed_data.data()), changed_data.size());
+					changed_count += run_end - i_chr;
+					i_chr = run_end;
+				}
+				if (! chr_outfile.good())
+					throw runtime_error("Failed to write tile data");
+				chr_outfile.close();
+
+				if (chr_count < previous_hashes.size() && truncate(cfg.out_chrdata_path.c_str(), chr_count * out_chunksize) != 0)
+					throw system_error(errno, generic_category(), "Could not truncate tile data");
+
+				patched = true;
+#ifdef DEBUG
+				cerr << "CHANGED TILES: " << changed_count << '\n';
+#endif
+			}
+		}
+
+		if (! patched)
+		{
+			// encode everything first so that the transforms can be applied across all of the data
+			vector<byte_t> chr_data(chr_count * out_chunksize);
+			encode_tiles(0, chr_count, chr_data.data());
+
+			if (auto compressor {make_compressor(cfg.compression, 9)})
+			{
+				vector<byte_t> compressed;
+				compressor->compress(chr_data.data(), chr_data.size(), compressed);
+				compressor->finish(compressed);
+				chr_data = std::move(compressed);
+			}
+
+			if (cfg.chr_offset)
+			{
+				// injected into an existing file, such as a ROM, leaving the rest of it untouched
+				patch_file(cfg.out_chrdata_path, cfg.chr_offset->bytes(out_chunksize), chr_data.data(), chr_data.size());
+			}
+			else
+			{
+				auto chr_outfile {ofstream_checked(cfg.out_chrdata_path)};
+				chr_outfile.write(reinterpret_cast<char const *>(chr_data.data()), chr_data.size());
+				if (! chr_outfile.good())
+					throw runtime_error("Failed to write tile data");
+			}
+		}
+
+		if (cfg.incremental)
+		{
+			manifest.stamp(cfg.out_chrdata_path);
+			manifest.save(manifest_path);
+		}
+
+#ifdef DEBUG
+		t2 = chrono::high_resolution_clock::now();
+		duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+		cerr << "TILE ENCODE/OUTPUT: " << to_string(duration) << "ms\n";
+#endif
+	}
+
+	/*******************************************************
+	 *                PALETTE CONVERSION
+	 *******************************************************/
+	if (! cfg.out_paldata_path.empty())
+	{
+		if (defs.paldef() == nullptr)
+			throw runtime_error("no paldef loaded");
+		if (defs.coldef() == nullptr)
+			throw runtime_error("no coldef loaded");
+
+#ifdef DEBUG
+		t1 = chrono::high_resolution_clock::now();
+#endif
+
+		// with palette lines, every line is written, in as many palettes as it takes to hold them
+		size_t const pal_length {defs.paldef()->length()}, pal_datasize {defs.paldef()->datasize_bytes()},
+			pal_count {cfg.pal_lines == 0 || defs.chrdef() == nullptr
+									 ? 1
+									 : (((size_t) cfg.pal_lines << min(defs.chrdef()->bpp(), 8u)) + pal_length - 1) / pal_length};
+		vector<byte_t> paldef_palette_data(pal_count * pal_datasize);
+		for (size_t i_pal {0}; i_pal < pal_count; ++i_pal)
+		{
+			palette pal {};
+			auto const & color_map {*image_data.color_map()};
+			for (size_t i_entry {0}; i_entry < pal_length && (i_pal * pal_length) + i_entry < color_map.size(); ++i_entry)
+				pal[i_entry] = color_map[(i_pal * pal_length) + i_entry];
+			encode_pal(*defs.paldef(), *defs.coldef(), &pal, paldef_palette_data.data() + (i_pal * pal_datasize));
+		}
+
+#ifdef DEBUG
+		t2 = chrono::high_resolution_clock::now();
+		duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+		cerr << "CONVERT PALETTE: " << to_string(duration) << "ms\n";
+#endif
+
+#ifdef DEBUG
+		t1 = chrono::high_resolution_clock::now();
+#endif
+
+		if (cfg.pal_offset)
+		{
+			patch_file(cfg.out_paldata_path, cfg.pal_offset->bytes(pal_datasize), paldef_palette_data.data(),
+				paldef_palette_data.size());
+		}
+		else
+		{
+			ofstream pal_outfile {ofstream_checked(cfg.out_paldata_path)};
+			pal_outfile.write(reinterpret_cast<char *>(paldef_palette_data.data()), paldef_palette_data.size());
+		}
+
+#ifdef DEBUG
+		t2 = chrono::high_resolution_clock::now();
+		duration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+
+		cerr << "PAL OUTPUT TO STREAM: " << to_string(duration) << "ms\n";
+#endif
+	}
+}
+
+int run(int argc, char ** argv)
+{
+	try
+	{
+		process_args(argc, argv);
+
+		if (! cfg.batch_path.empty())
+		{
+			return run_batch(cfg, parse_args, [](runtime_config_png2chr const & job_cfg, gfxdef_manager & defs) {
+				// there is only one stdin, so batch jobs must use files
+				if (job_cfg.pngdata_path.empty())
+					throw invalid_argument("No input PNG path specified");
+				// the jobs already keep every thread busy
+				convert(job_cfg, defs, 1);
+			});
+		}
+
+		gfxdef_manager defs(cfg);
+		convert(cfg, defs, cfg.batch_threads);
+
+		// everything's good, we're outta here
+		return 0;
+	}
+	catch (exception const & e)
+	{
+		cerr << "Error: " << e.what() << '\n';
+		return -1;
+	}
+}
+
+} // namespace png2chr
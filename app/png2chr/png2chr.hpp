@@ -0,0 +1,24 @@
+/**
+ * @file png2chr.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2022 Motoi Productions / Released under MIT License
+ * @brief Convert PNG image input to encoded tile graphics
+ */
+
+#ifndef __CHRGFX__PNG2CHR_HPP
+#define __CHRGFX__PNG2CHR_HPP
+
+namespace png2chr
+{
+
+/**
+ * @brief Parses the command line and runs a single conversion
+ * @note Kept separate from main() so that the job can also be run by chrgfxd
+ *
+ * @return int Program exit code
+ */
+int run(int argc, char ** argv);
+
+} // namespace png2chr
+
+#endif
@@ -1,29 +1,40 @@
 #ifndef __MOTOI__SETUP_HPP
 #define __MOTOI__SETUP_HPP
 
+#include "quantize.hpp"
 #include "shared.hpp"
+#include <optional>
+#include <stdexcept>
 #include <string>
 
+namespace png2chr
+{
+
 struct runtime_config_png2chr : runtime_config
 {
 	std::string pngdata_path;
 	std::string out_chrdata_path;
 	std::string out_paldata_path;
+	std::string out_linedata_path;
+	chrgfx::transform_chain transforms;
+	chrgfx::tile_arrangement arrangement;
+	chrgfx::compression_format compression {chrgfx::compression_format::none};
+	chrgfx::dither_mode dither {chrgfx::dither_mode::none};
+	uint pal_lines {0};
+	bool mask_pixels {false};
+	bool incremental {false};
+	std::optional<data_extent> chr_offset;
+	std::optional<data_extent> pal_offset;
+	std::string batch_path;
+	uint batch_threads {0};
 } cfg;
 
-void process_args(int argc, char ** argv)
+/**
+ * @brief Parse command line arguments into the given config
+ * @note The options must already have been added to the shared lists by process_args
+ */
+void parse_args(int argc, char ** argv, runtime_config_png2chr & cfg)
 {
-	// add png2chr specific options
-	long_opts.push_back({"chr-output", required_argument, nullptr, 'c'});
-	long_opts.push_back({"pal-output", required_argument, nullptr, 'p'});
-	long_opts.push_back({"png-data", required_argument, nullptr, 'b'});
-	long_opts.push_back({nullptr, 0, nullptr, 0});
-	short_opts.append("c:p:b:");
-
-	opt_details.push_back({true, "Path to output encoded tiles", nullptr});
-	opt_details.push_back({true, "Path to output encoded palette", nullptr});
-	opt_details.push_back({true, "Path to input PNG image", nullptr});
-
 	// read/parse arguments
 	while (true)
 	{
@@ -52,8 +63,147 @@ void process_args(int argc, char ** argv)
 			case 'b':
 				cfg.pngdata_path = optarg;
 				break;
+
+			// transforms that the tile data is stored with
+			case 'X':
+				cfg.transforms = parse_transforms(optarg);
+				break;
+
+			// placement of the tiles in the image
+			case 'a':
+				cfg.arrangement = parse_arrangement(optarg);
+				break;
+
+			// compression to apply to the tile data
+			case 'Z':
+				cfg.compression = parse_compression(optarg);
+				break;
+
+			// dithering for truecolor input
+			case 'D':
+			{
+				std::string const mode {optarg};
+				if (mode == "none")
+					cfg.dither = chrgfx::dither_mode::none;
+				else if (mode == "ordered")
+					cfg.dither = chrgfx::dither_mode::ordered;
+				else if (mode == "diffusion")
+					cfg.dither = chrgfx::dither_mode::diffusion;
+				else
+					throw std::invalid_argument("Invalid dither mode: " + mode);
+				break;
+			}
+
+			// number of palette lines to divide the tiles between
+			case 'L':
+				try
+				{
+					auto lines {std::stoi(optarg)};
+					if (lines < 1 || lines > 256)
+						throw std::invalid_argument("Invalid palette line count");
+					cfg.pal_lines = lines;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid palette line count");
+				}
+				break;
+
+			// palette line of each tile
+			case 'm':
+				cfg.out_linedata_path = optarg;
+				break;
+
+			// keep only the pixel bits the tile format can store
+			case 'k':
+				cfg.mask_pixels = true;
+				break;
+
+			// only write the tiles which have changed since the last run
+			case 'u':
+				cfg.incremental = true;
+				break;
+
+			// write the tile data into an existing file at this position
+			case 'O':
+				cfg.chr_offset = parse_data_extent(optarg);
+				break;
+
+			// write the palette data into an existing file at this position
+			case 'Q':
+				cfg.pal_offset = parse_data_extent(optarg);
+				break;
+
+			// batch manifest path
+			case 'B':
+				cfg.batch_path = optarg;
+				break;
+
+			// batch worker threads
+			case 't':
+				try
+				{
+					auto threads {std::stoi(optarg)};
+					if (threads < 0)
+						throw std::invalid_argument("Invalid thread count value");
+					cfg.batch_threads = threads;
+				}
+				catch (const std::invalid_argument & e)
+				{
+					throw std::invalid_argument("Invalid thread count value");
+				}
+				break;
 		}
 	}
 }
 
+void process_args(int argc, char ** argv)
+{
+	// add png2chr specific options
+	long_opts.push_back({"chr-output", required_argument, nullptr, 'c'});
+	long_opts.push_back({"pal-output", required_argument, nullptr, 'p'});
+	long_opts.push_back({"png-data", required_argument, nullptr, 'b'});
+	long_opts.push_back({"transform", required_argument, nullptr, 'X'});
+	long_opts.push_back({"arrange", required_argument, nullptr, 'a'});
+	long_opts.push_back({"compression", required_argument, nullptr, 'Z'});
+	long_opts.push_back({"dither", required_argument, nullptr, 'D'});
+	long_opts.push_back({"pal-lines", required_argument, nullptr, 'L'});
+	long_opts.push_back({"line-output", required_argument, nullptr, 'm'});
+	long_opts.push_back({"mask-pixels", no_argument, nullptr, 'k'});
+	long_opts.push_back({"incremental", no_argument, nullptr, 'u'});
+	long_opts.push_back({"chr-offset", required_argument, nullptr, 'O'});
+	long_opts.push_back({"pal-offset", required_argument, nullptr, 'Q'});
+	long_opts.push_back({"batch", required_argument, nullptr, 'B'});
+	long_opts.push_back({"threads", required_argument, nullptr, 't'});
+	long_opts.push_back({nullptr, 0, nullptr, 0});
+	short_opts.append("c:p:b:X:a:Z:D:L:m:kuO:Q:B:t:");
+
+	opt_details.push_back({true, "Path to output encoded tiles", nullptr});
+	opt_details.push_back({true, "Path to output encoded palette", nullptr});
+	opt_details.push_back({true, "Path to input PNG image", nullptr});
+	opt_details.push_back(
+		{false, "Transforms the tile data is stored with, as for chr2png; they are undone when writing", "LIST"});
+	opt_details.push_back(
+		{false, "Take tiles from groups in the image, as for chr2png, storing them in the order the groups describe", "LIST"});
+	opt_details.push_back({false, "Compress the tile data: gzip, lz77, kosinski, nemesis", "FORMAT"});
+	opt_details.push_back({false, "Dithering for truecolor input: none, ordered, diffusion", "MODE"});
+	opt_details.push_back(
+		{false, "Divide the tiles between this many palette lines, choosing a palette for each", "COUNT"});
+	opt_details.push_back({false, "Path to output the palette line of each tile, one byte per tile", "PATH"});
+	opt_details.push_back(
+		{false, "Keep only the low bits of pixel values too large for the tile format, rather than stopping with an error", nullptr});
+	opt_details.push_back(
+		{false, "Only write the tiles which have changed since the last run, as recorded in a .tilehash file next to the tile output", nullptr});
+	opt_details.push_back(
+		{false, "Write the tiles into the existing tile output file at this offset, in bytes or tiles (e.g. 0x8000, 512t)", "VALUE"});
+	opt_details.push_back(
+		{false, "Write the palette into the existing palette output file at this offset, in bytes or palettes", "VALUE"});
+	opt_details.push_back({false, "Path to batch manifest; each line holds the options for one conversion", "PATH"});
+	opt_details.push_back({false, "Number of worker threads for batch mode and color quantization (default: one per core)", nullptr});
+
+	parse_args(argc, argv, cfg);
+}
+
+} // namespace png2chr
+
 #endif
\ No newline at end of file
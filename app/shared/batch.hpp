@@ -0,0 +1,241 @@
+/**
+ * @file batch.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Manifest driven batch conversion for the support utilities
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * A manifest is a text file with one job per line. Each line holds the options for that job in the same form as they
+ * would be given on the command line, e.g.:
+ *
+ *   # sprites and their palettes
+ *   -H sega_md -c sprites.bin -p sprites.pal -o sprites.png
+ *   -H sega_md -c "title screen.bin" -o title.png
+ *
+ * Options given on the command line along with the manifest apply to every job, and may be overridden per line. Blank
+ * lines and lines beginning with # are ignored. Arguments may be enclosed in double quotes to include spaces.
+ *
+ * The gfxdefs for each distinct combination of gfxdef options are resolved once, up front, and shared by all the jobs
+ * which use them. The jobs themselves are then run on a work stealing thread pool.
+ */
+
+#ifndef CHRGFX__SHARED_BATCH_HPP
+#define CHRGFX__SHARED_BATCH_HPP
+
+#include "gfxdefman.hpp"
+#include "lineread.hpp"
+#include "strutil.hpp"
+#include "workpool.hpp"
+#include <getopt.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Split a manifest line into arguments
+ */
+inline std::vector<std::string> split_manifest_line(std::string_view const line)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool in_arg {false}, in_quotes {false};
+
+	for (char const c : line)
+	{
+		if (c == '"')
+		{
+			in_quotes = ! in_quotes;
+			in_arg = true;
+			continue;
+		}
+
+		if (! in_quotes && (c == ' ' || c == '\t' || c == '\r'))
+		{
+			if (in_arg)
+				args.push_back(std::move(arg));
+			arg.clear();
+			in_arg = false;
+			continue;
+		}
+
+		arg.push_back(c);
+		in_arg = true;
+	}
+
+	if (in_quotes)
+		throw std::invalid_argument("Unterminated quote");
+	if (in_arg)
+		args.push_back(std::move(arg));
+
+	return args;
+}
+
+/**
+ * @brief Identifies the gfxdefs that a config will resolve to, so that jobs with the same gfxdef options can share a
+ * gfxdef_manager
+ */
+inline std::string gfxdef_key(runtime_config const & cfg)
+{
+	std::string key;
+	for (auto const * field : {&cfg.gfxdefs_path,
+				 &cfg.profile_id,
+				 &cfg.chrdef_id,
+				 &cfg.coldef_id,
+				 &cfg.paldef_id,
+				 &cfg.chrdef_width,
+				 &cfg.chrdef_height,
+				 &cfg.chrdef_bpp,
+				 &cfg.chrdef_plane_offsets,
+				 &cfg.chrdef_pixel_offsets,
+				 &cfg.chrdef_row_offsets,
+				 &cfg.paldef_datasize,
+				 &cfg.paldef_entry_datasize,
+				 &cfg.paldef_length,
+				 &cfg.rgbcoldef_big_endian,
+				 &cfg.rgbcoldef_rgblayout,
+				 &cfg.rgbcoldef_bitdepth})
+	{
+		key.append(*field).push_back('\0');
+	}
+	return key;
+}
+
+template <typename ConfigT>
+struct batch_job
+{
+	ConfigT cfg;
+	size_t line_num;
+};
+
+/**
+ * @brief Read the jobs from a manifest
+ *
+ * @param base_cfg Options from the command line, used as the starting point for each job
+ * @param parse Parses an argument list into a job config; called as parse(argc, argv, cfg)
+ */
+template <typename ConfigT, typename ParseF>
+std::vector<batch_job<ConfigT>> read_manifest(std::string const & manifest_path, ConfigT const & base_cfg, ParseF parse)
+{
+	std::vector<batch_job<ConfigT>> jobs;
+	motoi::linereader manifest {manifest_path};
+
+	while (manifest.next())
+	{
+		auto const line {motoi::trim_view(manifest.line())};
+		if (line.empty() || line.front() == '#')
+			continue;
+
+		std::vector<std::string> args;
+		try
+		{
+			args = split_manifest_line(line);
+		}
+		catch (std::exception const & e)
+		{
+			throw std::invalid_argument(manifest_path + ":" + std::to_string(manifest.line_number()) + ": " + e.what());
+		}
+
+		// getopt expects the program name first
+		args.insert(args.begin(), manifest_path);
+		std::vector<char *> argv;
+		for (auto & arg : args)
+			argv.push_back(arg.data());
+		argv.push_back(nullptr);
+
+		batch_job<ConfigT> job {base_cfg, manifest.line_number()};
+		job.cfg.batch_path.clear();
+
+		// glibc fully reinitializes getopt when optind is 0
+		optind = 0;
+		parse(static_cast<int>(args.size()), argv.data(), job.cfg);
+
+		if (! job.cfg.batch_path.empty())
+			throw std::invalid_argument(manifest_path + ":" + std::to_string(job.line_num) + ": Manifests cannot be nested");
+
+		jobs.push_back(std::move(job));
+	}
+
+	return jobs;
+}
+
+/**
+ * @brief Run all jobs in a manifest
+ *
+ * @param convert Runs a single job; called as convert(cfg, defs)
+ * @return int Program exit code; non-zero if any job failed
+ */
+template <typename ConfigT, typename ParseF, typename ConvertF>
+int run_batch(ConfigT const & base_cfg, ParseF parse, ConvertF convert)
+{
+	auto jobs {read_manifest(base_cfg.batch_path, base_cfg, parse)};
+
+	std::mutex report_mutex;
+	bool failed {false};
+	auto report_error = [&](batch_job<ConfigT> const & job, std::string_view const what) {
+		std::lock_guard<std::mutex> lock {report_mutex};
+		std::cerr << "Error: " << base_cfg.batch_path << ":" << job.line_num << ": " << what << '\n';
+		failed = true;
+	};
+
+	/*
+		Resolve gfxdefs before starting any work; gfxdef_manager reads files and builds the defs and the tile decoder, none
+		of which needs to be repeated for jobs with the same options. A manager is shared by all the jobs using its
+		options, which may run on several threads at once, so nothing in it may change once the jobs are running.
+	*/
+	std::map<std::string, std::unique_ptr<gfxdef_manager>> gfxdefs;
+	std::vector<std::pair<batch_job<ConfigT> *, gfxdef_manager *>> ready_jobs;
+	for (auto & job : jobs)
+	{
+		auto const key {gfxdef_key(job.cfg)};
+		auto defs {gfxdefs.find(key)};
+		if (defs == gfxdefs.end())
+		{
+			try
+			{
+				defs = gfxdefs.emplace(key, std::make_unique<gfxdef_manager>(job.cfg)).first;
+			}
+			catch (std::exception const & e)
+			{
+				// remember the failure so that the details are only reported for the first job using these options
+				defs = gfxdefs.emplace(key, nullptr).first;
+				report_error(job, e.what());
+				continue;
+			}
+		}
+		if (defs->second == nullptr)
+		{
+			report_error(job, "gfxdefs could not be loaded");
+			continue;
+		}
+		ready_jobs.emplace_back(&job, defs->second.get());
+	}
+
+	std::vector<motoi::work_pool::task> tasks;
+	tasks.reserve(ready_jobs.size());
+	for (auto const & [job, defs] : ready_jobs)
+	{
+		tasks.emplace_back([&, job = job, defs = defs]() {
+			try
+			{
+				convert(job->cfg, *defs);
+			}
+			catch (std::exception const & e)
+			{
+				report_error(*job, e.what());
+			}
+		});
+	}
+
+	motoi::work_pool pool {base_cfg.batch_threads};
+#ifdef DEBUG
+	std::cerr << "BATCH: " << tasks.size() << " jobs on " << pool.thread_count() << " threads\n";
+#endif
+	pool.run(std::move(tasks));
+
+	return failed ? -1 : 0;
+}
+
+#endif
@@ -7,14 +7,19 @@
  * types and structures at various offsets, e.g., an image of a disk or a dump of a ROM module. It contains an iterator
  * sub-class which can be templatized to iterate over a certain data type dynamically.
  *
+ * The buffer grows geometrically, so building a blob with many appends or from a stream takes amortized constant time
+ * per byte. Memory comes from the C heap by default, or from a std::pmr::memory_resource (e.g. an arena) if one is
+ * given.
  */
 
 #ifndef __MOTOI__BLOB_HPP
 #define __MOTOI__BLOB_HPP
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <iterator>
+#include <memory_resource>
 #include <stdexcept>
 
 namespace motoi
@@ -25,64 +30,133 @@ class blob
 protected:
 	static size_t const DEFAULT_BLOCK_SIZE {0x80000};
 
+	/**
+	 * @brief Smallest allocation made when the blob first grows
+	 */
+	static size_t const MIN_CAPACITY {0x40};
+
 	/**
 	 * @brief Size of the blob in bytes
 	 */
-	size_t m_size;
+	size_t m_size {0};
+
+	/**
+	 * @brief Size of the allocated buffer in bytes
+	 */
+	size_t m_capacity {0};
 
 	/**
 	 * @brief The actual data buffer
 	 */
-	void * m_buffer;
+	void * m_buffer {nullptr};
 
-	void stream_in(std::istream & in, std::streamsize const block_size)
+	/**
+	 * @brief Source of the buffer memory; the C heap (malloc/realloc/free) if null
+	 */
+	std::pmr::memory_resource * m_resource {nullptr};
+
+	/**
+	 * @brief Move the data to a buffer of exactly new_capacity bytes
+	 */
+	void reallocate(size_t const new_capacity)
 	{
-		if (in.bad() || in.eof())
-			throw std::runtime_error("Input stream is in a bad state");
+		if (new_capacity == this->m_capacity)
+			return;
 
-		char * block_buff;
-		try
+		if (this->m_resource == nullptr)
 		{
-			block_buff = (char *) malloc(block_size);
-			if (block_buff == nullptr)
-				throw std::runtime_error("Failed to allocate read buffer");
-
-			size_t bytes_read {0};
-			while (true)
+			if (new_capacity == 0)
+			{
+				free(this->m_buffer);
+				this->m_buffer = nullptr;
+			}
+			else
+			{
+				// realloc can often extend the buffer in place, so it is preferred to a fresh allocation and copy
+				auto new_buffer {realloc(this->m_buffer, new_capacity)};
+				if (new_buffer == nullptr)
+					throw std::bad_alloc();
+				this->m_buffer = new_buffer;
+			}
+		}
+		else
+		{
+			void * new_buffer {nullptr};
+			if (new_capacity > 0)
 			{
-				in.read(block_buff, block_size);
-				if (in.bad())
-					throw std::runtime_error("Error reading data");
-
-				bytes_read = in.gcount();
-				if (bytes_read == 0)
-				{
-					if (in.eof())
-						break;
-					else
-						throw std::runtime_error("Failed to read data from input stream");
-				}
-
-				this->m_buffer = realloc(this->m_buffer, (this->m_size + bytes_read));
-				if (this->m_buffer == nullptr)
-					throw std::runtime_error("Failed to reallocate internal buffer");
-
-				std::memcpy(((char *) this->m_buffer) + this->m_size, block_buff, bytes_read);
-				this->m_size += bytes_read;
+				new_buffer = this->m_resource->allocate(new_capacity);
+				if (this->m_size > 0)
+					std::memcpy(new_buffer, this->m_buffer, std::min(this->m_size, new_capacity));
 			}
+			if (this->m_buffer != nullptr)
+				this->m_resource->deallocate(this->m_buffer, this->m_capacity);
+			this->m_buffer = new_buffer;
+		}
 
 #ifdef BLOB_DEBUG
-			std::cerr << __func__ << ": Created buffer from stream at " << std::showbase << std::hex
-								<< (std::size_t) this->m_buffer << ", size " << this->m_size << '\n'
-								<< std::dec;
+		std::cerr << __func__ << ": Buffer now at " << std::showbase << std::hex << (std::size_t) this->m_buffer
+							<< ", capacity " << this->m_capacity << " to " << new_capacity << " bytes\n"
+							<< std::dec;
 #endif
-			free(block_buff);
+
+		this->m_capacity = new_capacity;
+	}
+
+	/**
+	 * @brief Ensure there is space for at least required bytes, growing geometrically so that repeated appends take
+	 * amortized constant time
+	 */
+	void grow_for(size_t const required)
+	{
+		if (required <= this->m_capacity)
+			return;
+
+		reallocate(std::max({required, this->m_capacity * 2, MIN_CAPACITY}));
+	}
+
+	void stream_in(std::istream & in, std::streamsize const block_size)
+	{
+		if (in.bad() || in.eof())
+			throw std::runtime_error("Input stream is in a bad state");
+
+		if (block_size <= 0)
+			throw std::invalid_argument("Invalid block size");
+
+		// if the stream is seekable, allocate its full remaining size (plus room to detect the end) up front
+		auto const start_pos {in.tellg()};
+		if (start_pos != std::streampos(-1) && in.seekg(0, std::ios::end))
+		{
+			auto const end_pos {in.tellg()};
+			in.seekg(start_pos);
+			if (end_pos > start_pos)
+				reserve(this->m_size + static_cast<size_t>(end_pos - start_pos) + 1);
 		}
-		catch (...)
+		in.clear(in.rdstate() & std::ios::badbit);
+
+		// read directly into the tail of the buffer
+		while (true)
 		{
-			free(block_buff);
-			throw;
+			if (this->m_capacity - this->m_size < static_cast<size_t>(block_size))
+				grow_for(this->m_size + block_size);
+
+			auto const space {static_cast<std::streamsize>(this->m_capacity - this->m_size)};
+			in.read(reinterpret_cast<char *>(this->m_buffer) + this->m_size, space);
+			if (in.bad())
+				throw std::runtime_error("Error reading data");
+
+			size_t const bytes_read = in.gcount();
+			this->m_size += bytes_read;
+			if (in.eof())
+				break;
+			if (bytes_read == 0)
+				throw std::runtime_error("Failed to read data from input stream");
 		}
+
+#ifdef BLOB_DEBUG
+		std::cerr << __func__ << ": Created buffer from stream at " << std::showbase << std::hex
+							<< (std::size_t) this->m_buffer << ", size " << this->m_size << '\n'
+							<< std::dec;
+#endif
 	}
 
 public:
@@ -91,10 +165,10 @@ public:
 
 	/**
 	 * @brief Create an empty blob
+	 * @param resource Memory resource (such as an arena) to allocate from; if null, the C heap is used
 	 */
-	blob() :
-			m_size {0},
-			m_buffer {nullptr}
+	explicit blob(std::pmr::memory_resource * resource = nullptr) :
+			m_resource {resource}
 	{
 	}
 
@@ -102,15 +176,14 @@ public:
 	 * @brief Create a blob with optional initial value
 	 * @param size Size of blob in bytes
 	 * @param inital Initial value for data
+	 * @param resource Memory resource to allocate from; if null, the C heap is used
 	 */
-	explicit blob(size_t const size, char const initial = 0) :
-			m_size {size},
-			m_buffer {malloc(this->m_size)}
+	explicit blob(size_t const size, char const initial = 0, std::pmr::memory_resource * resource = nullptr) :
+			m_resource {resource}
 	{
-		if (this->m_buffer == nullptr)
-			throw std::bad_alloc();
-
-		std::memset(m_buffer, initial, m_size);
+		reallocate(size);
+		std::memset(m_buffer, initial, size);
+		m_size = size;
 
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Created empty buffer at " << std::showbase << std::hex << (std::size_t) this->m_buffer
@@ -121,11 +194,12 @@ public:
 
 	/**
 	 * @brief Take over existing data
-	 * @param data Pointer to data
+	 * @param data Pointer to data, which must have been allocated with malloc
 	 * @param size Size of existing data
 	 */
 	blob(void * data, size_t const size) :
 			m_size {size},
+			m_capacity {size},
 			m_buffer {data}
 	{
 #ifdef BLOB_DEBUG
@@ -139,15 +213,15 @@ public:
 	 * @brief Copy from pointer constructor
 	 * @param data Pointer to data
 	 * @param size Size of existing data
+	 * @param resource Memory resource to allocate from; if null, the C heap is used
 	 */
-	blob(void const * data, size_t const size) :
-			m_size {size},
-			m_buffer {malloc(this->m_size)}
+	blob(void const * data, size_t const size, std::pmr::memory_resource * resource = nullptr) :
+			m_resource {resource}
 	{
-		if (this->m_buffer == nullptr)
-			throw std::bad_alloc();
-
-		std::memcpy(this->m_buffer, data, m_size);
+		reallocate(size);
+		if (size > 0)
+			std::memcpy(this->m_buffer, data, size);
+		m_size = size;
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Copying existing data from " << std::showbase << std::hex << (std::size_t) data
 							<< " to " << (std::size_t) this->m_buffer << ", " << this->m_size << " bytes\n"
@@ -157,9 +231,10 @@ public:
 
 	/**
 	 * @brief Copy constructor
+	 * @details The copy uses the same memory resource as the original
 	 */
 	blob(blob const & other) :
-			blob(other.m_buffer, other.m_size)
+			blob(static_cast<void const *>(other.m_buffer), other.m_size, other.m_resource)
 	{
 	}
 
@@ -168,21 +243,30 @@ public:
 	 */
 	blob(blob && other) noexcept :
 			m_size {other.m_size},
-			m_buffer {other.m_buffer}
+			m_capacity {other.m_capacity},
+			m_buffer {other.m_buffer},
+			m_resource {other.m_resource}
 	{
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Moving existing buffer at " << std::showbase << std::hex << (std::size_t) other.m_buffer
 							<< " to " << (std::size_t) this->m_buffer << ", " << this->m_size << " bytes\n"
 							<< std::dec;
 #endif
+		other.m_size = 0;
+		other.m_capacity = 0;
+		other.m_buffer = nullptr;
 	};
 
 	/**
 	 * @brief Input stream constructor
 	 * @param data Input stream
-	 * @param block_size Stream read buffer (default 128KiB)
+	 * @param block_size Minimum amount of data to read at once (default 512KiB)
+	 * @param resource Memory resource to allocate from; if null, the C heap is used
 	 */
-	explicit blob(std::istream & data, size_t const block_size = DEFAULT_BLOCK_SIZE)
+	explicit blob(std::istream & data,
+		size_t const block_size = DEFAULT_BLOCK_SIZE,
+		std::pmr::memory_resource * resource = nullptr) :
+			m_resource {resource}
 	{
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Reading data from input stream in " << std::showbase << std::hex
@@ -201,7 +285,10 @@ public:
 								<< ", " << this->m_size << " bytes\n"
 								<< std::dec;
 #endif
-			free(this->m_buffer);
+			if (this->m_resource == nullptr)
+				free(this->m_buffer);
+			else
+				this->m_resource->deallocate(this->m_buffer, this->m_capacity);
 		}
 	}
 
@@ -214,6 +301,40 @@ public:
 		return this->m_size;
 	}
 
+	/**
+	 * @brief Returns the number of bytes the blob can hold before it must reallocate
+	 * @return size_t
+	 */
+	[[nodiscard]] size_t capacity() const
+	{
+		return this->m_capacity;
+	}
+
+	/**
+	 * @brief Returns the memory resource used by the blob, or null if it uses the C heap
+	 */
+	[[nodiscard]] std::pmr::memory_resource * resource() const
+	{
+		return this->m_resource;
+	}
+
+	/**
+	 * @brief Allocate space for at least new_capacity bytes without changing the size
+	 */
+	void reserve(size_t const new_capacity)
+	{
+		if (new_capacity > this->m_capacity)
+			reallocate(new_capacity);
+	}
+
+	/**
+	 * @brief Release any allocated space beyond the size of the blob
+	 */
+	void shrink_to_fit()
+	{
+		reallocate(this->m_size);
+	}
+
 	/**
 	 * @brief Returns const pointer to data buffer
 	 * @return DataT * const
@@ -234,6 +355,7 @@ public:
 
 	/**
 	 * @brief Resize the blob
+	 * @note Shrinking the blob does not release its memory; use shrink_to_fit for that
 	 *
 	 * @param new_size The requested new length of the blob
 	 * @param initial Fill the new space with this value if the new length is
@@ -249,24 +371,16 @@ public:
 			return this->m_size;
 
 		if (new_size > this->m_size)
-			return append(new_size, initial);
-
-#ifdef BLOB_DEBUG
-		size_t prev_bytesize = this->m_size;
-#endif
-
-		this->m_buffer = realloc(this->m_buffer, new_size);
-		if (this->m_buffer == nullptr)
-			throw std::bad_alloc();
-
-		this->m_size = new_size;
+			return append(new_size - this->m_size, initial);
 
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Shrunk buffer at " << std::showbase << std::hex << (std::size_t) this->m_buffer
-							<< ", prev size " << prev_bytesize << " bytes, new size " << this->m_size << " bytes" << '\n'
+							<< ", prev size " << this->m_size << " bytes, new size " << new_size << " bytes" << '\n'
 							<< std::dec;
 #endif
 
+		this->m_size = new_size;
+
 		return this->m_size;
 	}
 
@@ -275,9 +389,7 @@ public:
 		if (additional == 0)
 			return this->m_size;
 
-		this->m_buffer = realloc(this->m_buffer, (this->m_size + additional));
-		if (this->m_buffer == nullptr)
-			throw std::bad_alloc();
+		grow_for(this->m_size + additional);
 
 		std::memset(reinterpret_cast<char *>(this->m_buffer) + this->m_size, initial, additional);
 
@@ -296,11 +408,17 @@ public:
 		if (size == 0)
 			return this->m_size;
 
-		this->m_buffer = realloc(this->m_buffer, this->m_size + size);
-		if (this->m_buffer == nullptr)
-			throw std::bad_alloc();
+		// the source may be part of this blob, in which case it moves if the buffer is reallocated
+		auto const * src {reinterpret_cast<char const *>(other)};
+		auto const * buffer {reinterpret_cast<char const *>(this->m_buffer)};
+		bool const is_own_data {buffer != nullptr && src >= buffer && src < buffer + this->m_size};
+		size_t const own_offset {is_own_data ? static_cast<size_t>(src - buffer) : 0};
 
-		std::memcpy(reinterpret_cast<char *>(this->m_buffer) + this->m_size, other, size);
+		grow_for(this->m_size + size);
+		if (is_own_data)
+			src = reinterpret_cast<char const *>(this->m_buffer) + own_offset;
+
+		std::memcpy(reinterpret_cast<char *>(this->m_buffer) + this->m_size, src, size);
 		this->m_size += size;
 
 #ifdef BLOB_DEBUG
@@ -662,14 +780,11 @@ public:
 		}
 	};
 	template <typename DataT>
-	blob(const_iterator<DataT> start, const_iterator<DataT> end) :
-			m_size {sizeof(DataT) * (end - start)},
-			m_buffer {malloc(this->m_size)}
+	blob(const_iterator<DataT> start, const_iterator<DataT> end)
 	{
-		if (this->m_buffer == nullptr)
-			throw std::runtime_error("Failed to allocate buffer space");
-
-		std::copy(start, end, this->m_buffer);
+		reallocate(sizeof(DataT) * (end - start));
+		std::copy(start, end, reinterpret_cast<DataT *>(this->m_buffer));
+		this->m_size = this->m_capacity;
 
 #ifdef BLOB_DEBUG
 		std::cerr << __func__ << ": Copied portion of existing buffer to" << std::showbase << std::hex
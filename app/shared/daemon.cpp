@@ -0,0 +1,244 @@
+#include "daemon.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+
+// marks the start of a job request, mostly to catch anything other than our clients connecting
+static uint32_t constexpr JOB_MAGIC {0x43484744};
+
+// stdin, stdout, stderr
+static size_t constexpr JOB_FD_COUNT {3};
+
+struct job_header
+{
+	uint32_t magic;
+	uint32_t payload_size;
+};
+
+static sockaddr_un make_address(string const & socket_path)
+{
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path))
+		throw invalid_argument("Socket path is too long: " + socket_path);
+	strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+static void write_all(int fd, void const * data, size_t size)
+{
+	auto ptr {static_cast<char const *>(data)};
+	while (size > 0)
+	{
+		auto const written {send(fd, ptr, size, MSG_NOSIGNAL)};
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw system_error(errno, generic_category(), "Failed to write to socket");
+		}
+		ptr += written;
+		size -= written;
+	}
+}
+
+static bool read_all(int fd, void * data, size_t size)
+{
+	auto ptr {static_cast<char *>(data)};
+	while (size > 0)
+	{
+		auto const bytes_read {recv(fd, ptr, size, 0)};
+		if (bytes_read < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw system_error(errno, generic_category(), "Failed to read from socket");
+		}
+		if (bytes_read == 0)
+			return false;
+		ptr += bytes_read;
+		size -= bytes_read;
+	}
+	return true;
+}
+
+string default_daemon_socket_path()
+{
+	auto const env_path {getenv(DAEMON_SOCKET_ENV)};
+	if (env_path != nullptr && strlen(env_path) > 0)
+		return env_path;
+
+	auto const runtime_dir {getenv("XDG_RUNTIME_DIR")};
+	if (runtime_dir != nullptr && strlen(runtime_dir) > 0)
+		return string(runtime_dir) + "/chrgfxd.sock";
+
+	return "/tmp/chrgfxd-" + to_string(getuid()) + ".sock";
+}
+
+optional<int> run_via_daemon(char const * tool, int argc, char ** argv)
+{
+	auto const socket_path {getenv(DAEMON_SOCKET_ENV)};
+	if (socket_path == nullptr || strlen(socket_path) == 0)
+		return nullopt;
+
+	int const conn {socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+	if (conn < 0)
+		return nullopt;
+
+	try
+	{
+		auto const addr {make_address(socket_path)};
+		if (connect(conn, reinterpret_cast<sockaddr const *>(&addr), sizeof(addr)) != 0)
+		{
+			// daemon isn't running; not an error, the job is simply run locally
+			close(conn);
+			return nullopt;
+		}
+
+		char cwd[PATH_MAX];
+		if (getcwd(cwd, sizeof(cwd)) == nullptr)
+			throw system_error(errno, generic_category(), "Could not get current directory");
+
+		// payload is a sequence of null terminated strings: tool, working directory, arguments
+		string payload;
+		payload.append(tool).push_back('\0');
+		payload.append(cwd).push_back('\0');
+		for (int i {0}; i < argc; ++i)
+			payload.append(argv[i]).push_back('\0');
+
+		// the header is sent along with our standard streams
+		job_header header {JOB_MAGIC, static_cast<uint32_t>(payload.size())};
+		iovec iov {&header, sizeof(header)};
+		char control[CMSG_SPACE(sizeof(int) * JOB_FD_COUNT)] {};
+		msghdr msg {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		auto cmsg {CMSG_FIRSTHDR(&msg)};
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * JOB_FD_COUNT);
+		int const fds[JOB_FD_COUNT] {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+		if (sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(header))
+			throw system_error(errno, generic_category(), "Failed to send job to chrgfxd");
+		write_all(conn, payload.data(), payload.size());
+
+		int32_t status;
+		if (! read_all(conn, &status, sizeof(status)))
+			throw runtime_error("Lost connection to chrgfxd before job completed");
+
+		close(conn);
+		return status;
+	}
+	catch (exception const & e)
+	{
+		close(conn);
+		cerr << "Error: " << e.what() << '\n';
+		return -1;
+	}
+}
+
+int daemon_listen(string const & socket_path)
+{
+	auto const addr {make_address(socket_path)};
+
+	int const listener {socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+	if (listener < 0)
+		throw system_error(errno, generic_category(), "Could not create socket");
+
+	// remove a socket left over from a previous run
+	struct stat status;
+	if (::stat(socket_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+		unlink(socket_path.c_str());
+
+	// jobs run with the permissions of the daemon, so only its own user may connect
+	auto const prev_umask {umask(0077)};
+	auto const bound {bind(listener, reinterpret_cast<sockaddr const *>(&addr), sizeof(addr))};
+	umask(prev_umask);
+	if (bound != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		auto const err {errno};
+		close(listener);
+		throw system_error(err, generic_category(), "Could not listen on " + socket_path);
+	}
+
+	return listener;
+}
+
+daemon_job receive_job(int conn)
+{
+	job_header header;
+	iovec iov {&header, sizeof(header)};
+	char control[CMSG_SPACE(sizeof(int) * JOB_FD_COUNT)] {};
+	msghdr msg {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != sizeof(header) || header.magic != JOB_MAGIC)
+		throw runtime_error("Invalid job request");
+
+	auto cmsg {CMSG_FIRSTHDR(&msg)};
+	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(int) * JOB_FD_COUNT))
+		throw runtime_error("Job request is missing client file descriptors");
+
+	int fds[JOB_FD_COUNT];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	// received descriptors can themselves land in 0-2 if the daemon was started with a standard stream closed, so move
+	// them all clear first; otherwise attaching one stream could replace another that has yet to be attached
+	for (auto & fd : fds)
+	{
+		auto moved {fcntl(fd, F_DUPFD, 3)};
+		if (moved < 0)
+			throw system_error(errno, generic_category(), "Could not attach client file descriptors");
+		close(fd);
+		fd = moved;
+	}
+	for (int i {0}; i < static_cast<int>(JOB_FD_COUNT); ++i)
+	{
+		if (dup2(fds[i], i) < 0)
+			throw system_error(errno, generic_category(), "Could not attach client file descriptors");
+		if (fds[i] != i)
+			close(fds[i]);
+	}
+
+	string payload(header.payload_size, '\0');
+	if (! read_all(conn, payload.data(), payload.size()))
+		throw runtime_error("Job request was truncated");
+
+	vector<string> fields;
+	for (size_t start {0}, end; start < payload.size(); start = end + 1)
+	{
+		end = payload.find('\0', start);
+		if (end == string::npos)
+			throw runtime_error("Job request is malformed");
+		fields.emplace_back(payload, start, end - start);
+	}
+	if (fields.size() < 3)
+		throw runtime_error("Job request is malformed");
+
+	return {fields[0], fields[1], {fields.begin() + 2, fields.end()}};
+}
+
+void send_status(int conn, int status)
+{
+	int32_t const value {status};
+	write_all(conn, &value, sizeof(value));
+}
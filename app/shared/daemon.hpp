@@ -0,0 +1,64 @@
+/**
+ * @file daemon.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Client and server plumbing for running conversion jobs in chrgfxd
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * A job is the command line of one of the utilities. The client sends its working directory and arguments over a Unix
+ * domain socket along with its stdin, stdout and stderr file descriptors (via SCM_RIGHTS), so the job reads and writes
+ * exactly as it would have if run locally. The daemon replies with the exit status of the job.
+ */
+
+#ifndef CHRGFX__SHARED_DAEMON_HPP
+#define CHRGFX__SHARED_DAEMON_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Environment variable with the path to the chrgfxd socket
+ * @note The utilities only act as clients when this is set
+ */
+static auto constexpr DAEMON_SOCKET_ENV {"CHRGFXD_SOCKET"};
+
+struct daemon_job
+{
+	std::string tool;
+	std::string cwd;
+	std::vector<std::string> args;
+};
+
+/**
+ * @brief Socket path used by chrgfxd if none is specified
+ * @details $CHRGFXD_SOCKET if set, otherwise chrgfxd.sock in $XDG_RUNTIME_DIR, otherwise a per-user path in /tmp
+ */
+std::string default_daemon_socket_path();
+
+/**
+ * @brief Send the current command line to chrgfxd and wait for it to complete
+ *
+ * @param tool Name of the utility
+ * @return Exit status of the job, or nullopt if no daemon is configured or it could not be reached (in which case
+ * the job should be run locally)
+ */
+std::optional<int> run_via_daemon(char const * tool, int argc, char ** argv);
+
+/**
+ * @brief Create a listening socket at the given path, replacing any stale socket file
+ */
+int daemon_listen(std::string const & socket_path);
+
+/**
+ * @brief Read a job from a client connection
+ * @note The client's stdin, stdout and stderr replace those of the calling process, so this should only be called in
+ * the process which will run the job
+ */
+daemon_job receive_job(int conn);
+
+/**
+ * @brief Send the job exit status back to the client
+ */
+void send_status(int conn, int status);
+
+#endif
@@ -15,9 +15,12 @@
 #define __MOTOI__FILESYS_HPP
 
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <system_error>
 #include <unistd.h>
 
 namespace motoi
@@ -144,6 +147,76 @@ std::fstream fstream_checked(
 	}
 	return fs;
 }
+
+/**
+ * @brief Overwrite a region of an existing file in place
+ * @details The region is compared with the new data a page at a time, and only the pages which differ are written to,
+ * so unchanged parts of the region are never rewritten. Nothing outside the region is read or written. The file is
+ * never extended or truncated; the region must lie entirely within it.
+ */
+template <typename CharT>
+void patch_file(
+	std::basic_string<CharT> const & filepath, size_t const offset, void const * data, size_t const datasize)
+{
+	// errno is taken by the caller, as closing the file beforehand may change it
+	auto fail = [&filepath](char const * action, int const error) {
+		std::basic_ostringstream<CharT> oss;
+		oss << "Could not " << action << " \"" << filepath << '"';
+		throw std::system_error(error, std::generic_category(), oss.str());
+	};
+
+	int fd {::open(filepath.c_str(), O_RDWR)};
+	if (fd < 0)
+		fail("open", errno);
+
+	struct stat status;
+	if (::fstat(fd, &status) != 0)
+	{
+		int const error {errno};
+		::close(fd);
+		fail("read the status of", error);
+	}
+	if (offset > (size_t) status.st_size || datasize > (size_t) status.st_size - offset)
+	{
+		::close(fd);
+		std::basic_ostringstream<CharT> oss;
+		oss << "Patch region extends past the end of \"" << filepath << '"';
+		throw std::out_of_range(oss.str());
+	}
+	if (datasize == 0)
+	{
+		::close(fd);
+		return;
+	}
+
+	// the mapping must begin on a page boundary
+	size_t const page_size {(size_t) ::sysconf(_SC_PAGESIZE)}, map_offset {offset - (offset % page_size)},
+		map_size {offset + datasize - map_offset};
+	void * map {::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_offset)};
+	int const map_error {errno};
+	::close(fd);
+	if (map == MAP_FAILED)
+		fail("map", map_error);
+
+	// compare a page at a time so that unchanged pages are never dirtied
+	auto ptr_out {static_cast<char *>(map) + (offset - map_offset)};
+	auto ptr_in {static_cast<char const *>(data)};
+	size_t remaining {datasize}, chunk {page_size - (offset - map_offset)};
+	while (remaining > 0)
+	{
+		if (chunk > remaining)
+			chunk = remaining;
+		if (std::memcmp(ptr_out, ptr_in, chunk) != 0)
+			std::memcpy(ptr_out, ptr_in, chunk);
+		ptr_out += chunk;
+		ptr_in += chunk;
+		remaining -= chunk;
+		chunk = page_size;
+	}
+
+	if (::munmap(map, map_size) != 0)
+		fail("unmap", errno);
+}
 } // namespace motoi
 
 #endif
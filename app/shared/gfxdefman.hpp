@@ -6,10 +6,13 @@
 #include "chrdef.hpp"
 #include "coldef.hpp"
 #include "gfxdef_builder.hpp"
+#include "gfxdef_registry.hpp"
 #include "paldef.hpp"
 #include "shared.hpp"
 #include "xdgdirs.hpp"
 #include <map>
+#include <memory>
+#include <optional>
 #include <vector>
 #ifdef DEBUG
 #include <iostream>
@@ -22,9 +25,14 @@ class gfxdef_manager
 private:
 	runtime_config const & m_cfg;
 
-	chrgfx::chrdef const * m_chrdef {nullptr};
-	chrgfx::paldef const * m_paldef {nullptr};
-	chrgfx::coldef const * m_coldef {nullptr};
+	// definitions from the library are shared through the registry; those from a file or the command line are owned
+	// by the manager alone
+	std::shared_ptr<chrgfx::chrdef const> m_chrdef;
+	std::shared_ptr<chrgfx::paldef const> m_paldef;
+	std::shared_ptr<chrgfx::coldef const> m_coldef;
+
+	// shared through the registry for a library chrdef; otherwise it belongs to the manager, as does the chrdef
+	std::shared_ptr<chrgfx::tile_decoder const> m_decoder;
 
 	std::string m_target_profile;
 	std::string m_target_chrdef;
@@ -33,11 +41,73 @@ private:
 
 	bool profile_found {false};
 
+	struct prebuilt_chrdef
+	{
+		std::shared_ptr<chrgfx::chrdef const> chrdef;
+		std::shared_ptr<chrgfx::tile_decoder const> decoder;
+	};
+
+	// a gfxdefs file parsed ahead of time, along with the chrdefs in it and their decoders
+	struct preloaded_file
+	{
+		motoi::config_loader config;
+		// by ID; a chrdef that could not be built has an empty entry, and is left for the job asking for it to report
+		std::map<std::string, prebuilt_chrdef> chrdefs;
+
+		explicit preloaded_file(std::string const & path) :
+				config(path)
+		{
+		}
+	};
+
+	static std::map<std::string, preloaded_file> & file_cache()
+	{
+		static std::map<std::string, preloaded_file> cache;
+		return cache;
+	}
+
+	/**
+	 * @brief Build a chrdef from a block in a gfxdefs file
+	 * @details If the tile is made of sub-tiles, the chrdef they use is looked for in the same file first, then among the
+	 * built in definitions
+	 */
+	static chrgfx::chrdef * build_chrdef(
+		motoi::config_loader const & config, motoi::block_map const & block, uint const depth = 0)
+	{
+		// sub-tiles of sub-tiles are fine, but a chain this long can only be a chrdef which refers to itself
+		static uint constexpr MAX_SUBTILE_DEPTH {8};
+
+		chrgfx::chrdef_builder builder(block);
+		if (builder.subtile().empty())
+			return builder.build();
+		if (depth >= MAX_SUBTILE_DEPTH)
+			throw std::runtime_error("sub-tile chrdefs are nested too deeply at " + builder.subtile());
+
+		for (auto const & other : config)
+		{
+			if (other.first != "chrdef")
+				continue;
+			auto kv = other.second.find("id");
+			if (kv == other.second.end() || kv->second != builder.subtile())
+				continue;
+
+			std::unique_ptr<chrgfx::chrdef const> subtile {build_chrdef(config, other.second, depth + 1)};
+			builder.set_subtile_def(*subtile);
+			return builder.build();
+		}
+
+		auto const subtile {chrgfx::gfxdef_registry::global().find_chrdef(builder.subtile())};
+		if (subtile == nullptr)
+			throw std::runtime_error("could not find sub-tile chrdef " + builder.subtile());
+		builder.set_subtile_def(*subtile);
+		return builder.build();
+	}
+
 	std::string get_gfxdefs_xdg_paths()
 	{
-		auto xdg_locations {data_filepaths(GFXDEF_SUBDIR)};
+		auto xdg_locations {motoi::data_filepaths(GFXDEF_SUBDIR)};
 		if (xdg_locations.empty())
-			throw runtime_error("Could not find gfxdef file in any default location");
+			throw std::runtime_error("Could not find gfxdef file in any default location");
 		return xdg_locations.front();
 	}
 
@@ -52,11 +122,14 @@ private:
 			return;
 		}
 
-		motoi::config_loader config(path);
+		// use the parsed copy of the file if it has been preloaded
+		std::optional<motoi::config_loader> uncached;
+		auto const cached {file_cache().find(path)};
+		auto const & config {cached != file_cache().end() ? cached->second.config : uncached.emplace(path)};
 		std::string_view block_header;
 
 		// get gfxdef IDs from profile first, if specified
-		if (! m_target_profile.empty())
+		if (! m_target_profile.empty() && ! profile_found)
 		{
 #ifdef DEBUG
 			std::cerr << "Using profile: " << m_target_profile << '\n';
@@ -109,7 +182,7 @@ private:
 			}
 
 			if (! profile_found)
-				throw runtime_error("could not find specified profile " + m_target_profile);
+				throw std::runtime_error("could not find specified profile " + m_target_profile);
 		}
 
 		// load gfxdefs as specified
@@ -126,9 +199,18 @@ private:
 				if (kv->second != m_target_chrdef)
 					continue;
 
-				// matched the block, now load it as a gfxdef
-				chrdef_builder builder(block.second);
-				m_chrdef = builder.build();
+				// matched the block, now load it as a gfxdef, unless it was built when the file was preloaded
+				if (cached != file_cache().end())
+				{
+					auto const prebuilt {cached->second.chrdefs.find(m_target_chrdef)};
+					if (prebuilt != cached->second.chrdefs.end() && prebuilt->second.chrdef != nullptr)
+					{
+						m_chrdef = prebuilt->second.chrdef;
+						m_decoder = prebuilt->second.decoder;
+						continue;
+					}
+				}
+				m_chrdef.reset(build_chrdef(config, block.second));
 				continue;
 			}
 
@@ -142,8 +224,8 @@ private:
 					continue;
 
 				// matched the block, now load it as a gfxdef
-				paldef_builder builder(block.second);
-				m_paldef = builder.build();
+				chrgfx::paldef_builder builder(block.second);
+				m_paldef.reset(builder.build());
 				continue;
 			}
 
@@ -157,8 +239,8 @@ private:
 					continue;
 
 				// matched the block, now load it as a gfxdef
-				rgbcoldef_builder builder(block.second);
-				m_coldef = builder.build();
+				chrgfx::rgbcoldef_builder builder(block.second);
+				m_coldef.reset(builder.build());
 				continue;
 			}
 
@@ -172,35 +254,50 @@ private:
 					continue;
 
 				// matched the block, now load it as a gfxdef
-				refcoldef_builder builder(block.second);
-				m_coldef = builder.build();
+				chrgfx::refcoldef_builder builder(block.second);
+				m_coldef.reset(builder.build());
 				continue;
 			}
 		}
 	}
 
+	void load_profile_from_internal()
+	{
+		auto const profile {chrgfx::gfxdefs::find_profile(m_target_profile)};
+		if (profile == nullptr)
+			return;
+
+#ifdef DEBUG
+		std::cerr << "Using internal profile: " << m_target_profile << '\n';
+#endif
+		// as with profiles from file, only set gfxdef IDs if they are not set by the user
+		profile_found = true;
+		if (m_target_chrdef.empty())
+			m_target_chrdef = profile->chrdef_id;
+		if (m_target_paldef.empty())
+			m_target_paldef = profile->paldef_id;
+		if (m_target_coldef.empty())
+			m_target_coldef = profile->coldef_id;
+	}
+
 	void load_from_internal()
 	{
+		auto const & registry {chrgfx::gfxdef_registry::global()};
 		if (m_chrdef == nullptr && ! m_target_chrdef.empty())
-		{
-			auto def = chrgfx::gfxdefs::chrdefs.find(m_target_chrdef);
-			if (def != chrgfx::gfxdefs::chrdefs.end())
-				m_chrdef = new class chrdef(def->second);
-		}
-
+			m_chrdef = registry.find_chrdef(m_target_chrdef);
 		if (m_paldef == nullptr && ! m_target_paldef.empty())
-		{
-			auto def = chrgfx::gfxdefs::paldefs.find(m_target_paldef);
-			if (def != chrgfx::gfxdefs::paldefs.end())
-				m_paldef = new class paldef(def->second);
-		}
-
+			m_paldef = registry.find_paldef(m_target_paldef);
 		if (m_coldef == nullptr && ! m_target_coldef.empty())
-		{
-			auto def = chrgfx::gfxdefs::rgbcoldefs.find(m_target_coldef);
-			if (def != chrgfx::gfxdefs::rgbcoldefs.end())
-				m_coldef = new class rgbcoldef(def->second);
-		}
+			m_coldef = registry.find_coldef(m_target_coldef);
+	}
+
+	/**
+	 * @return true if every requested profile/gfxdef has been found
+	 */
+	bool targets_loaded() const
+	{
+		return (m_target_profile.empty() || profile_found) && (m_target_chrdef.empty() || m_chrdef != nullptr) &&
+					 (m_target_paldef.empty() || m_paldef != nullptr) && (m_target_coldef.empty() || m_coldef != nullptr);
 	}
 
 	void load_from_cli()
@@ -208,11 +305,15 @@ private:
 		// build chrdef from cli
 		if (m_cfg.chrdef_cli_defined())
 		{
-			chrdef_builder builder;
+			chrgfx::chrdef_builder builder;
 			if (m_chrdef != nullptr)
 			{
+				// tile settings from the command line apply to the whole tile, so any sub-tile arrangement is dropped
+				if (m_chrdef->subtile() != nullptr && m_chrdef->pixel_offsets().empty())
+					throw std::runtime_error(
+						"chrdef " + m_chrdef->id() + " is made of irregular sub-tiles and cannot be changed from the command line");
 				builder.from_def(*m_chrdef);
-				delete m_chrdef;
+				builder.clear_subtile();
 			}
 			if (! m_cfg.chrdef_bpp.empty())
 				builder.set_bpp(m_cfg.chrdef_bpp);
@@ -227,18 +328,15 @@ private:
 			if (! m_cfg.chrdef_row_offsets.empty())
 				builder.set_row_offsets(m_cfg.chrdef_row_offsets);
 
-			m_chrdef = builder.build();
+			m_chrdef.reset(builder.build());
 		}
 
 		// build paldef from cli
 		if (m_cfg.paldef_cli_defined())
 		{
-			paldef_builder builder;
+			chrgfx::paldef_builder builder;
 			if (m_paldef != nullptr)
-			{
 				builder.from_def(*m_paldef);
-				delete m_paldef;
-			}
 			if (! m_cfg.paldef_datasize.empty())
 				builder.set_datasize(m_cfg.paldef_datasize);
 			if (! m_cfg.paldef_entry_datasize.empty())
@@ -246,19 +344,15 @@ private:
 			if (! m_cfg.paldef_length.empty())
 				builder.set_length(m_cfg.paldef_length);
 
-			m_paldef = builder.build();
+			m_paldef.reset(builder.build());
 		}
 
 		// build coldef from cli
 		if (m_cfg.coldef_cli_defined())
 		{
-			rgbcoldef_builder builder;
-			if (m_coldef != nullptr)
-			{
-				if (m_coldef->type() == coldef_type::rgb)
-					builder.from_def(*static_cast<rgbcoldef const *>(m_coldef));
-				delete m_coldef;
-			}
+			chrgfx::rgbcoldef_builder builder;
+			if (m_coldef != nullptr && m_coldef->type() == chrgfx::coldef_type::rgb)
+				builder.from_def(*static_cast<chrgfx::rgbcoldef const *>(m_coldef.get()));
 			if (! m_cfg.rgbcoldef_bitdepth.empty())
 				builder.set_bitdepth(m_cfg.rgbcoldef_bitdepth);
 			if (! m_cfg.rgbcoldef_big_endian.empty())
@@ -266,11 +360,51 @@ private:
 			if (! m_cfg.rgbcoldef_rgblayout.empty())
 				builder.set_layout(m_cfg.rgbcoldef_rgblayout);
 
-			m_coldef = builder.build();
+			m_coldef.reset(builder.build());
 		}
 	}
 
 public:
+	/**
+	 * @brief Parse a gfxdefs file once and keep it for all gfxdef_manager instances created afterward
+	 * @details The chrdefs in the file are built, along with their decoders, at the same time.
+	 * @note Intended for long running processes; the file is not re-read if it changes
+	 */
+	static void preload_file(std::string const & path)
+	{
+		auto & file {file_cache().try_emplace(path, path).first->second};
+		for (auto const & block : file.config)
+		{
+			if (block.first != "chrdef")
+				continue;
+			auto kv = block.second.find("id");
+			if (kv == block.second.end())
+				continue;
+
+			// as when loading, only the first block with an ID is used
+			auto [entry, added] {file.chrdefs.try_emplace(kv->second)};
+			if (! added)
+				continue;
+			try
+			{
+				entry->second.chrdef.reset(build_chrdef(file.config, block.second));
+				entry->second.decoder = std::make_shared<chrgfx::tile_decoder const>(entry->second.chrdef);
+			}
+			catch (std::exception const &)
+			{
+				entry->second = {};
+			}
+		}
+	}
+
+	/**
+	 * @brief Drop all preloaded gfxdefs files
+	 */
+	static void clear_preloaded()
+	{
+		file_cache().clear();
+	}
+
 	gfxdef_manager(runtime_config & cfg) :
 			m_cfg(cfg),
 			m_target_profile(m_cfg.profile_id),
@@ -281,10 +415,10 @@ public:
 		// if no IDs are specified (i.e. building entirely from command line), skip these steps
 		if (! (m_target_profile.empty() && m_target_chrdef.empty() && m_target_paldef.empty() && m_target_coldef.empty()))
 		{
-			// we load from file first to get the profile, if specified
 			if (! m_cfg.gfxdefs_path.empty())
 			{
 				// if a gfxdefs file was specified, use that one only
+				// we load from file first to get the profile, if specified
 				load_from_file(m_cfg.gfxdefs_path);
 #ifdef DEBUG
 				std::cerr << "Considering gfxdefs file: " << m_cfg.gfxdefs_path << '\n';
@@ -292,58 +426,74 @@ public:
 			}
 			else
 			{
-				// otherwise read from XDG location(s)
-				auto xdg_locations {motoi::data_filepaths(GFXDEF_SUBDIR)};
-				if (xdg_locations.empty())
-					throw runtime_error("could not find a gfxdefs file in any default location");
-				for (auto const & path : xdg_locations)
+				// the gfxdefs file shipped with chrgfx is embedded in the library, so check that before touching the
+				// filesystem; the XDG location(s) are only read for definitions added by the user
+				if (! m_target_profile.empty())
+					load_profile_from_internal();
+				load_from_internal();
+
+				if (! targets_loaded())
 				{
+					auto xdg_locations {motoi::data_filepaths(GFXDEF_SUBDIR)};
+					if (xdg_locations.empty())
+						throw std::runtime_error("could not find a gfxdefs file in any default location");
+					for (auto const & path : xdg_locations)
+					{
 #ifdef DEBUG
-					std::cerr << "Considering gfxdefs file: " << path << '\n';
+						std::cerr << "Considering gfxdefs file: " << path << '\n';
 #endif
-					load_from_file(path);
+						load_from_file(path);
+					}
 				}
 			}
 
 			if (! m_target_profile.empty() && ! profile_found)
 			{
-				throw runtime_error("could not find specified profile " + m_target_profile);
+				throw std::runtime_error("could not find specified profile " + m_target_profile);
 			}
 
 			load_from_internal();
 			if (! m_target_chrdef.empty() && m_chrdef == nullptr)
-				throw runtime_error("could not find specified chrdef " + m_target_chrdef);
+				throw std::runtime_error("could not find specified chrdef " + m_target_chrdef);
 			if (! m_target_paldef.empty() && m_paldef == nullptr)
-				throw runtime_error("could not find specified paldef " + m_target_paldef);
+				throw std::runtime_error("could not find specified paldef " + m_target_paldef);
 			if (! m_target_coldef.empty() && m_coldef == nullptr)
-				throw runtime_error("could not find specified coldef " + m_target_coldef);
+				throw std::runtime_error("could not find specified coldef " + m_target_coldef);
 		}
 		load_from_cli();
 
 		if (m_chrdef == nullptr && m_paldef == nullptr && m_coldef == nullptr)
-			throw runtime_error("no gfxdefs loaded");
-	}
+			throw std::runtime_error("no gfxdefs loaded");
 
-	~gfxdef_manager()
-	{
-		delete m_chrdef;
-		delete m_paldef;
-		delete m_coldef;
+		// resolved here rather than on first use, as batch jobs on several threads share a manager; a chrdef built when
+		// its file was preloaded already has one, unless it was since changed from the command line
+		if (m_chrdef != nullptr && (m_decoder == nullptr || &m_decoder->chrdef() != m_chrdef.get()))
+			m_decoder = chrgfx::gfxdef_registry::global().decoder(m_chrdef);
 	}
 
 	auto chrdef()
 	{
-		return m_chrdef;
+		return m_chrdef.get();
 	}
 
 	auto paldef()
 	{
-		return m_paldef;
+		return m_paldef.get();
 	}
 
 	auto coldef()
 	{
-		return m_coldef;
+		return m_coldef.get();
+	}
+
+	/**
+	 * @brief Table driven decoder for the chrdef, or nullptr if there is no chrdef
+	 * @details The decoder for a library chrdef is shared with all other users through the registry. One for a chrdef
+	 * from a file or the command line is kept by this manager, and is dropped along with it.
+	 */
+	[[nodiscard]] std::shared_ptr<chrgfx::tile_decoder const> const & decoder() const
+	{
+		return m_decoder;
 	}
 };
 
@@ -0,0 +1,118 @@
+/**
+ * @file interleave.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Presents a set of interleaved files as a single address space
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * Graphics data on arcade boards is often split across several ROM chips, with the full data word formed by reading
+ * from each chip in turn. Dumps of such a set are separate files, where each holds every Nth byte (or word) of the
+ * logical data. Here those files are memory mapped and read through an address translation, so the merged data never
+ * has to be built in full.
+ *
+ * With N files and an interleave width of W bytes, logical address A comes from file (A / W) % N, at offset
+ * ((A / W) / N) * W + (A % W).
+ */
+
+#ifndef __MOTOI__INTERLEAVE_HPP
+#define __MOTOI__INTERLEAVE_HPP
+
+#include "mappedfile.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace motoi
+{
+
+class interleaved_files
+{
+private:
+	std::vector<mapped_file> m_files;
+	size_t m_width;
+	// logical address of the first byte of the mapped region of each file
+	size_t m_offset;
+	size_t m_size;
+
+public:
+	/**
+	 * @param paths Files in interleave order; the first holds logical bytes 0 to width - 1
+	 * @param width Interleave width in bytes
+	 * @param offset Start of the logical region to make available
+	 * @param length Size of the logical region; clamped to the end of the data
+	 */
+	interleaved_files(std::vector<std::string> const & paths,
+		size_t const width,
+		size_t const offset = 0,
+		size_t const length = mapped_file::npos) :
+			m_width {width}
+	{
+		if (paths.size() < 2)
+			throw std::invalid_argument("At least two files are needed for interleaved input");
+		if (width == 0)
+			throw std::invalid_argument("Invalid interleave width");
+
+		// check the sizes before mapping anything
+		size_t file_size {mapped_file::npos};
+		for (auto const & path : paths)
+		{
+			auto const this_size {mapped_file(path, 0, 0).file_size()};
+			if (file_size != mapped_file::npos && this_size != file_size)
+				throw std::invalid_argument("Interleaved files must all be the same size");
+			file_size = this_size;
+		}
+		if (file_size % width != 0)
+			throw std::invalid_argument("Interleaved file size must be a multiple of the interleave width");
+
+		size_t const group_size {width * paths.size()}, total_size {file_size * paths.size()};
+		if (offset > total_size)
+			throw std::out_of_range("Offset is beyond the end of the interleaved data");
+		m_size = std::min(length, total_size - offset);
+
+		// map only the groups which contain the requested region
+		size_t const first_group {offset / group_size},
+			last_group {m_size > 0 ? (offset + m_size + group_size - 1) / group_size : first_group};
+		m_offset = first_group * group_size;
+		for (auto const & path : paths)
+			m_files.emplace_back(path, first_group * width, (last_group - first_group) * width);
+
+		// the region is relative to the requested offset from here on
+		m_offset = offset - m_offset;
+	}
+
+	/**
+	 * @brief Size of the logical region in bytes
+	 */
+	[[nodiscard]] size_t size() const
+	{
+		return m_size;
+	}
+
+	/**
+	 * @brief Copy part of the logical region into a buffer
+	 * @param offset Start of the data to read, relative to the start of the region
+	 */
+	void read(size_t const offset, size_t const length, unsigned char * out) const
+	{
+		if (offset > m_size || length > m_size - offset)
+			throw std::out_of_range("Read is beyond the end of the interleaved data");
+
+		size_t const file_count {m_files.size()};
+		size_t address {m_offset + offset}, remaining {length};
+		while (remaining > 0)
+		{
+			size_t const chunk {address / m_width}, in_chunk {address % m_width},
+				copy_size {std::min(remaining, m_width - in_chunk)};
+			auto const * in {m_files[chunk % file_count].data() + ((chunk / file_count) * m_width) + in_chunk};
+			// chunks are usually only a byte or a word, too small for memcpy to be worth the call
+			for (size_t i {0}; i < copy_size; ++i)
+				*out++ = in[i];
+			address += copy_size;
+			remaining -= copy_size;
+		}
+	}
+};
+
+} // namespace motoi
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file mappedfile.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Read only memory mapping of a region of a file
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * Only the requested region is mapped, and pages are read from disk as they are first touched, so working with a small
+ * window into a very large file costs roughly the size of the window.
+ */
+
+#ifndef __MOTOI__MAPPEDFILE_HPP
+#define __MOTOI__MAPPEDFILE_HPP
+
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace motoi
+{
+
+class mapped_file
+{
+private:
+	void * m_map {nullptr};
+	size_t m_map_size {0};
+	unsigned char const * m_data {nullptr};
+	size_t m_size {0};
+	size_t m_file_size {0};
+
+public:
+	static size_t constexpr npos {static_cast<size_t>(-1)};
+
+	mapped_file(mapped_file const &) = delete;
+	mapped_file & operator=(mapped_file const &) = delete;
+
+	/**
+	 * @param offset Start of the region, in bytes
+	 * @param length Size of the region, in bytes; clamped to the end of the file
+	 */
+	explicit mapped_file(std::string const & path, size_t const offset = 0, size_t const length = npos)
+	{
+		int const fd {::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Could not open \"" + path + "\" for read");
+
+		struct stat status;
+		if (::fstat(fd, &status) != 0 || ! S_ISREG(status.st_mode))
+		{
+			::close(fd);
+			throw std::invalid_argument("Cannot map \"" + path + "\": not a regular file");
+		}
+		m_file_size = status.st_size;
+
+		if (offset > m_file_size)
+		{
+			::close(fd);
+			throw std::out_of_range("Offset is beyond the end of \"" + path + "\"");
+		}
+		m_size = std::min(length, m_file_size - offset);
+
+		if (m_size > 0)
+		{
+			// mappings must start on a page boundary
+			size_t const page_size {static_cast<size_t>(::sysconf(_SC_PAGESIZE))},
+				map_offset {offset - (offset % page_size)};
+			m_map_size = m_size + (offset - map_offset);
+			m_map = ::mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(map_offset));
+			if (m_map == MAP_FAILED)
+			{
+				auto const map_errno {errno};
+				::close(fd);
+				m_map = nullptr;
+				throw std::system_error(map_errno, std::generic_category(), "Could not map \"" + path + "\"");
+			}
+			m_data = static_cast<unsigned char const *>(m_map) + (offset - map_offset);
+			// the region is normally read front to back
+			::madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+	}
+
+	mapped_file(mapped_file && other) noexcept :
+			m_map {other.m_map},
+			m_map_size {other.m_map_size},
+			m_data {other.m_data},
+			m_size {other.m_size},
+			m_file_size {other.m_file_size}
+	{
+		other.m_map = nullptr;
+		other.m_map_size = 0;
+		other.m_data = nullptr;
+		other.m_size = 0;
+	}
+
+	~mapped_file()
+	{
+		if (m_map != nullptr)
+			::munmap(m_map, m_map_size);
+	}
+
+	/**
+	 * @brief Pointer to the start of the mapped region
+	 */
+	[[nodiscard]] unsigned char const * data() const
+	{
+		return m_data;
+	}
+
+	/**
+	 * @brief Size of the mapped region in bytes
+	 */
+	[[nodiscard]] size_t size() const
+	{
+		return m_size;
+	}
+
+	/**
+	 * @brief Size of the whole file in bytes
+	 */
+	[[nodiscard]] size_t file_size() const
+	{
+		return m_file_size;
+	}
+};
+
+} // namespace motoi
+
+#endif
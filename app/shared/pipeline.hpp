@@ -0,0 +1,166 @@
+/**
+ * @file pipeline.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Bounded queues for connecting the stages of a multithreaded pipeline
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * Both queues block producers when full so that a fast stage cannot run arbitrarily far ahead of a slow one, and both
+ * can be aborted from any thread to unblock every waiting stage when one of them fails.
+ */
+
+#ifndef __MOTOI__PIPELINE_HPP
+#define __MOTOI__PIPELINE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+
+namespace motoi
+{
+
+/**
+ * @brief First in, first out queue with a maximum size
+ */
+template <typename T>
+class bounded_queue
+{
+private:
+	size_t const m_capacity;
+	std::deque<T> m_items;
+	bool m_closed {false};
+	bool m_aborted {false};
+	std::mutex m_mutex;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+
+public:
+	explicit bounded_queue(size_t const capacity) :
+			m_capacity {capacity > 0 ? capacity : 1}
+	{
+	}
+
+	/**
+	 * @brief Add an item, waiting for space if the queue is full
+	 * @return false if the queue was aborted
+	 */
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock {m_mutex};
+		m_not_full.wait(lock, [this] { return m_aborted || m_items.size() < m_capacity; });
+		if (m_aborted)
+			return false;
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	/**
+	 * @brief Remove the next item, waiting for one if the queue is empty
+	 * @return The item, or nullopt if the queue has been closed and emptied, or was aborted
+	 */
+	std::optional<T> pop()
+	{
+		std::unique_lock<std::mutex> lock {m_mutex};
+		m_not_empty.wait(lock, [this] { return m_aborted || m_closed || ! m_items.empty(); });
+		if (m_aborted || m_items.empty())
+			return std::nullopt;
+		std::optional<T> item {std::move(m_items.front())};
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return item;
+	}
+
+	/**
+	 * @brief Indicate that no more items will be added; consumers receive the remaining items and then nullopt
+	 */
+	void close()
+	{
+		std::lock_guard<std::mutex> lock {m_mutex};
+		m_closed = true;
+		m_not_empty.notify_all();
+	}
+
+	/**
+	 * @brief Stop the queue immediately, discarding any remaining items
+	 */
+	void abort()
+	{
+		std::lock_guard<std::mutex> lock {m_mutex};
+		m_aborted = true;
+		m_items.clear();
+		m_not_full.notify_all();
+		m_not_empty.notify_all();
+	}
+};
+
+/**
+ * @brief Collects items produced out of order by parallel workers and hands them out in sequence
+ * @details Items are numbered from 0. A producer with an item too far ahead of the next one to be consumed waits, which
+ * bounds the number of items held. The producer of the next item never waits, so this cannot deadlock as long as every
+ * number is eventually produced.
+ */
+template <typename T>
+class reorder_queue
+{
+private:
+	size_t const m_capacity;
+	size_t m_next {0};
+	std::map<size_t, T> m_items;
+	bool m_aborted {false};
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+
+public:
+	explicit reorder_queue(size_t const capacity) :
+			m_capacity {capacity > 0 ? capacity : 1}
+	{
+	}
+
+	/**
+	 * @brief Add item number index, waiting if it is too far ahead of the consumer
+	 * @return false if the queue was aborted
+	 */
+	bool push(size_t const index, T item)
+	{
+		std::unique_lock<std::mutex> lock {m_mutex};
+		m_changed.wait(lock, [&] { return m_aborted || index < m_next + m_capacity; });
+		if (m_aborted)
+			return false;
+		m_items.emplace(index, std::move(item));
+		m_changed.notify_all();
+		return true;
+	}
+
+	/**
+	 * @brief Remove the next item in sequence, waiting for it to be produced
+	 * @return The item, or nullopt if the queue was aborted
+	 */
+	std::optional<T> pop()
+	{
+		std::unique_lock<std::mutex> lock {m_mutex};
+		m_changed.wait(lock, [this] { return m_aborted || m_items.count(m_next) > 0; });
+		if (m_aborted)
+			return std::nullopt;
+		auto node {m_items.extract(m_next)};
+		++m_next;
+		m_changed.notify_all();
+		return std::move(node.mapped());
+	}
+
+	/**
+	 * @brief Stop the queue immediately, discarding any remaining items
+	 */
+	void abort()
+	{
+		std::lock_guard<std::mutex> lock {m_mutex};
+		m_aborted = true;
+		m_items.clear();
+		m_changed.notify_all();
+	}
+};
+
+} // namespace motoi
+
+#endif
@@ -1,5 +1,7 @@
 #include "shared.hpp"
+#include "strutil.hpp"
 #include <iostream>
+#include <stdexcept>
 
 using namespace std;
 
@@ -163,3 +165,141 @@ bool runtime_config::paldef_cli_defined() const
 {
 	return ! (paldef_datasize.empty() && paldef_entry_datasize.empty() && paldef_length.empty());
 }
+
+data_extent parse_data_extent(string const & value)
+{
+	data_extent extent;
+	string number {value};
+	if (! number.empty() && (number.back() == 't' || number.back() == 'T'))
+	{
+		extent.in_tiles = true;
+		number.pop_back();
+	}
+
+	size_t parsed_length {0};
+	try
+	{
+		if (number.empty() || number.front() == '-')
+			throw invalid_argument("negative or missing");
+		extent.value = stoull(number, &parsed_length, 0);
+	}
+	catch (exception const &)
+	{
+		parsed_length = 0;
+	}
+	if (parsed_length == 0 || parsed_length != number.size())
+		throw invalid_argument("Invalid offset/count value: " + value);
+
+	return extent;
+}
+
+chrgfx::transform_chain parse_transforms(string const & value)
+{
+	using chrgfx::transform_op;
+
+	chrgfx::transform_chain chain;
+	for (auto const & name : motoi::split_container<vector<string_view>>(value))
+	{
+		if (name == "swap16")
+			chain.push_back({transform_op::byteswap16});
+		else if (name == "swap32")
+			chain.push_back({transform_op::byteswap32});
+		else if (name == "bitrev")
+			chain.push_back({transform_op::bitreverse});
+		else
+		{
+			auto const op {name.rfind("deint", 0) == 0 ? transform_op::deinterleave : transform_op::interleave};
+			auto const prefix_len {op == transform_op::deinterleave ? 5 : 3};
+			if (op == transform_op::interleave && name.rfind("int", 0) != 0)
+				throw invalid_argument("Invalid transform: " + string(name));
+
+			string const ways_str {name.substr(prefix_len)};
+			size_t parsed_length {0};
+			int ways {0};
+			try
+			{
+				ways = stoi(ways_str, &parsed_length);
+			}
+			catch (exception const &)
+			{
+			}
+			if (ways < 2 || parsed_length != ways_str.size())
+				throw invalid_argument("Invalid transform: " + string(name));
+			chain.push_back({op, static_cast<uint>(ways)});
+		}
+	}
+	return chain;
+}
+
+chrgfx::compression_format parse_compression(string const & value)
+{
+	using chrgfx::compression_format;
+
+	if (value == "gzip")
+		return compression_format::gzip;
+	if (value == "lz77")
+		return compression_format::lz77;
+	if (value == "kosinski")
+		return compression_format::kosinski;
+	if (value == "nemesis")
+		return compression_format::nemesis;
+	throw invalid_argument("Invalid compression format: " + value);
+}
+
+/*
+	Parses a whole string as an unsigned integer, throwing with the given message if it is anything else
+*/
+static uint parse_uint(string_view const value, string const & error)
+{
+	string const number {value};
+	size_t parsed_length {0};
+	unsigned long parsed {0};
+	try
+	{
+		if (! number.empty() && number.front() != '-')
+			parsed = stoul(number, &parsed_length);
+	}
+	catch (exception const &)
+	{
+		parsed_length = 0;
+	}
+	if (parsed_length == 0 || parsed_length != number.size() || parsed > UINT32_MAX)
+		throw invalid_argument(error);
+	return static_cast<uint>(parsed);
+}
+
+chrgfx::tile_arrangement parse_arrangement(string const & value)
+{
+	using chrgfx::tile_order;
+
+	chrgfx::tile_arrangement arrangement;
+	for (auto const & item : motoi::split_container<vector<string_view>>(value))
+	{
+		string const error {"Invalid tile arrangement: " + string(item)};
+		if (item == "rows")
+			arrangement.group_order = tile_order::rows;
+		else if (item == "columns")
+			arrangement.group_order = tile_order::columns;
+		else if (item == "down")
+			arrangement.order = tile_order::columns;
+		else if (item.rfind("gutter=", 0) == 0)
+			arrangement.gutter = parse_uint(item.substr(7), error);
+		else if (item.rfind("seq=", 0) == 0)
+		{
+			arrangement.group_sequence.clear();
+			for (auto const & position : motoi::split_container<vector<string_view>>(item.substr(4), ':'))
+				arrangement.group_sequence.push_back(parse_uint(position, error));
+		}
+		else
+		{
+			auto const separator {item.find('x')};
+			if (separator == string_view::npos)
+				throw invalid_argument(error);
+			arrangement.group_width = parse_uint(item.substr(0, separator), error);
+			arrangement.group_height = parse_uint(item.substr(separator + 1), error);
+			if (arrangement.group_width == 0 || arrangement.group_height == 0)
+				throw invalid_argument(error);
+		}
+	}
+	return arrangement;
+}
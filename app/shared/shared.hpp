@@ -5,6 +5,9 @@
 #include <string>
 #include <vector>
 
+#include "arrangement.hpp"
+#include "compression.hpp"
+#include "preprocess.hpp"
 #include "usage.hpp"
 
 // these are intentionally mutable
@@ -44,6 +47,46 @@ struct runtime_config
 
 bool shared_args(char this_opt, runtime_config & cfg);
 
+/**
+ * @brief A position or length within tile data, given either in bytes or in tiles
+ */
+struct data_extent
+{
+	size_t value {0};
+	bool in_tiles {false};
+
+	size_t bytes(size_t const tile_datasize) const
+	{
+		return in_tiles ? value * tile_datasize : value;
+	}
+};
+
+/**
+ * @brief Parse a data extent option value
+ * @details A number of bytes, in decimal or with a 0x prefix for hex, or a number of tiles with a t suffix (e.g. 0x8000,
+ * 512t)
+ */
+data_extent parse_data_extent(std::string const & value);
+
+/**
+ * @brief Parse a comma separated list of data transforms
+ * @details swap16, swap32, bitrev, deint<N> (deinterleave N ways) and int<N> (interleave N ways), e.g. deint2,swap16
+ */
+chrgfx::transform_chain parse_transforms(std::string const & value);
+
+/**
+ * @brief Parse a compression format name: gzip, lz77, kosinski or nemesis
+ */
+chrgfx::compression_format parse_compression(std::string const & value);
+
+/**
+ * @brief Parse a comma separated tile arrangement
+ * @details Any of: <W>x<H> (group size in tiles), rows or columns (order of the tiles within a group), seq=<list> (the
+ * position of each tile within a group, separated by colons), down (place groups top to bottom, then left to right) and
+ * gutter=<N> (pixels between groups), e.g. 2x2,columns,gutter=1
+ */
+chrgfx::tile_arrangement parse_arrangement(std::string const & value);
+
 std::string get_gfxdefs_path();
 
 #endif
@@ -0,0 +1,164 @@
+/**
+ * @file tilemanifest.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Record of the tiles last written to an encoded tile data file, for incremental updates
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * The manifest is kept alongside the tile data and holds a hash of each tile as it was written, a hash of the
+ * settings used to encode them, and the size and modification time of the tile data afterward. If the settings differ
+ * or the file has changed since, the tile data may not be what the manifest describes and must be written in full.
+ *
+ * The file is binary, with all values little endian: the magic "CHRGFXTM", a 32 bit version, then the settings hash,
+ * data size, data modification time (nanoseconds), tile count and tile hashes, all 64 bits.
+ */
+
+#ifndef CHRGFX__SHARED_TILEMANIFEST_HPP
+#define CHRGFX__SHARED_TILEMANIFEST_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace motoi
+{
+
+struct tile_manifest
+{
+	static constexpr char MAGIC[8] {'C', 'H', 'R', 'G', 'F', 'X', 'T', 'M'};
+	static constexpr uint32_t VERSION {1};
+
+	uint64_t settings_hash {0};
+	uint64_t data_size {0};
+	int64_t data_mtime {0};
+	std::vector<uint64_t> tile_hashes;
+
+	/**
+	 * @brief Record the current size and modification time of the tile data file
+	 */
+	void stamp(std::string const & data_path)
+	{
+		struct stat status;
+		if (::stat(data_path.c_str(), &status) != 0)
+			throw std::runtime_error("Could not read the status of \"" + data_path + "\"");
+		data_size = status.st_size;
+		data_mtime = (static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000) + status.st_mtim.tv_nsec;
+	}
+
+	/**
+	 * @brief Whether the tile data file is unchanged since it was stamped
+	 */
+	[[nodiscard]] bool matches(std::string const & data_path) const
+	{
+		tile_manifest current;
+		try
+		{
+			current.stamp(data_path);
+		}
+		catch (std::runtime_error const &)
+		{
+			return false;
+		}
+		return current.data_size == data_size && current.data_mtime == data_mtime;
+	}
+
+	/**
+	 * @return The manifest, or nullopt if the file does not exist or is not a valid manifest
+	 */
+	static std::optional<tile_manifest> load(std::string const & path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (! in.good())
+			return std::nullopt;
+
+		auto read_u64 = [&in]() {
+			unsigned char bytes[8];
+			in.read(reinterpret_cast<char *>(bytes), sizeof(bytes));
+			uint64_t value {0};
+			for (int i {7}; i >= 0; --i)
+				value = (value << 8) | bytes[i];
+			return value;
+		};
+
+		char magic[sizeof(MAGIC)];
+		unsigned char version[4];
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char *>(version), sizeof(version));
+		if (! in.good() || ! std::equal(magic, magic + sizeof(magic), MAGIC) ||
+				(version[0] | (version[1] << 8) | (version[2] << 16) | (static_cast<uint32_t>(version[3]) << 24)) != VERSION)
+			return std::nullopt;
+
+		tile_manifest out;
+		out.settings_hash = read_u64();
+		out.data_size = read_u64();
+		out.data_mtime = static_cast<int64_t>(read_u64());
+		auto const tile_count {read_u64()};
+		if (! in.good())
+			return std::nullopt;
+
+		// don't trust the count with an allocation before checking that the file is long enough
+		auto const hashes_start {in.tellg()};
+		in.seekg(0, std::ios::end);
+		if (static_cast<uint64_t>(in.tellg() - hashes_start) != tile_count * 8)
+			return std::nullopt;
+		in.seekg(hashes_start);
+
+		out.tile_hashes.resize(tile_count);
+		for (auto & hash : out.tile_hashes)
+			hash = read_u64();
+		if (! in.good())
+			return std::nullopt;
+
+		return out;
+	}
+
+	/**
+	 * @brief Write the manifest
+	 * @details The manifest is written to a temporary file which then replaces the original, so an interrupted write
+	 * never leaves a manifest which appears valid
+	 */
+	void save(std::string const & path) const
+	{
+		std::string const temp_path {path + ".tmp"};
+		{
+			std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+			if (! out.good())
+				throw std::runtime_error("Could not open \"" + temp_path + "\" for write");
+
+			auto write_u64 = [&out](uint64_t value) {
+				unsigned char bytes[8];
+				for (auto & byte : bytes)
+				{
+					byte = value & 0xff;
+					value >>= 8;
+				}
+				out.write(reinterpret_cast<char const *>(bytes), sizeof(bytes));
+			};
+
+			unsigned char const version[4] {VERSION & 0xff, (VERSION >> 8) & 0xff, (VERSION >> 16) & 0xff, VERSION >> 24};
+			out.write(MAGIC, sizeof(MAGIC));
+			out.write(reinterpret_cast<char const *>(version), sizeof(version));
+			write_u64(settings_hash);
+			write_u64(data_size);
+			write_u64(static_cast<uint64_t>(data_mtime));
+			write_u64(tile_hashes.size());
+			for (auto const hash : tile_hashes)
+				write_u64(hash);
+
+			if (! out.good())
+				throw std::runtime_error("Failed to write tile manifest");
+		}
+
+		if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+			throw std::runtime_error("Could not replace \"" + path + "\"");
+	}
+};
+
+} // namespace motoi
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * @file workpool.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @brief Work stealing thread pool for running a fixed set of tasks
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ *
+ * Each worker has its own queue, filled round robin before the workers start. A worker takes tasks from the back of its
+ * own queue and, once that is empty, steals from the front of the others. Since no tasks are added while running, a
+ * worker which finds nothing to steal is finished.
+ */
+
+#ifndef __MOTOI__WORKPOOL_HPP
+#define __MOTOI__WORKPOOL_HPP
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace motoi
+{
+
+class work_pool
+{
+public:
+	using task = std::function<void()>;
+
+private:
+	struct worker_queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	size_t m_thread_count;
+	std::unique_ptr<worker_queue[]> m_queues;
+
+	bool pop(size_t const worker, task & out)
+	{
+		auto & queue {m_queues[worker]};
+		std::lock_guard<std::mutex> lock {queue.mutex};
+		if (queue.tasks.empty())
+			return false;
+		out = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(size_t const thief, task & out)
+	{
+		for (size_t offset {1}; offset < m_thread_count; ++offset)
+		{
+			auto & queue {m_queues[(thief + offset) % m_thread_count]};
+			std::lock_guard<std::mutex> lock {queue.mutex};
+			if (queue.tasks.empty())
+				continue;
+			out = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+public:
+	/**
+	 * @param thread_count Number of worker threads; 0 uses the number of hardware threads
+	 */
+	explicit work_pool(size_t const thread_count = 0) :
+			m_thread_count {thread_count > 0 ? thread_count : std::max<size_t>(std::thread::hardware_concurrency(), 1)},
+			m_queues {new worker_queue[m_thread_count]}
+	{
+	}
+
+	size_t thread_count() const
+	{
+		return m_thread_count;
+	}
+
+	/**
+	 * @brief Run all tasks and wait for them to complete
+	 * @note If a task throws, the remaining tasks are still run and the first exception is rethrown afterward
+	 */
+	void run(std::vector<task> tasks)
+	{
+		for (size_t i {0}; i < tasks.size(); ++i)
+			m_queues[i % m_thread_count].tasks.push_back(std::move(tasks[i]));
+
+		std::mutex error_mutex;
+		std::exception_ptr error;
+
+		auto worker_main = [&](size_t const worker) {
+			task this_task;
+			while (pop(worker, this_task) || steal(worker, this_task))
+			{
+				try
+				{
+					this_task();
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock {error_mutex};
+					if (! error)
+						error = std::current_exception();
+				}
+			}
+		};
+
+		// the calling thread acts as the first worker
+		std::vector<std::thread> workers;
+		size_t const worker_count {std::min(m_thread_count, std::max<size_t>(tasks.size(), 1))};
+		for (size_t worker {1}; worker < worker_count; ++worker)
+			workers.emplace_back(worker_main, worker);
+		worker_main(0);
+		for (auto & thread : workers)
+			thread.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
+
+} // namespace motoi
+
+#endif
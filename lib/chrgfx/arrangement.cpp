@@ -0,0 +1,120 @@
+#include "arrangement.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+/*
+	Returns the number of groups in each row of the image, checking the arrangement on the way
+*/
+static size_t groups_per_row(tile_arrangement const & arrangement, uint const row_size)
+{
+	if (arrangement.group_width == 0 || arrangement.group_height == 0)
+		throw invalid_argument("Invalid tile group dimensions");
+	if (row_size == 0)
+		throw invalid_argument("Invalid row size");
+
+	return max<size_t>(1, row_size / arrangement.group_width);
+}
+
+tile_layout layout_tiles(tile_arrangement const & arrangement,
+	uint const tile_width,
+	uint const tile_height,
+	uint const row_size,
+	size_t const tile_count)
+{
+	if (tile_width == 0 || tile_height == 0)
+		throw invalid_argument("Invalid tile dimension(s)");
+	if (tile_count == 0)
+		throw invalid_argument("No tiles to lay out");
+
+	size_t const group_columns {groups_per_row(arrangement, row_size)},
+		group_size {(size_t) arrangement.group_width * arrangement.group_height};
+
+	// the position within a group of each tile in turn
+	vector<tile_position> in_group(group_size);
+	if (! arrangement.group_sequence.empty())
+	{
+		if (arrangement.group_sequence.size() != group_size)
+			throw invalid_argument("Tile group sequence does not match the group size");
+		vector<bool> seen(group_size);
+		for (size_t i {0}; i < group_size; ++i)
+		{
+			auto const position {arrangement.group_sequence[i]};
+			if (position >= group_size || seen[position])
+				throw invalid_argument("Tile group sequence must list each position in the group once");
+			seen[position] = true;
+			in_group[i] = {position % arrangement.group_width, position / arrangement.group_width};
+		}
+	}
+	else
+	{
+		for (size_t i {0}; i < group_size; ++i)
+			in_group[i] = arrangement.group_order == tile_order::rows
+											? tile_position {(uint) (i % arrangement.group_width), (uint) (i / arrangement.group_width)}
+											: tile_position {(uint) (i / arrangement.group_height), (uint) (i % arrangement.group_height)};
+	}
+
+	size_t const group_count {(tile_count + group_size - 1) / group_size},
+		group_rows {(group_count + group_columns - 1) / group_columns},
+		// distance between the start of neighbouring groups, in pixels
+		group_pxlwidth {(size_t) arrangement.group_width * tile_width},
+		group_pxlheight {(size_t) arrangement.group_height * tile_height},
+		group_step_x {group_pxlwidth + arrangement.gutter}, group_step_y {group_pxlheight + arrangement.gutter};
+
+	tile_layout out;
+	out.width = static_cast<uint>((group_columns * group_step_x) - arrangement.gutter);
+	out.height = static_cast<uint>((group_rows * group_step_y) - arrangement.gutter);
+	out.positions.resize(tile_count);
+
+	for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+	{
+		size_t const i_group {i_tile / group_size};
+		auto const & within {in_group[i_tile % group_size]};
+		size_t const group_x {arrangement.order == tile_order::rows ? i_group % group_columns : i_group / group_rows},
+			group_y {arrangement.order == tile_order::rows ? i_group / group_columns : i_group % group_rows};
+
+		out.positions[i_tile] = {static_cast<uint>((group_x * group_step_x) + (within.x * tile_width)),
+			static_cast<uint>((group_y * group_step_y) + (within.y * tile_height))};
+	}
+
+	return out;
+}
+
+tile_layout layout_image_tiles(tile_arrangement const & arrangement,
+	uint const tile_width,
+	uint const tile_height,
+	uint const image_width,
+	uint const image_height)
+{
+	if (tile_width == 0 || tile_height == 0)
+		throw invalid_argument("Invalid tile dimension(s)");
+	if (arrangement.group_width == 0 || arrangement.group_height == 0)
+		throw invalid_argument("Invalid tile group dimensions");
+
+	// the last group in each direction has no gutter after it
+	size_t const group_columns {((size_t) image_width + arrangement.gutter) /
+															(((size_t) arrangement.group_width * tile_width) + arrangement.gutter)},
+		group_rows {((size_t) image_height + arrangement.gutter) /
+								(((size_t) arrangement.group_height * tile_height) + arrangement.gutter)};
+	if (group_columns == 0 || group_rows == 0)
+		throw invalid_argument("Source image too small to form a tile group");
+
+	return layout_tiles(arrangement,
+		tile_width,
+		tile_height,
+		static_cast<uint>(group_columns * arrangement.group_width),
+		group_columns * group_rows * arrangement.group_width * arrangement.group_height);
+}
+
+size_t band_tile_count(tile_arrangement const & arrangement, uint const row_size)
+{
+	if (arrangement.order == tile_order::columns)
+		return 0;
+	return groups_per_row(arrangement, row_size) * arrangement.group_width * arrangement.group_height;
+}
+
+} // namespace chrgfx
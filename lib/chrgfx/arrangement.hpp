@@ -0,0 +1,126 @@
+/**
+ * @file arrangement.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Placement of tiles within a rendered tileset
+ *
+ * Larger sprites are often stored as groups of 8x8 tiles, such as a 16x16 sprite made of a 2x2 group, and the order of
+ * the tiles within a group varies with the hardware: some store the group a row at a time, some a column at a time,
+ * and some in an order of their own. An arrangement describes such a layout, and is worked out once into the position
+ * of every tile, so that rendering is only a matter of copying each tile to its place.
+ */
+
+#ifndef __CHRGFX__ARRANGEMENT_HPP
+#define __CHRGFX__ARRANGEMENT_HPP
+
+#include "types.hpp"
+#include <vector>
+
+namespace chrgfx
+{
+
+enum class tile_order
+{
+	// left to right, then top to bottom
+	rows,
+	// top to bottom, then left to right
+	columns
+};
+
+/**
+ * @brief Description of how tiles are placed in a rendered tileset
+ * @details The default places each tile in turn left to right, in rows of a fixed number of tiles.
+ */
+struct tile_arrangement
+{
+	/**
+	 * @brief Width and height of each group of tiles, in tiles
+	 */
+	uint group_width {1};
+	uint group_height {1};
+
+	/**
+	 * @brief Order in which the tiles fill a group
+	 */
+	tile_order group_order {tile_order::rows};
+
+	/**
+	 * @brief Position within the group of each tile in turn, counted left to right and top to bottom
+	 * @details If set, this overrides group_order; it must contain each position in the group exactly once. For
+	 * example, {1, 0, 3, 2} fills each row of a 2x2 group from the right.
+	 */
+	std::vector<uint> group_sequence;
+
+	/**
+	 * @brief Order in which the groups fill the image
+	 */
+	tile_order order {tile_order::rows};
+
+	/**
+	 * @brief Number of pixels left empty between neighbouring groups
+	 */
+	uint gutter {0};
+};
+
+struct tile_position
+{
+	uint x;
+	uint y;
+};
+
+/**
+ * @brief Dimensions of a rendered tileset and the position of each tile within it
+ */
+struct tile_layout
+{
+	uint width {0};
+	uint height {0};
+
+	/**
+	 * @brief Pixel position of the top left corner of each tile
+	 */
+	std::vector<tile_position> positions;
+};
+
+/**
+ * @brief Work out the position of each tile in a rendered tileset
+ *
+ * @param arrangement Tile placement
+ * @param tile_width Width of a tile in pixels
+ * @param tile_height Height of a tile in pixels
+ * @param row_size Number of tiles in each row of the image; rounded down to a whole number of groups
+ * @param tile_count Number of tiles
+ */
+tile_layout layout_tiles(tile_arrangement const & arrangement,
+	uint const tile_width,
+	uint const tile_height,
+	uint const row_size,
+	size_t const tile_count);
+
+/**
+ * @brief Work out the position of each tile within an image of the given size, as taken apart by make_tileset
+ * @details As many whole groups as fit across and down the image are taken, with the gutters between them skipped.
+ * Pixels to the right of and below the last whole group are ignored.
+ *
+ * @param arrangement Tile placement
+ * @param tile_width Width of a tile in pixels
+ * @param tile_height Height of a tile in pixels
+ * @param image_width Width of the image in pixels
+ * @param image_height Height of the image in pixels
+ */
+tile_layout layout_image_tiles(tile_arrangement const & arrangement,
+	uint const tile_width,
+	uint const tile_height,
+	uint const image_width,
+	uint const image_height);
+
+/**
+ * @brief Returns the number of tiles which fill one full band of rows of groups
+ * @details With groups placed in rows, a tileset can be rendered a band at a time, each band being followed by the gutter
+ * if there is one. With groups placed in columns, every tile may affect any row, and 0 is returned.
+ */
+size_t band_tile_count(tile_arrangement const & arrangement, uint const row_size);
+
+} // namespace chrgfx
+
+#endif
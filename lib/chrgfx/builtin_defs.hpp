@@ -12,6 +12,8 @@
 #include "coldef.hpp"
 #include "paldef.hpp"
 #include <map>
+#include <string_view>
+#include <vector>
 
 namespace chrgfx::gfxdefs
 {
@@ -56,6 +58,48 @@ extern paldef const pal_16bit_256color;
 
 extern std::map<std::string, paldef const &> const paldefs;
 
+/**
+ * @brief Grouping of gfxdef IDs representing the graphics subsystem of a piece of hardware
+ */
+struct profile
+{
+	std::string_view id;
+	std::string_view desc;
+	std::string_view chrdef_id;
+	std::string_view paldef_id;
+	std::string_view coldef_id;
+};
+
+/*
+	The find functions below search the builtin definitions above first, and then the definitions from the gfxdefs file
+	that was embedded into the library at build time. They return nullptr if the ID is not present in either.
+*/
+
+/**
+ * @return Pointer to the hardware profile with the given ID
+ */
+[[nodiscard]] profile const * find_profile(std::string_view id);
+
+/**
+ * @return Pointer to the tile encoding with the given ID
+ */
+[[nodiscard]] chrdef const * find_chrdef(std::string_view id);
+
+/**
+ * @return IDs of all the built in and embedded tile encodings
+ */
+[[nodiscard]] std::vector<std::string_view> chrdef_ids();
+
+/**
+ * @return Pointer to the palette encoding with the given ID
+ */
+[[nodiscard]] paldef const * find_paldef(std::string_view id);
+
+/**
+ * @return Pointer to the color encoding (RGB or reference) with the given ID
+ */
+[[nodiscard]] coldef const * find_coldef(std::string_view id);
+
 } // namespace chrgfx::gfxdefs
 
 #endif
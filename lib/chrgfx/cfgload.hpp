@@ -1,5 +1,5 @@
 /**
- * @file cfgload2.hpp
+ * @file cfgload.hpp
  * @author Damian Rogers / damian@motoi.pro
  * @brief Reads and parses a text file containing configuration data in a simple format of a header with
  *        key/value pairs listed in a brace block.
@@ -4,9 +4,27 @@ namespace chrgfx
 {
 using namespace std;
 
-void encode_chr(chrdef const & chrdef, pixel const * in_tile, byte_t * out_tile)
+/*
+	The conversions below work on a tile within a larger pixel buffer, so that a tile made of sub-tiles can pass each of
+	them straight to or from its place in the whole tile. Encoding only sets bits, as the sub-tiles of some formats are
+	interleaved with each other; the output is cleared once for the whole tile beforehand.
+*/
+
+static void encode_bits(chrdef const & chrdef, pixel const * in_tile, size_t const in_stride, byte_t * out_tile)
 {
-	fill_n(out_tile, chrdef.datasize_bytes(), 0);
+	if (auto const subtile {chrdef.subtile()}; subtile != nullptr)
+	{
+		auto ptr_subtile_offset {chrdef.subtile_offsets().data()};
+		for (uint i_row {0}; i_row < chrdef.subtile_rows(); ++i_row)
+			for (uint i_column {0}; i_column < chrdef.subtile_columns(); ++i_column, ++ptr_subtile_offset)
+			{
+				encode_bits(*subtile,
+					in_tile + (i_row * subtile->height() * in_stride) + (i_column * subtile->width()),
+					in_stride,
+					out_tile + *ptr_subtile_offset);
+			}
+		return;
+	}
 
 	// clang-format off
 	uint
@@ -67,11 +85,26 @@ void encode_chr(chrdef const & chrdef, pixel const * in_tile, byte_t * out_tile)
 		}
 
 		ptr_pixel_offsets = chrdef.pixel_offsets().data();
+		ptr_in_pixel += in_stride - tile_width;
 	}
 }
 
-void decode_chr(chrdef const & chrdef, byte_t const * in_tile, pixel * out_tile)
+static void decode_pixels(chrdef const & chrdef, byte_t const * in_tile, pixel * out_tile, size_t const out_stride)
 {
+	if (auto const subtile {chrdef.subtile()}; subtile != nullptr)
+	{
+		auto ptr_subtile_offset {chrdef.subtile_offsets().data()};
+		for (uint i_row {0}; i_row < chrdef.subtile_rows(); ++i_row)
+			for (uint i_column {0}; i_column < chrdef.subtile_columns(); ++i_column, ++ptr_subtile_offset)
+			{
+				decode_pixels(*subtile,
+					in_tile + *ptr_subtile_offset,
+					out_tile + (i_row * subtile->height() * out_stride) + (i_column * subtile->width()),
+					out_stride);
+			}
+		return;
+	}
+
 	// clang-format off
 	uint
 		// bit offsets in the input tile data
@@ -126,7 +159,19 @@ void decode_chr(chrdef const & chrdef, byte_t const * in_tile, pixel * out_tile)
 		}
 
 		ptr_pixel_offsets = chrdef.pixel_offsets().data();
+		ptr_out_pixel += out_stride - tile_width;
 	}
 }
 
+void encode_chr(chrdef const & chrdef, pixel const * in_tile, byte_t * out_tile)
+{
+	fill_n(out_tile, chrdef.datasize_bytes(), 0);
+	encode_bits(chrdef, in_tile, chrdef.width(), out_tile);
+}
+
+void decode_chr(chrdef const & chrdef, byte_t const * in_tile, pixel * out_tile)
+{
+	decode_pixels(chrdef, in_tile, out_tile, chrdef.width());
+}
+
 } // namespace chrgfx
@@ -1,9 +1,33 @@
 #include "chrdef.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 
 namespace chrgfx
 {
+
+/*
+	Returns the number of bytes from the start of an encoded tile to just past the last bit it uses, which may be more
+	than its data size if the tile is interleaved with others
+*/
+static size_t data_extent(chrdef const & chrdef)
+{
+	if (chrdef.subtile() != nullptr)
+	{
+		size_t const subtile_extent {data_extent(*chrdef.subtile())};
+		size_t extent {0};
+		for (auto const offset : chrdef.subtile_offsets())
+			extent = max(extent, offset + subtile_extent);
+		return extent;
+	}
+
+	auto const max_of = [](vector<uint> const & offsets) {
+		return offsets.empty() ? 0 : *max_element(offsets.begin(), offsets.end());
+	};
+	return ((max_of(chrdef.row_offsets()) + max_of(chrdef.pixel_offsets()) + max_of(chrdef.plane_offsets())) >> 3) + 1;
+}
+
 chrdef::chrdef(string const & id,
 	uint const width,
 	uint const height,
@@ -24,6 +48,66 @@ chrdef::chrdef(string const & id,
 {
 }
 
+chrdef::chrdef(string const & id,
+	chrdef const & subtile,
+	uint const columns,
+	uint const rows,
+	vector<uint> const & subtile_offsets,
+	string const & description) :
+		gfxdef(id, description),
+		m_width(subtile.width() * columns),
+		m_height(subtile.height() * rows),
+		m_bitdepth(subtile.bpp()),
+		m_datasize(m_width * m_height * m_bitdepth),
+		m_datasize_bytes(m_datasize / 8 + (m_datasize % 8 > 0 ? 1 : 0)),
+		m_planeoffsets(subtile.plane_offsets()),
+		m_subtile(make_shared<chrdef const>(subtile)),
+		m_subtile_columns(columns),
+		m_subtile_rows(rows),
+		m_subtile_offsets(subtile_offsets)
+{
+	if (columns == 0 || rows == 0)
+		throw invalid_argument("Invalid sub-tile grid dimensions");
+	if (subtile.datasize() == 0)
+		throw invalid_argument("Invalid sub-tile data size");
+	if (subtile_offsets.size() != (size_t) columns * rows)
+		throw invalid_argument("Number of sub-tile offsets must match the sub-tile grid size");
+	if (data_extent(*this) > m_datasize_bytes)
+		throw invalid_argument("Sub-tile data extends beyond the end of the tile");
+
+	/*
+		If every row of sub-tiles is the first row moved by a fixed amount, the offsets of the whole tile are the sum of a
+		column part and a row part, the same as a tile defined directly. The row with the smallest offsets is used as the
+		base, so that neither part is negative.
+	*/
+	if (subtile.pixel_offsets().empty() || subtile.row_offsets().empty())
+		return;
+
+	size_t base_row {0};
+	for (size_t i_row {1}; i_row < rows; ++i_row)
+		if (subtile_offsets[i_row * columns] < subtile_offsets[base_row * columns])
+			base_row = i_row;
+
+	auto const offset_at = [&](size_t const column, size_t const row) -> int64_t {
+		return subtile_offsets[(row * columns) + column];
+	};
+	for (size_t i_row {0}; i_row < rows; ++i_row)
+		for (size_t i_column {0}; i_column < columns; ++i_column)
+			if (offset_at(i_column, i_row) - offset_at(0, i_row) != offset_at(i_column, base_row) - offset_at(0, base_row))
+				return;
+
+	m_pixeloffsets.reserve(m_width);
+	for (size_t i_column {0}; i_column < columns; ++i_column)
+		for (auto const offset : subtile.pixel_offsets())
+			m_pixeloffsets.push_back(offset + (subtile_offsets[(base_row * columns) + i_column] * 8));
+
+	m_rowoffsets.reserve(m_height);
+	for (size_t i_row {0}; i_row < rows; ++i_row)
+		for (auto const offset : subtile.row_offsets())
+			m_rowoffsets.push_back(
+				offset + ((subtile_offsets[i_row * columns] - subtile_offsets[base_row * columns]) * 8));
+}
+
 auto chrdef::width() const -> uint
 {
 	return m_width;
@@ -79,4 +163,24 @@ uint chrdef::row_offset_at(uint const index) const
 	return m_rowoffsets[index];
 }
 
+chrdef const * chrdef::subtile() const
+{
+	return m_subtile.get();
+}
+
+uint chrdef::subtile_columns() const
+{
+	return m_subtile_columns;
+}
+
+uint chrdef::subtile_rows() const
+{
+	return m_subtile_rows;
+}
+
+vector<uint> const & chrdef::subtile_offsets() const
+{
+	return m_subtile_offsets;
+}
+
 } // namespace chrgfx
@@ -3,6 +3,11 @@
  * @author Damian Rogers / damian@motoi.pro
  * @copyright ©2022 Motoi Productions / Released under MIT License
  * @brief Tile format definition
+ *
+ * Large tiles, such as the 16x16 sprites of many arcade systems, are usually built from smaller tiles in a fixed
+ * arrangement. Rather than listing the offsets of every pixel, such a format can be defined as a grid of sub-tiles of
+ * another chrdef, each at its own byte offset. Encoding and decoding then work a sub-tile at a time, using the tables
+ * of the smaller format, which are a fraction of the size of those for the whole tile.
  */
 
 #ifndef __CHRGFX__CHRDEF_HPP
@@ -10,6 +15,7 @@
 
 #include "gfxdef.hpp"
 #include "types.hpp"
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -31,6 +37,11 @@ protected:
 	std::vector<uint> m_rowoffsets;
 	std::vector<uint> m_planeoffsets;
 
+	std::shared_ptr<chrdef const> m_subtile;
+	uint m_subtile_columns {0};
+	uint m_subtile_rows {0};
+	std::vector<uint> m_subtile_offsets;
+
 public:
 	chrdef(std::string const & id,
 		uint const width,
@@ -41,6 +52,27 @@ public:
 		std::vector<uint> const & plane_offsets,
 		std::string const & description = "");
 
+	/**
+	 * @brief Define a tile as a grid of sub-tiles
+	 * @details The bit depth is that of the sub-tile format, and the dimensions are those of the grid. If the sub-tile
+	 * offsets form a regular grid (that is, moving one sub-tile across adds the same amount on every row), the pixel
+	 * and row offsets of the whole tile are worked out as well, so the definition can be used like any other; if not,
+	 * those lists are empty.
+	 *
+	 * @param id Definition ID
+	 * @param subtile Format of each sub-tile
+	 * @param columns Number of sub-tiles across
+	 * @param rows Number of sub-tiles down
+	 * @param subtile_offsets Offset in bytes of each sub-tile within the encoded tile, left to right and top to bottom
+	 * @param description Definition description
+	 */
+	chrdef(std::string const & id,
+		chrdef const & subtile,
+		uint const columns,
+		uint const rows,
+		std::vector<uint> const & subtile_offsets,
+		std::string const & description = "");
+
 	/**
 	 * @return uint Width of the tile in pixels
 	 */
@@ -97,6 +129,26 @@ public:
 	 * @return uint Bit offset to specified row index within a tile
 	 */
 	[[nodiscard]] uint row_offset_at(uint row_index) const;
+
+	/**
+	 * @return Pointer to the format of each sub-tile, or nullptr if the tile is not made of sub-tiles
+	 */
+	[[nodiscard]] chrdef const * subtile() const;
+
+	/**
+	 * @return uint Number of sub-tiles across the tile
+	 */
+	[[nodiscard]] uint subtile_columns() const;
+
+	/**
+	 * @return uint Number of sub-tiles down the tile
+	 */
+	[[nodiscard]] uint subtile_rows() const;
+
+	/**
+	 * @return Reference to the collection of byte offsets to each sub-tile within a tile
+	 */
+	[[nodiscard]] std::vector<uint> const & subtile_offsets() const;
 };
 
 } // namespace chrgfx
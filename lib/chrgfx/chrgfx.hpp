@@ -8,20 +8,32 @@
 #ifndef __CHRGFX__CHRGFX_HPP
 #define __CHRGFX__CHRGFX_HPP
 
+#include "arrangement.hpp"
 #include "builtin_defs.hpp"
+#include "cfgload.hpp"
 #include "chrconv.hpp"
 #include "chrdef.hpp"
 #include "colconv.hpp"
 #include "coldef.hpp"
+#include "compression.hpp"
 #include "custom.hpp"
+#include "decoded_tiles.hpp"
 #include "gfxdef.hpp"
+#include "gfxdef_builder.hpp"
+#include "gfxdef_registry.hpp"
 #include "image.hpp"
 #include "image_types.hpp"
 #include "imageformat_png.hpp"
 #include "imaging.hpp"
+#include "lineread.hpp"
 #include "palconv.hpp"
 #include "paldef.hpp"
+#include "preprocess.hpp"
+#include "quantize.hpp"
 #include "rgb_layout.hpp"
+#include "scan.hpp"
+#include "tile_decoder.hpp"
+#include "tileset_view.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 
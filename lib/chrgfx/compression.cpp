@@ -0,0 +1,1060 @@
+#include "compression.hpp"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <queue>
+#include <stdexcept>
+#include <zlib.h>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+/*******************************************************
+ *                      GZIP/ZLIB
+ *******************************************************/
+
+class gzip_decompressor : public decompressor
+{
+private:
+	z_stream m_stream {};
+	bool m_finished {false};
+
+public:
+	gzip_decompressor()
+	{
+		// +32 detects a gzip or zlib header automatically
+		if (inflateInit2(&m_stream, 15 + 32) != Z_OK)
+			throw runtime_error("Could not initialize zlib");
+	}
+
+	gzip_decompressor(gzip_decompressor const &) = delete;
+	gzip_decompressor & operator=(gzip_decompressor const &) = delete;
+
+	~gzip_decompressor() override
+	{
+		inflateEnd(&m_stream);
+	}
+
+	size_t decompress(byte_t const * in, size_t const in_size, vector<byte_t> & out) override
+	{
+		byte_t buffer[0x10000];
+		size_t used {0};
+		while (! m_finished && used < in_size)
+		{
+			m_stream.next_in = const_cast<Bytef *>(in + used);
+			m_stream.avail_in = static_cast<uInt>(min(in_size - used, (size_t) UINT_MAX));
+			auto const avail_in {m_stream.avail_in};
+			do
+			{
+				m_stream.next_out = buffer;
+				m_stream.avail_out = sizeof(buffer);
+				auto const result {inflate(&m_stream, Z_NO_FLUSH)};
+				if (result == Z_STREAM_END)
+					m_finished = true;
+				else if (result != Z_OK && result != Z_BUF_ERROR)
+					throw runtime_error("Invalid compressed data");
+				out.insert(out.end(), buffer, buffer + (sizeof(buffer) - m_stream.avail_out));
+			} while (! m_finished && m_stream.avail_out == 0);
+			used += avail_in - m_stream.avail_in;
+		}
+		return used;
+	}
+
+	[[nodiscard]] bool finished() const override
+	{
+		return m_finished;
+	}
+};
+
+class gzip_compressor : public compressor
+{
+private:
+	z_stream m_stream {};
+
+	void run(byte_t const * in, size_t const in_size, int const flush, vector<byte_t> & out)
+	{
+		byte_t buffer[0x10000];
+		size_t used {0};
+		do
+		{
+			m_stream.next_in = const_cast<Bytef *>(in + used);
+			m_stream.avail_in = static_cast<uInt>(min(in_size - used, (size_t) UINT_MAX));
+			auto const avail_in {m_stream.avail_in};
+			bool const last {used + avail_in == in_size};
+			int result;
+			do
+			{
+				m_stream.next_out = buffer;
+				m_stream.avail_out = sizeof(buffer);
+				result = deflate(&m_stream, last ? flush : Z_NO_FLUSH);
+				if (result == Z_STREAM_ERROR)
+					throw runtime_error("zlib compression failed");
+				out.insert(out.end(), buffer, buffer + (sizeof(buffer) - m_stream.avail_out));
+			} while (m_stream.avail_out == 0);
+			used += avail_in - m_stream.avail_in;
+		} while (used < in_size);
+	}
+
+public:
+	explicit gzip_compressor(int const level)
+	{
+		// +16 writes a gzip header
+		if (deflateInit2(&m_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			throw runtime_error("Could not initialize zlib");
+	}
+
+	gzip_compressor(gzip_compressor const &) = delete;
+	gzip_compressor & operator=(gzip_compressor const &) = delete;
+
+	~gzip_compressor() override
+	{
+		deflateEnd(&m_stream);
+	}
+
+	void compress(byte_t const * in, size_t const in_size, vector<byte_t> & out) override
+	{
+		if (in_size > 0)
+			run(in, in_size, Z_NO_FLUSH, out);
+	}
+
+	void finish(vector<byte_t> & out) override
+	{
+		run(nullptr, 0, Z_FINISH, out);
+	}
+};
+
+/*******************************************************
+ *                 BUFFERED FORMATS
+ *******************************************************/
+
+/*
+	Base for the decompressors which decode one command at a time. Input is held until a whole command is available; a
+	command that runs out of input is rolled back and retried when more arrives.
+*/
+class command_decompressor : public decompressor
+{
+protected:
+	vector<byte_t> m_pending;
+	size_t m_pos {0};
+	bool m_finished {false};
+
+	bool read_byte(byte_t & out)
+	{
+		if (m_pos >= m_pending.size())
+			return false;
+		out = m_pending[m_pos++];
+		return true;
+	}
+
+	/**
+	 * @brief Decode one command
+	 * @return false, with all state restored, if there is not enough input for the whole command
+	 */
+	virtual bool decode_command(vector<byte_t> & out) = 0;
+
+public:
+	size_t decompress(byte_t const * in, size_t const in_size, vector<byte_t> & out) override
+	{
+		if (m_finished)
+			return 0;
+
+		m_pending.erase(m_pending.begin(), m_pending.begin() + m_pos);
+		m_pos = 0;
+		m_pending.insert(m_pending.end(), in, in + in_size);
+
+		while (! m_finished && decode_command(out))
+			;
+
+		// anything left over after the end of the data was not used
+		if (m_finished)
+			return in_size - min(in_size, m_pending.size() - m_pos);
+		return in_size;
+	}
+
+	[[nodiscard]] bool finished() const override
+	{
+		return m_finished;
+	}
+};
+
+/*
+	The LZ formats need lookahead for their matches, and some formats record the total size up front, so their
+	compressors collect all the input and do the work when finished.
+*/
+class collecting_compressor : public compressor
+{
+protected:
+	vector<byte_t> m_input;
+
+	virtual void encode(vector<byte_t> & out) = 0;
+
+public:
+	void compress(byte_t const * in, size_t const in_size, vector<byte_t> &) override
+	{
+		m_input.insert(m_input.end(), in, in + in_size);
+	}
+
+	void finish(vector<byte_t> & out) override
+	{
+		encode(out);
+		m_input.clear();
+	}
+};
+
+/*******************************************************
+ *                 LZ STYLE FORMATS
+ *******************************************************/
+
+/*
+	Base for the LZ style decompressors, where each command is a literal or a back reference. The most recent output is
+	kept for resolving back references, since the caller may not keep it.
+*/
+class lz_decompressor : public command_decompressor
+{
+private:
+	vector<byte_t> m_history;
+	size_t m_history_mask;
+	size_t m_total_out {0};
+
+protected:
+	explicit lz_decompressor(size_t const history_size) :
+			m_history(history_size),
+			m_history_mask {history_size - 1}
+	{
+	}
+
+	void put(byte_t const value, vector<byte_t> & out)
+	{
+		out.push_back(value);
+		m_history[m_total_out++ & m_history_mask] = value;
+	}
+
+	void copy_match(size_t const distance, size_t const count, vector<byte_t> & out)
+	{
+		if (distance == 0 || distance > m_total_out || distance > m_history.size())
+			throw runtime_error("Invalid compressed data");
+		for (size_t i {0}; i < count; ++i)
+			put(m_history[(m_total_out - distance) & m_history_mask], out);
+	}
+};
+
+/*
+	Hash chain search for the longest earlier match, shared by the LZ style compressors. Positions must be inserted in
+	order as they are passed.
+*/
+class lz_match_finder
+{
+private:
+	static size_t constexpr HASH_BITS {15};
+	static size_t constexpr MAX_CHAIN {128};
+
+	vector<byte_t> const & m_data;
+	vector<int64_t> m_head;
+	vector<int64_t> m_prev;
+
+	static size_t hash(byte_t const * ptr)
+	{
+		return ((ptr[0] << 10) ^ (ptr[1] << 5) ^ ptr[2]) & ((1 << HASH_BITS) - 1);
+	}
+
+public:
+	struct match
+	{
+		size_t distance {0};
+		size_t length {0};
+	};
+
+	explicit lz_match_finder(vector<byte_t> const & data) :
+			m_data {data},
+			m_head(1 << HASH_BITS, -1),
+			m_prev(data.size(), -1)
+	{
+	}
+
+	void insert(size_t const pos)
+	{
+		if (pos + 3 > m_data.size())
+			return;
+		auto & head {m_head[hash(&m_data[pos])]};
+		m_prev[pos] = head;
+		head = pos;
+	}
+
+	[[nodiscard]] match find(size_t const pos, size_t const window, size_t max_length, size_t const min_distance) const
+	{
+		match best;
+		if (pos + 3 > m_data.size())
+			return best;
+		max_length = min(max_length, m_data.size() - pos);
+
+		auto candidate {m_head[hash(&m_data[pos])]};
+		for (size_t chain {0}; candidate >= 0 && chain < MAX_CHAIN; ++chain, candidate = m_prev[candidate])
+		{
+			size_t const distance {pos - candidate};
+			if (distance > window)
+				break;
+			if (distance < min_distance)
+				continue;
+
+			size_t length {0};
+			while (length < max_length && m_data[candidate + length] == m_data[pos + length])
+				++length;
+			if (length > best.length)
+			{
+				best = {distance, length};
+				if (length == max_length)
+					break;
+			}
+		}
+		return best;
+	}
+};
+
+/*
+	GBA/DS BIOS LZ77 (type 0x10)
+
+	A four byte header holds 0x10 and the decompressed size (24 bits, little endian). Then each flag byte describes the
+	following eight items, from the most significant bit: 0 is a literal byte, 1 is a two byte back reference with a
+	4 bit length (3 to 18) and a 12 bit distance (1 to 4096).
+*/
+class lz77_decompressor : public lz_decompressor
+{
+private:
+	bool m_have_header {false};
+	size_t m_remaining {0};
+	byte_t m_flags {0};
+	uint m_flag_bits {0};
+
+protected:
+	bool decode_command(vector<byte_t> & out) override
+	{
+		auto const saved_pos {m_pos};
+		auto const saved_flags {m_flags};
+		auto const saved_flag_bits {m_flag_bits};
+		auto rollback = [&]() {
+			m_pos = saved_pos;
+			m_flags = saved_flags;
+			m_flag_bits = saved_flag_bits;
+			return false;
+		};
+
+		if (! m_have_header)
+		{
+			byte_t header[4];
+			for (auto & header_byte : header)
+				if (! read_byte(header_byte))
+					return rollback();
+			if (header[0] != 0x10)
+				throw runtime_error("Data is not LZ77 compressed");
+			m_remaining = header[1] | (header[2] << 8) | (header[3] << 16);
+			m_have_header = true;
+			m_finished = m_remaining == 0;
+			return true;
+		}
+
+		if (m_flag_bits == 0)
+		{
+			if (! read_byte(m_flags))
+				return rollback();
+			m_flag_bits = 8;
+		}
+		bool const is_match {(m_flags & 0x80) != 0};
+		m_flags <<= 1;
+		--m_flag_bits;
+
+		if (is_match)
+		{
+			byte_t ref0, ref1;
+			if (! read_byte(ref0) || ! read_byte(ref1))
+				return rollback();
+			size_t const count {min((size_t) ((ref0 >> 4) + 3), m_remaining)};
+			copy_match((((ref0 & 0xf) << 8) | ref1) + 1, count, out);
+			m_remaining -= count;
+		}
+		else
+		{
+			byte_t literal;
+			if (! read_byte(literal))
+				return rollback();
+			put(literal, out);
+			--m_remaining;
+		}
+
+		m_finished = m_remaining == 0;
+		return true;
+	}
+
+public:
+	lz77_decompressor() :
+			lz_decompressor(0x1000)
+	{
+	}
+};
+
+class lz77_compressor : public collecting_compressor
+{
+protected:
+	void encode(vector<byte_t> & out) override
+	{
+		size_t const size {m_input.size()};
+		if (size > 0xffffff)
+			throw invalid_argument("Data too large for LZ77 compression");
+
+		auto const start {out.size()};
+		out.insert(out.end(), {0x10, (byte_t) size, (byte_t) (size >> 8), (byte_t) (size >> 16)});
+
+		lz_match_finder finder(m_input);
+		size_t pos {0};
+		while (pos < size)
+		{
+			auto const flags_pos {out.size()};
+			out.push_back(0);
+			for (uint bit {0}; bit < 8 && pos < size; ++bit)
+			{
+				// a distance of 1 cannot be decompressed by the BIOS directly into VRAM, which is written 16 bits at a time
+				auto const match {finder.find(pos, 0x1000, 18, 2)};
+				if (match.length >= 3)
+				{
+					out[flags_pos] |= 0x80 >> bit;
+					auto const distance {match.distance - 1};
+					out.push_back(((match.length - 3) << 4) | (distance >> 8));
+					out.push_back(distance & 0xff);
+					for (size_t i {0}; i < match.length; ++i)
+						finder.insert(pos++);
+				}
+				else
+				{
+					out.push_back(m_input[pos]);
+					finder.insert(pos++);
+				}
+			}
+		}
+
+		// the BIOS expects the data to be a multiple of four bytes
+		while ((out.size() - start) % 4 != 0)
+			out.push_back(0);
+	}
+};
+
+/*
+	Kosinski
+
+	Commands are selected by bits from a 16 bit little endian descriptor field, consumed from the least significant bit.
+	A new field is read as soon as the previous one is used up, even in the middle of a command.
+	- 1: literal byte
+	- 00NN: inline match of NN + 2 bytes; the following byte is the distance, as 0x100 - distance
+	- 01: full match; two bytes hold the distance, as 0x2000 - distance, and a 3 bit count; a count of 0 means the count
+		is in a third byte, where 0 ends the data and 1 is ignored
+*/
+class kosinski_decompressor : public lz_decompressor
+{
+private:
+	bool m_started {false};
+	uint16_t m_descriptor {0};
+	uint m_descriptor_bits {0};
+
+	bool load_descriptor()
+	{
+		byte_t low, high;
+		if (! read_byte(low) || ! read_byte(high))
+			return false;
+		m_descriptor = low | (high << 8);
+		m_descriptor_bits = 16;
+		return true;
+	}
+
+	bool pop_bit(bool & bit)
+	{
+		bit = (m_descriptor & 1) != 0;
+		m_descriptor >>= 1;
+		if (--m_descriptor_bits == 0)
+			return load_descriptor();
+		return true;
+	}
+
+protected:
+	bool decode_command(vector<byte_t> & out) override
+	{
+		auto const saved_pos {m_pos};
+		auto const saved_started {m_started};
+		auto const saved_descriptor {m_descriptor};
+		auto const saved_descriptor_bits {m_descriptor_bits};
+		auto rollback = [&]() {
+			m_pos = saved_pos;
+			m_started = saved_started;
+			m_descriptor = saved_descriptor;
+			m_descriptor_bits = saved_descriptor_bits;
+			return false;
+		};
+
+		if (! m_started)
+		{
+			if (! load_descriptor())
+				return rollback();
+			m_started = true;
+		}
+
+		bool bit;
+		if (! pop_bit(bit))
+			return rollback();
+		if (bit)
+		{
+			byte_t literal;
+			if (! read_byte(literal))
+				return rollback();
+			put(literal, out);
+			return true;
+		}
+
+		if (! pop_bit(bit))
+			return rollback();
+
+		size_t distance, count;
+		if (bit)
+		{
+			byte_t low, high;
+			if (! read_byte(low) || ! read_byte(high))
+				return rollback();
+			distance = 0x2000 - (((high & 0xf8) << 5) | low);
+			count = high & 7;
+			if (count != 0)
+			{
+				count += 2;
+			}
+			else
+			{
+				byte_t extended_count;
+				if (! read_byte(extended_count))
+					return rollback();
+				if (extended_count == 0)
+				{
+					m_finished = true;
+					return true;
+				}
+				if (extended_count == 1)
+					return true;
+				count = extended_count + 1;
+			}
+		}
+		else
+		{
+			bool count_high, count_low;
+			if (! pop_bit(count_high) || ! pop_bit(count_low))
+				return rollback();
+			count = ((count_high ? 2 : 0) | (count_low ? 1 : 0)) + 2;
+
+			byte_t distance_byte;
+			if (! read_byte(distance_byte))
+				return rollback();
+			distance = 0x100 - distance_byte;
+		}
+
+		copy_match(distance, count, out);
+		return true;
+	}
+
+public:
+	kosinski_decompressor() :
+			lz_decompressor(0x2000)
+	{
+	}
+};
+
+class kosinski_compressor : public collecting_compressor
+{
+private:
+	uint16_t m_descriptor {0};
+	uint m_descriptor_bits {0};
+	// bytes which follow the descriptor field currently being filled
+	vector<byte_t> m_pending;
+
+	void push_bit(bool const bit, vector<byte_t> & out)
+	{
+		m_descriptor |= (bit ? 1 : 0) << m_descriptor_bits;
+		if (++m_descriptor_bits == 16)
+		{
+			// the decompressor loads the next field as soon as this one is used up, so the data read up to this point
+			// follows this field, and anything after follows the next one
+			flush(out);
+		}
+	}
+
+	void flush(vector<byte_t> & out)
+	{
+		out.push_back(m_descriptor & 0xff);
+		out.push_back(m_descriptor >> 8);
+		out.insert(out.end(), m_pending.begin(), m_pending.end());
+		m_pending.clear();
+		m_descriptor = 0;
+		m_descriptor_bits = 0;
+	}
+
+protected:
+	void encode(vector<byte_t> & out) override
+	{
+		lz_match_finder finder(m_input);
+		size_t pos {0};
+		while (pos < m_input.size())
+		{
+			auto const match {finder.find(pos, 0x2000, 0x100, 1)};
+			if (match.length >= 2 && match.length <= 5 && match.distance <= 0x100)
+			{
+				push_bit(false, out);
+				push_bit(false, out);
+				push_bit(((match.length - 2) & 2) != 0, out);
+				push_bit(((match.length - 2) & 1) != 0, out);
+				m_pending.push_back(0x100 - match.distance);
+			}
+			else if (match.length >= 3)
+			{
+				push_bit(false, out);
+				push_bit(true, out);
+				auto const distance {0x2000 - match.distance};
+				m_pending.push_back(distance & 0xff);
+				if (match.length <= 9)
+				{
+					m_pending.push_back(((distance >> 5) & 0xf8) | (match.length - 2));
+				}
+				else
+				{
+					m_pending.push_back((distance >> 5) & 0xf8);
+					m_pending.push_back(match.length - 1);
+				}
+			}
+			else
+			{
+				push_bit(true, out);
+				m_pending.push_back(m_input[pos]);
+				finder.insert(pos++);
+				continue;
+			}
+
+			for (size_t i {0}; i < match.length; ++i)
+				finder.insert(pos++);
+		}
+
+		// end of data marker
+		push_bit(false, out);
+		push_bit(true, out);
+		m_pending.insert(m_pending.end(), {0x00, 0xf0, 0x00});
+		flush(out);
+	}
+};
+
+/*******************************************************
+ *                      NEMESIS
+ *******************************************************/
+
+/*
+	Nemesis, as used by many Sega Mega Drive games; it holds only 8x8 4bpp tiles
+
+	A 16 bit big endian header holds the number of tiles, with the top bit set for XOR mode. Then comes a table of
+	prefix codes, each standing for a run of 1 to 8 of one pixel value: a byte of 0x80 | value begins the entries for
+	that value, and each entry is a byte holding the run length - 1 in bits 4-6 and the code length (1 to 8) in the low
+	bits, followed by a byte holding the code. 0xff ends the table.
+
+	The pixels follow as a stream of codes, from the most significant bit. The code 111111 is reserved for runs which are
+	not in the table, and is followed by a 3 bit run length - 1 and a 4 bit value. Runs carry on from one tile row to the
+	next. In XOR mode, each 32 bit row is stored XORed with the row before.
+*/
+static uint constexpr NEMESIS_INLINE_CODE {0x3f}, NEMESIS_INLINE_LENGTH {6}, NEMESIS_INLINE_BITS {6 + 3 + 4};
+
+class nemesis_decompressor : public command_decompressor
+{
+private:
+	struct code_entry
+	{
+		uint length {0};
+		byte_t value {0};
+		uint count {0};
+	};
+
+	bool m_have_header {false};
+	bool m_have_table {false};
+	bool m_xor_mode {false};
+	size_t m_remaining_rows {0};
+	// indexed by the code moved to the top of the byte, so each code fills all the entries it is a prefix of
+	array<code_entry, 256> m_codes;
+
+	uint m_bits {0};
+	uint m_bit_count {0};
+
+	uint32_t m_row {0};
+	uint m_row_pixels {0};
+	uint32_t m_previous_row {0};
+
+	bool read_bit(uint & out)
+	{
+		if (m_bit_count == 0)
+		{
+			byte_t next;
+			if (! read_byte(next))
+				return false;
+			m_bits = next;
+			m_bit_count = 8;
+		}
+		out = (m_bits >> --m_bit_count) & 1;
+		return true;
+	}
+
+	bool read_table()
+	{
+		array<code_entry, 256> codes;
+		byte_t value {0}, entry;
+		if (! read_byte(entry))
+			return false;
+		while (entry != 0xff)
+		{
+			if ((entry & 0x80) != 0)
+			{
+				value = entry & 0xf;
+				if (! read_byte(entry))
+					return false;
+				continue;
+			}
+
+			byte_t code;
+			if (! read_byte(code))
+				return false;
+			uint const length {entry & 0xfu};
+			if (length == 0 || length > 8)
+				throw runtime_error("Invalid compressed data");
+			size_t const first {static_cast<size_t>(code & ((1 << length) - 1)) << (8 - length)};
+			fill_n(codes.begin() + first, 1 << (8 - length), code_entry {length, value, ((entry >> 4) & 7u) + 1});
+
+			if (! read_byte(entry))
+				return false;
+		}
+		m_codes = codes;
+		return true;
+	}
+
+	void put_pixels(byte_t const value, uint count, vector<byte_t> & out)
+	{
+		for (; count > 0 && m_remaining_rows > 0; --count)
+		{
+			m_row = (m_row << 4) | value;
+			if (++m_row_pixels < 8)
+				continue;
+
+			if (m_xor_mode)
+				m_row ^= m_previous_row;
+			out.insert(out.end(), {(byte_t) (m_row >> 24), (byte_t) (m_row >> 16), (byte_t) (m_row >> 8), (byte_t) m_row});
+			m_previous_row = m_row;
+			m_row = 0;
+			m_row_pixels = 0;
+			--m_remaining_rows;
+		}
+		m_finished = m_remaining_rows == 0;
+	}
+
+protected:
+	bool decode_command(vector<byte_t> & out) override
+	{
+		auto const saved_pos {m_pos};
+		auto const saved_bits {m_bits};
+		auto const saved_bit_count {m_bit_count};
+		auto rollback = [&]() {
+			m_pos = saved_pos;
+			m_bits = saved_bits;
+			m_bit_count = saved_bit_count;
+			return false;
+		};
+
+		if (! m_have_header)
+		{
+			byte_t high, low;
+			if (! read_byte(high) || ! read_byte(low))
+				return rollback();
+			m_xor_mode = (high & 0x80) != 0;
+			m_remaining_rows = (((high & 0x7f) << 8) | low) * 8;
+			m_have_header = true;
+			return true;
+		}
+
+		if (! m_have_table)
+		{
+			if (! read_table())
+				return rollback();
+			m_have_table = true;
+			m_finished = m_remaining_rows == 0;
+			return true;
+		}
+
+		uint code {0};
+		for (uint length {1}; length <= 8; ++length)
+		{
+			uint bit;
+			if (! read_bit(bit))
+				return rollback();
+			code = (code << 1) | bit;
+
+			if (length == NEMESIS_INLINE_LENGTH && code == NEMESIS_INLINE_CODE)
+			{
+				uint run {0};
+				for (uint i {0}; i < NEMESIS_INLINE_BITS - NEMESIS_INLINE_LENGTH; ++i)
+				{
+					if (! read_bit(bit))
+						return rollback();
+					run = (run << 1) | bit;
+				}
+				put_pixels(run & 0xf, (run >> 4) + 1, out);
+				return true;
+			}
+
+			auto const & entry {m_codes[code << (8 - length)]};
+			if (entry.length == length)
+			{
+				put_pixels(entry.value, entry.count, out);
+				return true;
+			}
+		}
+		throw runtime_error("Invalid compressed data");
+	}
+};
+
+/*
+	The data is compressed both with and without XOR mode, and the smaller result is kept. The runs given codes are
+	chosen by trying the most common runs in turn and keeping the set which gives the smallest output; the rest are
+	written inline.
+*/
+class nemesis_compressor : public collecting_compressor
+{
+private:
+	// a run is identified by its value and length as value * 8 + length - 1
+	static size_t constexpr RUN_KINDS {16 * 8};
+
+	static vector<uint> make_runs(vector<byte_t> const & data, bool const xor_mode)
+	{
+		vector<uint> runs;
+		uint32_t previous_row {0};
+		for (size_t i_row {0}; i_row < data.size(); i_row += 4)
+		{
+			uint32_t const row {
+				((uint32_t) data[i_row] << 24) | (data[i_row + 1] << 16) | (data[i_row + 2] << 8) | data[i_row + 3]};
+			uint32_t const stored {xor_mode ? row ^ previous_row : row};
+			previous_row = row;
+
+			for (int shift {28}; shift >= 0; shift -= 4)
+			{
+				uint const value {(stored >> shift) & 0xf};
+				if (! runs.empty() && (runs.back() >> 3) == value && (runs.back() & 7) < 7)
+					++runs.back();
+				else
+					runs.push_back(value << 3);
+			}
+		}
+		return runs;
+	}
+
+	/*
+		Huffman code lengths for the given runs, which are then limited to 8 bits and to leaving room for the inline code
+		by lengthening the codes of the least common runs
+	*/
+	static vector<uint> make_code_lengths(vector<size_t> const & counts)
+	{
+		size_t const symbols {counts.size()};
+		vector<uint> lengths(symbols, 1);
+		if (symbols > 1)
+		{
+			vector<size_t> parents(symbols * 2 - 1);
+			using node = pair<size_t, size_t>;
+			priority_queue<node, vector<node>, greater<>> queue;
+			for (size_t i {0}; i < symbols; ++i)
+				queue.push({counts[i], i});
+			for (size_t next {symbols}; queue.size() > 1; ++next)
+			{
+				auto const a {queue.top()};
+				queue.pop();
+				auto const b {queue.top()};
+				queue.pop();
+				parents[a.second] = parents[b.second] = next;
+				queue.push({a.first + b.first, next});
+			}
+			size_t const root {symbols * 2 - 2};
+			for (size_t i {0}; i < symbols; ++i)
+			{
+				uint length {0};
+				for (size_t node {i}; node != root; node = parents[node])
+					++length;
+				lengths[i] = min(length, 8u);
+			}
+		}
+
+		// the space of 8 bit codes, less the four taken by the inline code
+		size_t constexpr budget {256 - (1 << (8 - NEMESIS_INLINE_LENGTH))};
+		size_t used {0};
+		for (auto const length : lengths)
+			used += 1 << (8 - length);
+		// the counts are in descending order, so the last code which can be lengthened is the least common
+		for (size_t i {symbols}; used > budget && i > 0;)
+		{
+			if (lengths[i - 1] == 8)
+			{
+				--i;
+				continue;
+			}
+			used -= 1 << (7 - lengths[i - 1]);
+			++lengths[i - 1];
+		}
+		return lengths;
+	}
+
+	static void encode_runs(size_t const tiles, bool const xor_mode, vector<uint> const & runs, vector<byte_t> & out)
+	{
+		array<size_t, RUN_KINDS> counts {};
+		for (auto const run : runs)
+			++counts[run];
+
+		vector<uint> by_count;
+		for (uint kind {0}; kind < RUN_KINDS; ++kind)
+			if (counts[kind] > 0)
+				by_count.push_back(kind);
+		stable_sort(by_count.begin(), by_count.end(), [&](uint a, uint b) { return counts[a] > counts[b]; });
+
+		// find how many of the most common runs are best given codes
+		size_t best_coded {0}, best_bits {0};
+		vector<uint> best_lengths;
+		for (auto const kind : by_count)
+			best_bits += counts[kind] * NEMESIS_INLINE_BITS;
+		vector<size_t> coded_counts;
+		for (size_t coded {1}; coded <= by_count.size(); ++coded)
+		{
+			coded_counts.push_back(counts[by_count[coded - 1]]);
+			auto const lengths {make_code_lengths(coded_counts)};
+			// each code costs two bytes in the table
+			size_t bits {coded * 16};
+			for (size_t i {0}; i < by_count.size(); ++i)
+				bits += counts[by_count[i]] * (i < coded ? lengths[i] : NEMESIS_INLINE_BITS);
+			if (bits < best_bits)
+			{
+				best_bits = bits;
+				best_coded = coded;
+				best_lengths = lengths;
+			}
+		}
+
+		// canonical codes, in order of length; these fill the code space from the bottom, leaving the inline code free
+		vector<size_t> order(best_coded);
+		for (size_t i {0}; i < best_coded; ++i)
+			order[i] = i;
+		stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return best_lengths[a] < best_lengths[b]; });
+		array<uint, RUN_KINDS> codes {}, code_lengths {};
+		uint code {0}, length {0};
+		for (auto const i : order)
+		{
+			code <<= best_lengths[i] - length;
+			length = best_lengths[i];
+			codes[by_count[i]] = code++;
+			code_lengths[by_count[i]] = length;
+		}
+
+		out.push_back((xor_mode ? 0x80 : 0) | (tiles >> 8));
+		out.push_back(tiles & 0xff);
+		for (uint value {0}; value < 16; ++value)
+		{
+			bool started {false};
+			for (uint kind {value << 3}; kind < (value + 1) << 3; ++kind)
+			{
+				if (code_lengths[kind] == 0)
+					continue;
+				if (! started)
+				{
+					out.push_back(0x80 | value);
+					started = true;
+				}
+				out.push_back(((kind & 7) << 4) | code_lengths[kind]);
+				out.push_back(codes[kind]);
+			}
+		}
+		out.push_back(0xff);
+
+		uint bits {0}, bit_count {0};
+		auto push_bits = [&](uint const value, uint const count) {
+			for (uint i {count}; i > 0; --i)
+			{
+				bits = (bits << 1) | ((value >> (i - 1)) & 1);
+				if (++bit_count == 8)
+				{
+					out.push_back(bits);
+					bits = 0;
+					bit_count = 0;
+				}
+			}
+		};
+		for (auto const run : runs)
+		{
+			if (code_lengths[run] != 0)
+			{
+				push_bits(codes[run], code_lengths[run]);
+			}
+			else
+			{
+				push_bits(NEMESIS_INLINE_CODE, NEMESIS_INLINE_LENGTH);
+				push_bits(((run & 7) << 4) | (run >> 3), NEMESIS_INLINE_BITS - NEMESIS_INLINE_LENGTH);
+			}
+		}
+		if (bit_count > 0)
+			out.push_back(bits << (8 - bit_count));
+	}
+
+protected:
+	void encode(vector<byte_t> & out) override
+	{
+		if (m_input.size() % 32 != 0)
+			throw invalid_argument("Nemesis compressed data must be whole 8x8 4bpp tiles");
+		size_t const tiles {m_input.size() / 32};
+		if (tiles > 0x7fff)
+			throw invalid_argument("Data too large for Nemesis compression");
+
+		vector<byte_t> plain, xored;
+		encode_runs(tiles, false, make_runs(m_input, false), plain);
+		encode_runs(tiles, true, make_runs(m_input, true), xored);
+		auto const & smaller {xored.size() < plain.size() ? xored : plain};
+		out.insert(out.end(), smaller.begin(), smaller.end());
+	}
+};
+
+/*******************************************************
+ *                      FACTORIES
+ *******************************************************/
+
+unique_ptr<decompressor> make_decompressor(compression_format const format)
+{
+	switch (format)
+	{
+		case compression_format::gzip:
+			return make_unique<gzip_decompressor>();
+		case compression_format::lz77:
+			return make_unique<lz77_decompressor>();
+		case compression_format::kosinski:
+			return make_unique<kosinski_decompressor>();
+		case compression_format::nemesis:
+			return make_unique<nemesis_decompressor>();
+		default:
+			return nullptr;
+	}
+}
+
+unique_ptr<compressor> make_compressor(compression_format const format, int const level)
+{
+	switch (format)
+	{
+		case compression_format::gzip:
+			if (level < 0 || level > 9)
+				throw invalid_argument("Invalid compression level");
+			return make_unique<gzip_compressor>(level);
+		case compression_format::lz77:
+			return make_unique<lz77_compressor>();
+		case compression_format::kosinski:
+			return make_unique<kosinski_compressor>();
+		case compression_format::nemesis:
+			return make_unique<nemesis_compressor>();
+		default:
+			return nullptr;
+	}
+}
+
+} // namespace chrgfx
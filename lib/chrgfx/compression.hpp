@@ -0,0 +1,83 @@
+/**
+ * @file compression.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Streaming (de)compression of tile data
+ *
+ * Graphics are often stored compressed, either with a general purpose format or with one of the LZ variants used by
+ * console software. The decompressors here accept their input in pieces of any size, so data can be decompressed as
+ * it is read rather than staged through a temporary file.
+ *
+ * Other formats can be supported by deriving from decompressor and compressor.
+ */
+
+#ifndef __CHRGFX__COMPRESSION_HPP
+#define __CHRGFX__COMPRESSION_HPP
+
+#include "types.hpp"
+#include <memory>
+#include <vector>
+
+namespace chrgfx
+{
+
+enum class compression_format
+{
+	none,
+	// gzip or zlib; the type is detected when decompressing, and gzip is used when compressing
+	gzip,
+	// LZ77 as implemented by the Game Boy Advance and Nintendo DS BIOS (type 0x10)
+	lz77,
+	// Kosinski, as used by many Sega Mega Drive games
+	kosinski,
+	// Nemesis, as used by many Sega Mega Drive games; holds only 8x8 4bpp tiles
+	nemesis
+};
+
+class decompressor
+{
+public:
+	virtual ~decompressor() = default;
+
+	/**
+	 * @brief Decompress the next piece of input, appending the output
+	 * @return Number of input bytes used; this is less than in_size only if the end of the compressed data was reached
+	 */
+	virtual size_t decompress(byte_t const * in, size_t const in_size, std::vector<byte_t> & out) = 0;
+
+	/**
+	 * @brief Whether the end of the compressed data has been reached
+	 */
+	[[nodiscard]] virtual bool finished() const = 0;
+};
+
+class compressor
+{
+public:
+	virtual ~compressor() = default;
+
+	/**
+	 * @brief Compress the next piece of input, appending any output produced so far
+	 */
+	virtual void compress(byte_t const * in, size_t const in_size, std::vector<byte_t> & out) = 0;
+
+	/**
+	 * @brief Complete the compressed data after all input has been given
+	 */
+	virtual void finish(std::vector<byte_t> & out) = 0;
+};
+
+/**
+ * @return A decompressor for the given format, or nullptr for none
+ */
+std::unique_ptr<decompressor> make_decompressor(compression_format const format);
+
+/**
+ * @param level Compression level, 0 to 9; only used by gzip
+ * @return A compressor for the given format, or nullptr for none
+ */
+std::unique_ptr<compressor> make_compressor(compression_format const format, int const level = 6);
+
+} // namespace chrgfx
+
+#endif
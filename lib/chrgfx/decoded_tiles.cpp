@@ -0,0 +1,42 @@
+#include "decoded_tiles.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+decoded_tiles::decoded_tiles(tileset_view const & view, size_t const chunk_tiles) :
+		m_view {view},
+		m_chunk_tiles {min(chunk_tiles, max(view.size(), size_t {1}))},
+		m_tile_pixels {view.chrdef().width() * view.chrdef().height()}
+{
+	if (chunk_tiles == 0)
+		throw invalid_argument("Chunk size cannot be zero tiles");
+
+	m_chunk.resize(m_chunk_tiles * m_tile_pixels);
+}
+
+void decoded_tiles::load(size_t const index)
+{
+	if (index >= m_view.size())
+		throw out_of_range("Tile index beyond end of tileset");
+
+	if (m_chunk_first != tileset_view::npos && index >= m_chunk_first && index - m_chunk_first < m_chunk_count)
+		return;
+
+	m_chunk_first = index - (index % m_chunk_tiles);
+	m_chunk_count = min(m_chunk_tiles, m_view.size() - m_chunk_first);
+	m_view.decode(m_chunk_first, m_chunk_count, m_chunk.data());
+}
+
+const_image_view decoded_tiles::tile(size_t const index)
+{
+	load(index);
+	return const_image_view(m_chunk.data() + ((index - m_chunk_first) * m_tile_pixels),
+		m_view.chrdef().width(),
+		m_view.chrdef().height());
+}
+
+} // namespace chrgfx
@@ -0,0 +1,165 @@
+/**
+ * @file decoded_tiles.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Lazily decoded tiles from a tileset_view, for streaming over encoded data
+ */
+
+#ifndef __CHRGFX__DECODED_TILES_HPP
+#define __CHRGFX__DECODED_TILES_HPP
+
+#include "image_types.hpp"
+#include "tileset_view.hpp"
+#include "types.hpp"
+#include <iterator>
+#include <vector>
+
+namespace chrgfx
+{
+
+/**
+ * @brief Range over the tiles of a tileset_view, decoded as they are reached
+ * @details Tiles are decoded a chunk at a time into a single buffer which is allocated with the range and reused for
+ * every chunk, so any amount of data can be processed with the same, small amount of memory. Decoding goes through the
+ * view, and so uses the view's table driven decoder if it has one.
+ *
+ * Iteration is single pass: each tile is a view into the chunk buffer, and is only valid until an iterator over the
+ * same range moves into another chunk. Copy the pixels of any tile which needs to be kept. A range is not thread safe;
+ * give each thread its own range, over a subview if the work is to be split.
+ */
+class decoded_tiles
+{
+private:
+	tileset_view m_view;
+	size_t m_chunk_tiles;
+	size_t m_tile_pixels;
+	std::vector<pixel> m_chunk;
+	size_t m_chunk_first {tileset_view::npos};
+	size_t m_chunk_count {0};
+
+	/**
+	 * @brief Decode the chunk holding the given tile, unless it is already loaded
+	 */
+	void load(size_t const index);
+
+public:
+	static size_t constexpr DEFAULT_CHUNK_TILES {256};
+
+	class iterator
+	{
+	public:
+		using self_type = iterator;
+		using iterator_category = std::input_iterator_tag;
+		using value_type = const_image_view;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = const_image_view;
+
+	private:
+		decoded_tiles * m_range;
+		size_t m_index;
+
+	public:
+		iterator(decoded_tiles & range, size_t const index) :
+				m_range {&range},
+				m_index {index}
+		{
+		}
+
+		/**
+		 * @brief Index of the current tile within the view
+		 */
+		[[nodiscard]] size_t index() const
+		{
+			return m_index;
+		}
+
+		reference operator*() const
+		{
+			return m_range->tile(m_index);
+		}
+
+		self_type & operator++()
+		{
+			++m_index;
+			return *this;
+		}
+
+		self_type operator++(int)
+		{
+			self_type tmp = *this;
+			++*this;
+			return tmp;
+		}
+
+		bool operator==(self_type const & other) const
+		{
+			return m_index == other.m_index && m_range == other.m_range;
+		}
+
+		bool operator!=(self_type const & other) const
+		{
+			return ! (*this == other);
+		}
+	};
+
+	/**
+	 * @param view Tiles to decode; the data (and the decoder, if any) must outlive the range
+	 * @param chunk_tiles Number of tiles decoded at a time
+	 */
+	explicit decoded_tiles(tileset_view const & view, size_t const chunk_tiles = DEFAULT_CHUNK_TILES);
+
+	decoded_tiles(decoded_tiles const &) = delete;
+	decoded_tiles & operator=(decoded_tiles const &) = delete;
+
+	[[nodiscard]] tileset_view const & view() const
+	{
+		return m_view;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return m_view.size();
+	}
+
+	[[nodiscard]] size_t chunk_tiles() const
+	{
+		return m_chunk_tiles;
+	}
+
+	[[nodiscard]] iterator begin()
+	{
+		return iterator(*this, 0);
+	}
+
+	[[nodiscard]] iterator end()
+	{
+		return iterator(*this, m_view.size());
+	}
+
+	/**
+	 * @brief A single decoded tile, decoding its chunk if needed
+	 * @details The returned view is only valid until another chunk is loaded.
+	 */
+	[[nodiscard]] const_image_view tile(size_t const index);
+
+	/**
+	 * @brief Call a function with each chunk of decoded tiles in turn
+	 * @details The function is called as func(first, count, pixels), where pixels is a basic tileset of count tiles
+	 * starting at tile index first. This suits work done over many tiles at once, such as the tileset functions in
+	 * imaging and scan.
+	 */
+	template <typename FuncT>
+	void for_each_chunk(FuncT && func)
+	{
+		for (size_t first {0}; first < m_view.size(); first += m_chunk_tiles)
+		{
+			load(first);
+			func(m_chunk_first, m_chunk_count, static_cast<pixel const *>(m_chunk.data()));
+		}
+	}
+};
+
+} // namespace chrgfx
+
+#endif
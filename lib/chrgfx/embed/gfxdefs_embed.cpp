@@ -0,0 +1,326 @@
+/**
+ * @file gfxdefs_embed.cpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2022 Motoi Productions / Released under MIT License
+ * @brief Build time tool to convert a gfxdefs file into constexpr tables for libchrgfx
+ * @details Each definition is parsed and validated with the same builders used by the support utilities, then
+ * written out as records (see embedded_defs.hpp) along with a perfect hash slot table for each gfxdef type.
+ *
+ * Usage: gfxdefs_embed <input gfxdefs file> <output .inc file>
+ */
+
+#include "cfgload.hpp"
+#include "embedded_defs.hpp"
+#include "gfxdef_builder.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace chrgfx;
+using namespace motoi;
+
+using chrgfx::gfxdefs::embedded::hash_id;
+using chrgfx::gfxdefs::embedded::NO_SLOT;
+
+struct profile_entry
+{
+	string id;
+	string desc;
+	string chrdef_id;
+	string paldef_id;
+	string coldef_id;
+};
+
+string quoted(string_view const str)
+{
+	ostringstream oss;
+	oss << '"';
+	for (char const c : str)
+	{
+		if (c == '"' || c == '\\')
+			oss << '\\';
+		oss << c;
+	}
+	oss << '"';
+	return oss.str();
+}
+
+template <typename ValueT>
+void write_list(ostream & out, vector<ValueT> const & values, size_t const count)
+{
+	out << '{';
+	for (size_t i {0}; i < count; ++i)
+	{
+		if (i > 0)
+			out << ", ";
+		out << values[i];
+	}
+	out << '}';
+}
+
+/**
+ * @brief Search for a seed that gives every ID its own slot and write the resulting table
+ */
+void write_table(ostream & out, string const & name, vector<string_view> const & ids)
+{
+	size_t slot_count {1};
+	while (slot_count < ids.size() * 2)
+		slot_count <<= 1;
+
+	vector<int16> slots;
+	uint32 seed {0};
+	for (;; ++seed)
+	{
+		slots.assign(slot_count, NO_SLOT);
+		bool collision {false};
+		for (size_t i {0}; i < ids.size(); ++i)
+		{
+			auto & slot {slots[hash_id(ids[i], seed) & (slot_count - 1)]};
+			if (slot != NO_SLOT)
+			{
+				collision = true;
+				break;
+			}
+			slot = static_cast<int16>(i);
+		}
+		if (! collision)
+			break;
+	}
+
+	out << "constexpr hash_table<" << slot_count << "> " << name << "_table {" << seed << "u, {";
+	for (size_t i {0}; i < slot_count; ++i)
+	{
+		if (i > 0)
+			out << ", ";
+		out << slots[i];
+	}
+	out << "}};\n";
+
+	// have the compiler verify the table resolves every ID to its own record
+	for (size_t i {0}; i < ids.size(); ++i)
+		out << "static_assert(find_index(" << name << "_records, " << name << "_table, " << quoted(ids[i]) << ") == " << i
+				<< ");\n";
+	out << '\n';
+}
+
+template <typename DefT>
+vector<string_view> ids_of(vector<unique_ptr<DefT>> const & defs)
+{
+	vector<string_view> ids;
+	for (auto const & def : defs)
+		ids.emplace_back(def->id());
+	return ids;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc != 3)
+	{
+		cerr << "Usage: " << argv[0] << " <input gfxdefs file> <output file>\n";
+		return -1;
+	}
+
+	try
+	{
+		config_loader config(argv[1]);
+
+		vector<unique_ptr<chrdef>> chrdefs;
+		vector<unique_ptr<paldef>> paldefs;
+		vector<unique_ptr<rgbcoldef>> rgbcoldefs;
+		vector<unique_ptr<refcoldef>> refcoldefs;
+		vector<profile_entry> profiles;
+		map<string, ptrdiff_t> subtile_indices;
+
+		// gfxdef_manager uses the first block matching an ID, so later duplicates are dropped
+		set<pair<string, string>> seen;
+		for (auto const & block : config)
+		{
+			auto const id {block.second.find("id")};
+			if (id == block.second.end())
+				continue;
+			if (! seen.emplace(block.first, id->second).second)
+			{
+				cerr << "Warning: skipping duplicate " << block.first << " " << id->second << '\n';
+				continue;
+			}
+
+			if (block.first == "chrdef")
+			{
+				// a sub-tile chrdef must come earlier in the file, so that records can be built in order
+				chrdef_builder builder(block.second);
+				if (! builder.subtile().empty())
+				{
+					auto const subtile {find_if(chrdefs.begin(), chrdefs.end(), [&](auto const & def) {
+						return def->id() == builder.subtile();
+					})};
+					if (subtile == chrdefs.end())
+						throw runtime_error("Sub-tile chrdef " + builder.subtile() + " must be defined before " + id->second);
+					builder.set_subtile_def(**subtile);
+					subtile_indices.emplace(id->second, subtile - chrdefs.begin());
+				}
+				chrdefs.emplace_back(builder.build());
+			}
+			else if (block.first == "paldef")
+				paldefs.emplace_back(paldef_builder(block.second).build());
+			else if (block.first == "rgbcoldef")
+				rgbcoldefs.emplace_back(rgbcoldef_builder(block.second).build());
+			else if (block.first == "refcoldef")
+				refcoldefs.emplace_back(refcoldef_builder(block.second).build());
+			else if (block.first == "profile")
+			{
+				profile_entry profile;
+				for (auto const & entry : block.second)
+				{
+					if (entry.first == "id")
+						profile.id = entry.second;
+					else if (entry.first == "desc")
+						profile.desc = entry.second;
+					else if (entry.first == "chrdef")
+						profile.chrdef_id = entry.second;
+					else if (entry.first == "paldef")
+						profile.paldef_id = entry.second;
+					else if (entry.first == "coldef")
+						profile.coldef_id = entry.second;
+				}
+				profiles.push_back(profile);
+			}
+		}
+
+		ofstream out {argv[2]};
+		if (! out.good())
+			throw runtime_error("Could not open output file " + string(argv[2]));
+		out << "// Generated from " << argv[1] << " by gfxdefs_embed; do not edit\n\n";
+		out << "// clang-format off\n";
+		out << "namespace chrgfx::gfxdefs::embedded\n{\n\n";
+
+		// chrdefs
+		for (size_t i {0}; i < chrdefs.size(); ++i)
+		{
+			auto const & def {*chrdefs[i]};
+			out << "// " << def.id() << '\n';
+			// the offsets of tiles made of sub-tiles are worked out again when they are constructed
+			if (def.subtile() != nullptr)
+			{
+				out << "constexpr uint chrdef_" << i << "_subtile_offsets[] ";
+				write_list(out, def.subtile_offsets(), def.subtile_offsets().size());
+				out << ";\n";
+				continue;
+			}
+			out << "constexpr uint chrdef_" << i << "_pixel_offsets[] ";
+			write_list(out, def.pixel_offsets(), def.width());
+			out << ";\nconstexpr uint chrdef_" << i << "_row_offsets[] ";
+			write_list(out, def.row_offsets(), def.height());
+			out << ";\nconstexpr uint chrdef_" << i << "_plane_offsets[] ";
+			write_list(out, def.plane_offsets(), def.bpp());
+			out << ";\n";
+		}
+		out << "\nconstexpr std::array<chrdef_record, " << chrdefs.size() << "> chrdef_records {{\n";
+		for (size_t i {0}; i < chrdefs.size(); ++i)
+		{
+			auto const & def {*chrdefs[i]};
+			out << "\t{" << quoted(def.id()) << ", " << quoted(def.desc()) << ", " << def.width() << ", " << def.height()
+					<< ", " << def.bpp() << ", ";
+			if (def.subtile() != nullptr)
+				out << "nullptr, nullptr, nullptr, " << subtile_indices.at(def.id()) << ", " << def.subtile_columns() << ", "
+						<< def.subtile_rows() << ", chrdef_" << i << "_subtile_offsets},\n";
+			else
+				out << "chrdef_" << i << "_pixel_offsets, chrdef_" << i << "_row_offsets, chrdef_" << i
+						<< "_plane_offsets, -1, 0, 0, nullptr},\n";
+		}
+		out << "}};\n";
+		write_table(out, "chrdef", ids_of(chrdefs));
+
+		// paldefs
+		out << "constexpr std::array<paldef_record, " << paldefs.size() << "> paldef_records {{\n";
+		for (auto const & def : paldefs)
+		{
+			out << "\t{" << quoted(def->id()) << ", " << quoted(def->desc()) << ", " << def->entry_datasize() << ", "
+					<< def->length() << ", " << def->datasize() << "},\n";
+		}
+		out << "}};\n";
+		write_table(out, "paldef", ids_of(paldefs));
+
+		// rgbcoldefs
+		for (size_t i {0}; i < rgbcoldefs.size(); ++i)
+		{
+			auto const & def {*rgbcoldefs[i]};
+			out << "// " << def.id() << '\n';
+			out << "constexpr rgb_layout_record rgbcoldef_" << i << "_layout[] {";
+			for (auto const & layout : def.layout())
+			{
+				out << "{" << layout.red_offset() << ", " << layout.red_size() << ", " << layout.green_offset() << ", "
+						<< layout.green_size() << ", " << layout.blue_offset() << ", " << layout.blue_size() << "}, ";
+			}
+			out << "};\n";
+		}
+		out << "\nconstexpr std::array<rgbcoldef_record, " << rgbcoldefs.size() << "> rgbcoldef_records {{\n";
+		for (size_t i {0}; i < rgbcoldefs.size(); ++i)
+		{
+			auto const & def {*rgbcoldefs[i]};
+			out << "\t{" << quoted(def.id()) << ", " << quoted(def.desc()) << ", " << def.bitdepth() << ", rgbcoldef_" << i
+					<< "_layout, " << def.layout().size() << ", " << (def.big_endian() ? "true" : "false") << "},\n";
+		}
+		out << "}};\n";
+		write_table(out, "rgbcoldef", ids_of(rgbcoldefs));
+
+		// refcoldefs
+		// unlisted reference palette entries are black, so trailing black entries are not stored
+		vector<size_t> refpal_counts;
+		for (size_t i {0}; i < refcoldefs.size(); ++i)
+		{
+			auto const & refpal {refcoldefs[i]->refpal()};
+			size_t count {refpal.size()};
+			while (count > 1 && refpal[count - 1].red == 0 && refpal[count - 1].green == 0 && refpal[count - 1].blue == 0)
+				--count;
+			refpal_counts.push_back(count);
+
+			out << "// " << refcoldefs[i]->id() << '\n';
+			out << "constexpr uint8 refcoldef_" << i << "_refpal[][3] {";
+			for (size_t c {0}; c < count; ++c)
+			{
+				out << "{" << (uint) refpal[c].red << ", " << (uint) refpal[c].green << ", " << (uint) refpal[c].blue << "}, ";
+			}
+			out << "};\n";
+		}
+		out << "\nconstexpr std::array<refcoldef_record, " << refcoldefs.size() << "> refcoldef_records {{\n";
+		for (size_t i {0}; i < refcoldefs.size(); ++i)
+		{
+			auto const & def {*refcoldefs[i]};
+			out << "\t{" << quoted(def.id()) << ", " << quoted(def.desc()) << ", refcoldef_" << i << "_refpal, "
+					<< refpal_counts[i] << ", " << (def.big_endian() ? "true" : "false") << "},\n";
+		}
+		out << "}};\n";
+		write_table(out, "refcoldef", ids_of(refcoldefs));
+
+		// profiles
+		vector<string_view> profile_ids;
+		out << "constexpr std::array<profile, " << profiles.size() << "> profile_records {{\n";
+		for (auto const & profile : profiles)
+		{
+			out << "\t{" << quoted(profile.id) << ", " << quoted(profile.desc) << ", " << quoted(profile.chrdef_id) << ", "
+					<< quoted(profile.paldef_id) << ", " << quoted(profile.coldef_id) << "},\n";
+			profile_ids.emplace_back(profile.id);
+		}
+		out << "}};\n";
+		write_table(out, "profile", profile_ids);
+
+		out << "} // namespace chrgfx::gfxdefs::embedded\n";
+		out << "// clang-format on\n";
+
+		if (! out.good())
+			throw runtime_error("Failed writing output file");
+
+		return 0;
+	}
+	catch (exception const & e)
+	{
+		cerr << "Error: " << e.what() << '\n';
+		return -1;
+	}
+}
@@ -0,0 +1,154 @@
+#include "builtin_defs.hpp"
+#include "embedded_defs.hpp"
+#include <vector>
+
+// generated at build time from share/gfxdefs by gfxdefs_embed
+#include "gfxdefs_embedded.inc"
+
+namespace chrgfx::gfxdefs
+{
+
+using namespace std;
+using namespace embedded;
+
+/*
+	The gfxdef objects are constructed from the records on first use rather than at static initialization, so that
+	programs which never look up an embedded def do not pay for building them.
+*/
+
+static vector<chrdef> make_chrdefs()
+{
+	vector<chrdef> defs;
+	defs.reserve(chrdef_records.size());
+	for (auto const & rec : chrdef_records)
+	{
+		if (rec.subtile >= 0)
+		{
+			defs.emplace_back(string(rec.id),
+				defs[rec.subtile],
+				rec.subtile_columns,
+				rec.subtile_rows,
+				vector<uint>(rec.subtile_offsets, rec.subtile_offsets + (rec.subtile_columns * rec.subtile_rows)),
+				string(rec.desc));
+			continue;
+		}
+		defs.emplace_back(string(rec.id),
+			rec.width,
+			rec.height,
+			rec.bpp,
+			vector<uint>(rec.pixel_offsets, rec.pixel_offsets + rec.width),
+			vector<uint>(rec.row_offsets, rec.row_offsets + rec.height),
+			vector<uint>(rec.plane_offsets, rec.plane_offsets + rec.bpp),
+			string(rec.desc));
+	}
+	return defs;
+}
+
+static vector<paldef> make_paldefs()
+{
+	vector<paldef> defs;
+	defs.reserve(paldef_records.size());
+	for (auto const & rec : paldef_records)
+		defs.emplace_back(string(rec.id), rec.entry_datasize, rec.length, rec.datasize, string(rec.desc));
+	return defs;
+}
+
+static vector<rgbcoldef> make_rgbcoldefs()
+{
+	vector<rgbcoldef> defs;
+	defs.reserve(rgbcoldef_records.size());
+	for (auto const & rec : rgbcoldef_records)
+	{
+		vector<rgb_layout> layout;
+		for (auto ptr_layout {rec.layout}; ptr_layout != rec.layout + rec.layout_count; ++ptr_layout)
+		{
+			layout.emplace_back(make_pair(ptr_layout->red_offset, ptr_layout->red_size),
+				make_pair(ptr_layout->green_offset, ptr_layout->green_size),
+				make_pair(ptr_layout->blue_offset, ptr_layout->blue_size));
+		}
+		defs.emplace_back(string(rec.id), rec.bitdepth, layout, rec.big_endian, string(rec.desc));
+	}
+	return defs;
+}
+
+static vector<refcoldef> make_refcoldefs()
+{
+	vector<refcoldef> defs;
+	defs.reserve(refcoldef_records.size());
+	for (auto const & rec : refcoldef_records)
+	{
+		palette refpal;
+		for (size_t i {0}; i < rec.refpal_count; ++i)
+			refpal[i] = rgb_color(rec.refpal[i][0], rec.refpal[i][1], rec.refpal[i][2]);
+		defs.emplace_back(string(rec.id), refpal, rec.big_endian, string(rec.desc));
+	}
+	return defs;
+}
+
+profile const * find_profile(string_view const id)
+{
+	auto const index {find_index(profile_records, profile_table, id)};
+	return index < 0 ? nullptr : &profile_records[index];
+}
+
+chrdef const * find_chrdef(string_view const id)
+{
+	auto const builtin {chrdefs.find(string(id))};
+	if (builtin != chrdefs.end())
+		return &builtin->second;
+
+	auto const index {find_index(chrdef_records, chrdef_table, id)};
+	if (index < 0)
+		return nullptr;
+	static vector<chrdef> const defs {make_chrdefs()};
+	return &defs[index];
+}
+
+vector<string_view> chrdef_ids()
+{
+	vector<string_view> ids;
+	ids.reserve(chrdefs.size() + chrdef_records.size());
+	for (auto const & builtin : chrdefs)
+		ids.emplace_back(builtin.first);
+	for (auto const & rec : chrdef_records)
+		ids.push_back(rec.id);
+	return ids;
+}
+
+paldef const * find_paldef(string_view const id)
+{
+	auto const builtin {paldefs.find(string(id))};
+	if (builtin != paldefs.end())
+		return &builtin->second;
+
+	auto const index {find_index(paldef_records, paldef_table, id)};
+	if (index < 0)
+		return nullptr;
+	static vector<paldef> const defs {make_paldefs()};
+	return &defs[index];
+}
+
+coldef const * find_coldef(string_view const id)
+{
+	auto const builtin {rgbcoldefs.find(string(id))};
+	if (builtin != rgbcoldefs.end())
+		return &builtin->second;
+
+	auto index {find_index(rgbcoldef_records, rgbcoldef_table, id)};
+	if (index >= 0)
+	{
+		static vector<rgbcoldef> const defs {make_rgbcoldefs()};
+		return &defs[index];
+	}
+
+	index = find_index(refcoldef_records, refcoldef_table, id);
+	if (index >= 0)
+	{
+		static vector<refcoldef> const defs {make_refcoldefs()};
+		return &defs[index];
+	}
+
+	return nullptr;
+}
+
+} // namespace chrgfx::gfxdefs
@@ -0,0 +1,126 @@
+/**
+ * @file embedded_defs.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2022 Motoi Productions / Released under MIT License
+ * @brief Record layout and lookup for the gfxdefs file embedded into the library at build time
+ * @details The gfxdefs_embed tool reads share/gfxdefs during the build and writes constexpr tables of the records
+ * below, along with a perfect hash slot table for each gfxdef type. The same hash function is used by the tool and by
+ * the lookup here, so an ID is resolved with one hash and one string comparison.
+ */
+
+#ifndef __CHRGFX__EMBEDDED_DEFS_HPP
+#define __CHRGFX__EMBEDDED_DEFS_HPP
+
+#include "types.hpp"
+#include <array>
+#include <string_view>
+
+namespace chrgfx::gfxdefs::embedded
+{
+
+/**
+ * @brief FNV-1a, with the seed folded into the offset basis
+ */
+constexpr uint32 hash_id(std::string_view const id, uint32 const seed)
+{
+	uint32 hash {2166136261u ^ seed};
+	for (char const c : id)
+	{
+		hash ^= static_cast<uint8>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * @brief Marks an empty slot in a perfect hash table
+ */
+int16 constexpr NO_SLOT {-1};
+
+template <size_t SlotCount>
+struct hash_table
+{
+	static_assert((SlotCount & (SlotCount - 1)) == 0, "slot count must be a power of two");
+
+	uint32 seed;
+	std::array<int16, SlotCount> slots;
+};
+
+/**
+ * @return index of the record with the given ID, or -1 if not present
+ */
+template <typename RecordT, size_t RecordCount, size_t SlotCount>
+constexpr int find_index(
+	std::array<RecordT, RecordCount> const & records, hash_table<SlotCount> const & table, std::string_view const id)
+{
+	if constexpr (RecordCount == 0)
+	{
+		return -1;
+	}
+	else
+	{
+		auto const slot {table.slots[hash_id(id, table.seed) & (SlotCount - 1)]};
+		if (slot == NO_SLOT || records[slot].id != id)
+			return -1;
+		return slot;
+	}
+}
+
+struct chrdef_record
+{
+	std::string_view id;
+	std::string_view desc;
+	uint width;
+	uint height;
+	uint bpp;
+	uint const * pixel_offsets;
+	uint const * row_offsets;
+	uint const * plane_offsets;
+	// for tiles made of sub-tiles, the index of the sub-tile record, which is always an earlier one; otherwise -1
+	int subtile;
+	uint subtile_columns;
+	uint subtile_rows;
+	uint const * subtile_offsets;
+};
+
+struct paldef_record
+{
+	std::string_view id;
+	std::string_view desc;
+	uint entry_datasize;
+	uint length;
+	uint datasize;
+};
+
+struct rgb_layout_record
+{
+	short red_offset;
+	uint red_size;
+	short green_offset;
+	uint green_size;
+	short blue_offset;
+	uint blue_size;
+};
+
+struct rgbcoldef_record
+{
+	std::string_view id;
+	std::string_view desc;
+	uint bitdepth;
+	rgb_layout_record const * layout;
+	size_t layout_count;
+	bool big_endian;
+};
+
+struct refcoldef_record
+{
+	std::string_view id;
+	std::string_view desc;
+	uint8 const (*refpal)[3];
+	size_t refpal_count;
+	bool big_endian;
+};
+
+} // namespace chrgfx::gfxdefs::embedded
+
+#endif
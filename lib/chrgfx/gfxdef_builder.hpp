@@ -0,0 +1,455 @@
+/**
+ * @file gfxdef_builder.hpp
+ * @author Motoi Productions (Damian Rogers damian@motoi.pro)
+ * @brief Creates a gfxdef on the fly
+ */
+
+#ifndef __CHRGFX__GFXDEF_BUILDER_HPP
+#define __CHRGFX__GFXDEF_BUILDER_HPP
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cfgload.hpp"
+#include "chrdef.hpp"
+#include "coldef.hpp"
+#include "image_types.hpp"
+#include "paldef.hpp"
+#include "strutil.hpp"
+
+#define SET_FIELD(_field) \
+	if (entry.first == #_field) \
+	{ \
+		set_##_field(entry.second); \
+		continue; \
+	}
+
+namespace chrgfx
+{
+
+/*
+we may add builders for paldef/coldef sometime in the future, so we have an abstract class
+
+however, coldefs in particular are a bit more complicated than chrdefs when it comes to command line definitions
+
+for example, for rgbcoldefs, if we override an existing loaded def (e.g. from a profile) with a color passes value that
+does not match the overridden def, we have a problem
+
+moreover, trying to specify a refcoldef on the command line sounds like a nightmare
+
+all that aside, I can't think of a use case where col/pal defs would need to be modified "on the fly" like chrdefs may
+need to be (e.g. large "tiles" with non-uniform sizes)
+*/
+
+class gfxdef_builder
+{
+protected:
+	std::string m_id;
+	std::string m_desc;
+	gfxdef_builder() {}
+
+public:
+	void set_id(std::string const & id)
+	{
+		if (id.empty())
+			throw std::runtime_error("gfxdef id cannot be empty");
+		m_id = id;
+	}
+
+	void set_desc(std::string const & comment)
+	{
+		m_desc = comment;
+	}
+};
+
+class rgbcoldef_builder : public gfxdef_builder
+{
+private:
+	uint m_bitdepth {0};
+	std::vector<rgb_layout> m_layout;
+	bool m_big_endian {false};
+
+public:
+	rgbcoldef_builder() = default;
+	rgbcoldef_builder(rgbcoldef const & coldef)
+	{
+		from_def(coldef);
+	}
+
+	rgbcoldef_builder(motoi::block_map const & map)
+	{
+		from_map(map);
+	}
+
+	void from_def(rgbcoldef const & coldef)
+	{
+		set_id(coldef.id());
+		set_desc(coldef.desc());
+		m_bitdepth = coldef.bitdepth();
+		m_layout = coldef.layout();
+	}
+
+	void from_map(motoi::block_map const & map)
+	{
+		for (auto const & entry : map)
+		{
+			SET_FIELD(id);
+			SET_FIELD(desc);
+			SET_FIELD(bitdepth);
+			SET_FIELD(layout);
+			SET_FIELD(big_endian);
+		}
+	}
+
+	void set_bitdepth(std::string const & bitdepth)
+	{
+		m_bitdepth = motoi::sto<uint>(motoi::trim_view(bitdepth));
+	}
+
+	void clear_layout()
+	{
+		m_layout.clear();
+	}
+
+	void set_layout(std::string const & layout)
+	{
+		auto layout_raw = motoi::sto_container<std::vector<uint>>(layout);
+		if (layout_raw.size() != 6)
+			throw std::runtime_error("invalid rgb layout for coldef, must have exactly 6 entries");
+		rgb_layout rgblayout {
+			{layout_raw[0], layout_raw[1]}, {layout_raw[2], layout_raw[3]}, {layout_raw[4], layout_raw[5]}};
+		m_layout.emplace_back(rgblayout);
+	}
+
+	void set_big_endian(std::string const & big_endian)
+	{
+		m_big_endian = motoi::sto_bool(big_endian);
+	}
+
+	[[nodiscard]] rgbcoldef * build() const
+	{
+		// check the validity of the definition
+		if (m_bitdepth == 0)
+			throw std::runtime_error("Bitdepth must be greater than zero");
+		if (m_layout.size() == 0)
+			throw std::runtime_error("rgb_layout list cannot be empty");
+		for (auto const & layout : m_layout)
+		{
+			if (layout.red_size() > 8 || layout.green_size() > 8 || layout.blue_size() > 8)
+				throw std::runtime_error(
+					"datasize in a bit layout cannot be greater than 8 (maximum of 8 bits per color channel)");
+			if (layout.red_offset() > 32 || layout.green_offset() > 32 || layout.blue_offset() > 32)
+				throw std::runtime_error("color channel bit offsets cannot be greater than 32");
+		}
+		return new rgbcoldef {m_id, m_bitdepth, m_layout, m_big_endian, m_desc};
+	}
+};
+
+class refcoldef_builder : public gfxdef_builder
+{
+private:
+	palette m_refpal;
+	bool m_big_endian {false};
+
+public:
+	refcoldef_builder() = default;
+
+	refcoldef_builder(refcoldef const & coldef)
+	{
+		from_def(coldef);
+	}
+
+	refcoldef_builder(motoi::block_map const & map)
+	{
+		from_map(map);
+	}
+
+	void from_def(refcoldef const & coldef)
+	{
+		set_id(coldef.id());
+		set_desc(coldef.desc());
+		m_refpal = coldef.refpal();
+	}
+
+	void from_map(motoi::block_map const & map)
+	{
+		for (auto const & entry : map)
+		{
+			SET_FIELD(id);
+			SET_FIELD(desc);
+			SET_FIELD(big_endian);
+			SET_FIELD(refpal);
+		}
+	}
+
+	void set_refpal(std::string const & refpal)
+	{
+		m_refpal = motoi::split_array<rgb_color, 256>(refpal);
+	}
+
+	void set_big_endian(std::string const & big_endian)
+	{
+		m_big_endian = motoi::sto_bool(motoi::trim_view(big_endian));
+	}
+
+	[[nodiscard]] refcoldef * build() const
+	{
+		return new refcoldef {m_id, m_refpal, m_big_endian, m_desc};
+	}
+};
+
+class paldef_builder : public gfxdef_builder
+{
+private:
+	uint m_entry_datasize {0};
+	uint m_length {0};
+	std::optional<uint> m_datasize {std::nullopt};
+
+public:
+	paldef_builder() = default;
+	paldef_builder(paldef const & paldef)
+	{
+		from_def(paldef);
+	}
+
+	paldef_builder(motoi::block_map const & map)
+	{
+		from_map(map);
+	}
+
+	void from_def(paldef const & paldef)
+	{
+		set_id(paldef.id());
+		set_desc(paldef.desc());
+		m_entry_datasize = paldef.entry_datasize();
+		m_length = paldef.length();
+		m_datasize = paldef.datasize();
+	}
+
+	void from_map(motoi::block_map const & map)
+	{
+		for (auto const & entry : map)
+		{
+			SET_FIELD(id);
+			SET_FIELD(desc);
+			SET_FIELD(length);
+			SET_FIELD(entry_datasize);
+			SET_FIELD(datasize);
+		}
+	}
+
+	void set_length(std::string const & length)
+	{
+		m_length = motoi::sto<uint>(length);
+	}
+
+	void set_entry_datasize(std::string const & entry_datasize)
+	{
+		m_entry_datasize = motoi::sto<uint>(motoi::trim_view(entry_datasize));
+	}
+
+	void set_datasize(std::string const & datasize)
+	{
+		m_datasize = motoi::sto<uint>(motoi::trim_view(datasize));
+	}
+
+	[[nodiscard]] paldef * build() const
+	{
+		// check the validity of the definition
+		if (m_length == 0)
+			throw std::runtime_error("palette length must be greater than zero");
+		if (m_entry_datasize == 0)
+			throw std::runtime_error("palette entry data size must be greater than zero");
+		if (m_datasize == 0)
+			throw std::runtime_error("palette data size must be greater than zero");
+
+		return new paldef {m_id, m_entry_datasize, m_length, m_datasize, m_desc};
+	}
+};
+
+class chrdef_builder : public gfxdef_builder
+{
+private:
+	uint m_width {0};
+	uint m_height {0};
+	uint m_bpp {0};
+	std::vector<uint> m_plane_offsets;
+	std::vector<uint> m_pixel_offsets;
+	std::vector<uint> m_row_offsets;
+
+	// tiles made of sub-tiles refer to another chrdef by ID, which must be found and passed to set_subtile_def
+	std::string m_subtile;
+	std::optional<chrdef> m_subtile_def;
+	uint m_subtile_columns {0};
+	uint m_subtile_rows {0};
+	std::vector<uint> m_subtile_offsets;
+
+public:
+	chrdef_builder() = default;
+	chrdef_builder(chrdef const & chrdef)
+	{
+		from_def(chrdef);
+	}
+
+	chrdef_builder(motoi::block_map const & map)
+	{
+		from_map(map);
+	}
+
+	void from_def(chrdef const & chrdef)
+	{
+		set_id(chrdef.id());
+		set_desc(chrdef.desc());
+		m_width = chrdef.width();
+		m_height = chrdef.height();
+		m_bpp = chrdef.bpp();
+		m_plane_offsets = chrdef.plane_offsets();
+		m_pixel_offsets = chrdef.pixel_offsets();
+		m_row_offsets = chrdef.row_offsets();
+		if (chrdef.subtile() != nullptr)
+		{
+			m_subtile = chrdef.subtile()->id();
+			m_subtile_def = *chrdef.subtile();
+			m_subtile_columns = chrdef.subtile_columns();
+			m_subtile_rows = chrdef.subtile_rows();
+			m_subtile_offsets = chrdef.subtile_offsets();
+		}
+	}
+
+	void from_map(motoi::block_map const & map)
+	{
+		for (auto const & entry : map)
+		{
+			SET_FIELD(id);
+			SET_FIELD(desc);
+			SET_FIELD(width);
+			SET_FIELD(height);
+			SET_FIELD(bpp);
+			SET_FIELD(plane_offsets);
+			SET_FIELD(pixel_offsets);
+			SET_FIELD(row_offsets);
+			SET_FIELD(subtile);
+			SET_FIELD(subtile_columns);
+			SET_FIELD(subtile_rows);
+			SET_FIELD(subtile_offsets);
+		}
+	}
+
+	void set_width(std::string const & width)
+	{
+		m_width = motoi::sto<uint>(motoi::trim_view(width));
+	}
+
+	void set_height(std::string const & height)
+	{
+		m_height = motoi::sto<uint>(motoi::trim_view(height));
+	}
+
+	void set_bpp(std::string const & bpp)
+	{
+		m_bpp = motoi::sto<uint>(motoi::trim_view(bpp));
+	}
+
+	void set_plane_offsets(std::string const & plane_offsets)
+	{
+		if (plane_offsets[0] == '[')
+			m_plane_offsets = motoi::sto_range<std::vector<uint>>(plane_offsets);
+		else
+			m_plane_offsets = motoi::sto_container<std::vector<uint>>(plane_offsets);
+	}
+
+	void set_pixel_offsets(std::string const & pixel_offsets)
+	{
+		if (pixel_offsets[0] == '[')
+			m_pixel_offsets = motoi::sto_range<std::vector<uint>>(pixel_offsets);
+		else
+			m_pixel_offsets = motoi::sto_container<std::vector<uint>>(pixel_offsets);
+	}
+
+	void set_row_offsets(std::string const & row_offsets)
+	{
+		if (row_offsets[0] == '[')
+			m_row_offsets = motoi::sto_range<std::vector<uint>>(row_offsets);
+		else
+			m_row_offsets = motoi::sto_container<std::vector<uint>>(row_offsets);
+	}
+
+	void set_subtile(std::string const & subtile)
+	{
+		m_subtile = motoi::trim_view(subtile);
+		m_subtile_def.reset();
+	}
+
+	void set_subtile_columns(std::string const & columns)
+	{
+		m_subtile_columns = motoi::sto<uint>(motoi::trim_view(columns));
+	}
+
+	void set_subtile_rows(std::string const & rows)
+	{
+		m_subtile_rows = motoi::sto<uint>(motoi::trim_view(rows));
+	}
+
+	void set_subtile_offsets(std::string const & subtile_offsets)
+	{
+		if (subtile_offsets[0] == '[')
+			m_subtile_offsets = motoi::sto_range<std::vector<uint>>(subtile_offsets);
+		else
+			m_subtile_offsets = motoi::sto_container<std::vector<uint>>(subtile_offsets);
+	}
+
+	void set_subtile_def(chrdef const & subtile_def)
+	{
+		m_subtile_def = subtile_def;
+	}
+
+	/**
+	 * @brief Use only the pixel, row and plane offsets, dropping any sub-tile arrangement
+	 */
+	void clear_subtile()
+	{
+		m_subtile.clear();
+		m_subtile_def.reset();
+	}
+
+	/**
+	 * @return ID of the chrdef used for each sub-tile, or an empty string if the tile is not made of sub-tiles
+	 */
+	[[nodiscard]] std::string const & subtile() const
+	{
+		return m_subtile;
+	}
+
+	[[nodiscard]] chrdef * build() const
+	{
+		if (! m_subtile.empty())
+		{
+			if (! m_subtile_def)
+				throw std::runtime_error("Sub-tile chrdef " + m_subtile + " has not been loaded");
+			if (m_subtile_columns == 0 || m_subtile_rows == 0)
+				throw std::runtime_error("Sub-tile columns and rows must be greater than zero");
+			if (m_subtile_offsets.size() != (size_t) m_subtile_columns * m_subtile_rows)
+				throw std::runtime_error("Number of sub-tile offset entries must equal sub-tile columns times rows");
+			return new chrdef {m_id, *m_subtile_def, m_subtile_columns, m_subtile_rows, m_subtile_offsets, m_desc};
+		}
+
+		// check the validity of the definition
+		if (m_bpp == 0)
+			throw std::runtime_error("Bitdepth must be greater than zero");
+		if (m_width > m_pixel_offsets.size())
+			throw std::runtime_error("CHR width must be equal to number of pixel offset entries");
+		if (m_height > m_row_offsets.size())
+			throw std::runtime_error("CHR height must be equal to number of row offset entries");
+		if (m_bpp > m_plane_offsets.size())
+			throw std::runtime_error("CHR bitdepth must be equal to number of plane offset entries");
+		return new chrdef {m_id, m_width, m_height, m_bpp, m_pixel_offsets, m_row_offsets, m_plane_offsets, m_desc};
+	}
+};
+
+} // namespace chrgfx
+
+#undef SET_FIELD
+
+#endif
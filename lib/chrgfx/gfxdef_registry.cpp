@@ -0,0 +1,144 @@
+#include "gfxdef_registry.hpp"
+#include "builtin_defs.hpp"
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+/*
+	The built in and embedded definitions live for the life of the program, so they are handed out by shared pointers
+	which do not own them
+*/
+template <typename DefT>
+static shared_ptr<DefT const> unowned(DefT const * def)
+{
+	return def == nullptr ? nullptr : shared_ptr<DefT const>(shared_ptr<void>(), def);
+}
+
+template <typename DefT>
+static shared_ptr<DefT const> find_added(
+	shared_mutex & mutex, map<string, shared_ptr<DefT const>, less<>> const & defs, string_view const id)
+{
+	shared_lock lock {mutex};
+	auto const def {defs.find(id)};
+	return def == defs.end() ? nullptr : def->second;
+}
+
+template <typename DefT>
+static void add_def(
+	shared_mutex & mutex, map<string, shared_ptr<DefT const>, less<>> & defs, shared_ptr<DefT const> def)
+{
+	if (def == nullptr)
+		throw invalid_argument("Cannot add a null gfxdef");
+	unique_lock lock {mutex};
+	defs.insert_or_assign(def->id(), std::move(def));
+}
+
+gfxdef_registry & gfxdef_registry::global()
+{
+	static gfxdef_registry registry;
+	return registry;
+}
+
+shared_ptr<chrdef const> gfxdef_registry::find_chrdef(string_view const id) const
+{
+	auto def {find_added(m_mutex, m_chrdefs, id)};
+	return def != nullptr ? def : unowned(gfxdefs::find_chrdef(id));
+}
+
+shared_ptr<paldef const> gfxdef_registry::find_paldef(string_view const id) const
+{
+	auto def {find_added(m_mutex, m_paldefs, id)};
+	return def != nullptr ? def : unowned(gfxdefs::find_paldef(id));
+}
+
+shared_ptr<coldef const> gfxdef_registry::find_coldef(string_view const id) const
+{
+	auto def {find_added(m_mutex, m_coldefs, id)};
+	return def != nullptr ? def : unowned(gfxdefs::find_coldef(id));
+}
+
+void gfxdef_registry::add(shared_ptr<chrdef const> def)
+{
+	if (def == nullptr)
+		throw invalid_argument("Cannot add a null gfxdef");
+	unique_lock lock {m_mutex};
+	auto const replaced {m_chrdefs.find(def->id())};
+	if (replaced != m_chrdefs.end())
+		m_decoders.erase(replaced->second.get());
+	m_chrdefs.insert_or_assign(def->id(), std::move(def));
+}
+
+void gfxdef_registry::add(shared_ptr<paldef const> def)
+{
+	add_def(m_mutex, m_paldefs, std::move(def));
+}
+
+void gfxdef_registry::add(shared_ptr<coldef const> def)
+{
+	add_def(m_mutex, m_coldefs, std::move(def));
+}
+
+bool gfxdef_registry::holds(chrgfx::chrdef const & chrdef) const
+{
+	auto const added {m_chrdefs.find(chrdef.id())};
+	if (added != m_chrdefs.end())
+		return added->second.get() == &chrdef;
+	return gfxdefs::find_chrdef(chrdef.id()) == &chrdef;
+}
+
+shared_ptr<tile_decoder const> gfxdef_registry::decoder(shared_ptr<chrdef const> const & chrdef)
+{
+	if (chrdef == nullptr)
+		throw invalid_argument("Cannot build a decoder without a chrdef");
+
+	{
+		shared_lock lock {m_mutex};
+		auto const decoder {m_decoders.find(chrdef.get())};
+		if (decoder != m_decoders.end())
+			return decoder->second;
+	}
+
+	/*
+		The tables are built without holding the lock, so that lookups are not held up meanwhile. If another thread built
+		a decoder for the same chrdef in the meantime, that one is kept and this one is thrown away.
+
+		A chrdef the registry does not hold, such as one loaded from a file or built for a single job, may be one of any
+		number made and dropped, so its decoder is handed over without being kept.
+	*/
+	auto built {make_shared<tile_decoder const>(chrdef)};
+	unique_lock lock {m_mutex};
+	if (! holds(*chrdef))
+		return built;
+	return m_decoders.try_emplace(chrdef.get(), std::move(built)).first->second;
+}
+
+void gfxdef_registry::build_decoders()
+{
+	vector<shared_ptr<chrdef const>> chrdefs;
+	{
+		shared_lock lock {m_mutex};
+		for (auto const & added : m_chrdefs)
+			chrdefs.push_back(added.second);
+	}
+	for (auto const id : gfxdefs::chrdef_ids())
+		chrdefs.push_back(find_chrdef(id));
+
+	for (auto const & chrdef : chrdefs)
+		[[maybe_unused]] auto const built {decoder(chrdef)};
+}
+
+void gfxdef_registry::clear()
+{
+	unique_lock lock {m_mutex};
+	m_chrdefs.clear();
+	m_paldefs.clear();
+	m_coldefs.clear();
+	m_decoders.clear();
+}
+
+} // namespace chrgfx
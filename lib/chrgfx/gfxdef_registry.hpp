@@ -0,0 +1,108 @@
+/**
+ * @file gfxdef_registry.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Shared, thread safe collection of gfxdefs and the decoders built from them
+ *
+ * The registry hands out gfxdefs by shared pointer. Definitions are never changed once they are added, so any number of
+ * threads may hold and use them while others look up or add definitions. The built in definitions and those embedded
+ * from the gfxdefs file are returned without being copied.
+ *
+ * The table driven decoder for a chrdef is built the first time it is asked for and kept with the registry, so in a
+ * long running process, or one running many jobs, the cost of building it is only paid once for each format. Only the
+ * decoders for the registry's own definitions are kept; any other chrdef gets a new decoder each time, which belongs to
+ * the caller, so definitions made and dropped by each job are never held on to.
+ */
+
+#ifndef __CHRGFX__GFXDEF_REGISTRY_HPP
+#define __CHRGFX__GFXDEF_REGISTRY_HPP
+
+#include "chrdef.hpp"
+#include "coldef.hpp"
+#include "paldef.hpp"
+#include "tile_decoder.hpp"
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+namespace chrgfx
+{
+
+class gfxdef_registry
+{
+private:
+	mutable std::shared_mutex m_mutex;
+
+	std::map<std::string, std::shared_ptr<chrdef const>, std::less<>> m_chrdefs;
+	std::map<std::string, std::shared_ptr<paldef const>, std::less<>> m_paldefs;
+	std::map<std::string, std::shared_ptr<coldef const>, std::less<>> m_coldefs;
+
+	// each decoder keeps its chrdef, so the key always points to a live chrdef
+	std::map<chrdef const *, std::shared_ptr<tile_decoder const>> m_decoders;
+
+	/**
+	 * @brief Whether the chrdef is one of the built in, embedded or added definitions
+	 * @details The lock must be held.
+	 */
+	[[nodiscard]] bool holds(chrdef const & chrdef) const;
+
+public:
+	gfxdef_registry() = default;
+	gfxdef_registry(gfxdef_registry const &) = delete;
+	gfxdef_registry & operator=(gfxdef_registry const &) = delete;
+
+	/**
+	 * @brief Registry shared by the whole process
+	 */
+	static gfxdef_registry & global();
+
+	/**
+	 * @return The tile encoding with the given ID, or nullptr if not present
+	 * @details Definitions added to the registry are searched first, then the built in and embedded definitions.
+	 */
+	[[nodiscard]] std::shared_ptr<chrdef const> find_chrdef(std::string_view id) const;
+
+	/**
+	 * @return The palette encoding with the given ID, or nullptr if not present
+	 */
+	[[nodiscard]] std::shared_ptr<paldef const> find_paldef(std::string_view id) const;
+
+	/**
+	 * @return The color encoding (RGB or reference) with the given ID, or nullptr if not present
+	 */
+	[[nodiscard]] std::shared_ptr<coldef const> find_coldef(std::string_view id) const;
+
+	/**
+	 * @brief Add a definition, replacing any earlier one with the same ID
+	 * @details Those still holding a replaced definition may keep using it. The registry drops its decoder for a
+	 * replaced chrdef.
+	 */
+	void add(std::shared_ptr<chrdef const> def);
+	void add(std::shared_ptr<paldef const> def);
+	void add(std::shared_ptr<coldef const> def);
+
+	/**
+	 * @brief Returns the decoder for a tile encoding
+	 * @details For definitions from the registry, the decoder is built on first use and kept. For any other chrdef, a
+	 * new decoder is built and not kept, so the caller should hold on to it for as long as it is needed.
+	 */
+	[[nodiscard]] std::shared_ptr<tile_decoder const> decoder(std::shared_ptr<chrdef const> const & chrdef);
+
+	/**
+	 * @brief Build and keep the decoders for every chrdef the registry holds
+	 * @details For processes which fork workers once they are set up, so that the tables are built only once and shared
+	 * with every worker, rather than built again in each.
+	 */
+	void build_decoders();
+
+	/**
+	 * @brief Drop all added definitions and all decoders
+	 */
+	void clear();
+};
+
+} // namespace chrgfx
+
+#endif
@@ -13,7 +13,12 @@
 #include "strutil.hpp"
 #include "types.hpp"
 #include <array>
+#include <memory>
+#include <new>
+#include <optional>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 namespace motoi
 {
@@ -66,6 +71,34 @@ public:
 	}
 };
 
+/**
+ * @brief Direct color pixel with alpha, laid out as in RGBA image data
+ */
+struct rgba
+{
+public:
+	uint8_t red {0};
+	uint8_t green {0};
+	uint8_t blue {0};
+	uint8_t alpha {0};
+
+	rgba() = default;
+	explicit rgba(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha = 255) :
+			red(red),
+			green(green),
+			blue(blue),
+			alpha(alpha)
+	{
+	}
+
+	explicit rgba(rgb const & color, uint8_t alpha = 255) :
+			rgba(color.red, color.green, color.blue, alpha)
+	{
+	}
+};
+
+static_assert(sizeof(rgba) == 4, "rgba pixels must be packed to four bytes");
+
 using index = uint8_t;
 
 } // namespace pixel_type
@@ -79,32 +112,315 @@ using basic_color_map = std::array<pixel_type::rgb, length>;
  */
 using color_map_8bpp = basic_color_map<256>;
 
+/**
+ * @brief Alignment of image pixel storage, suitable for cache lines and SIMD loads
+ */
+static size_t constexpr IMAGE_ALIGNMENT {64};
+
+/**
+ * @brief Minimal allocator returning memory aligned to the given boundary
+ */
+template <typename T, size_t alignment = IMAGE_ALIGNMENT>
+struct aligned_allocator
+{
+	static_assert(alignment >= alignof(T) && (alignment & (alignment - 1)) == 0,
+		"Alignment must be a power of 2 and no less than that of the type");
+
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = aligned_allocator<U, alignment>;
+	};
+
+	aligned_allocator() noexcept = default;
+
+	template <typename U>
+	aligned_allocator(aligned_allocator<U, alignment> const &) noexcept
+	{
+	}
+
+	[[nodiscard]] T * allocate(size_t const count)
+	{
+		return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t {alignment}));
+	}
+
+	void deallocate(T * ptr, size_t) noexcept
+	{
+		::operator delete(ptr, std::align_val_t {alignment});
+	}
+
+	template <typename U>
+	bool operator==(aligned_allocator<U, alignment> const &) const noexcept
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(aligned_allocator<U, alignment> const &) const noexcept
+	{
+		return false;
+	}
+};
+
+template <class pixel_type, class color_map_t = color_map_8bpp, class allocator_t = aligned_allocator<pixel_type>>
+class image;
+
+/**
+ * @brief Non-owning view of a rectangular region of pixels
+ * @details A view refers to pixel data owned by something else (usually an image), and so must not outlive it. Rows
+ * are stride pixels apart, which allows a view to cover a region within a larger image. Creating and copying views
+ * never copies pixel data.
+ *
+ * Use image_view<T const> (const_image_view) for read only access.
+ */
+template <class pixel_type>
+class image_view
+{
+private:
+	pixel_type * m_pixels {nullptr};
+	uint m_width {0};
+	uint m_height {0};
+	size_t m_stride {0};
+
+public:
+	image_view() = default;
+
+	/**
+	 * @param pixels Pointer to the top left pixel
+	 * @param stride Distance between the start of each row, in pixels
+	 */
+	image_view(pixel_type * pixels, uint const width, uint const height, size_t const stride) :
+			m_pixels {pixels},
+			m_width {width},
+			m_height {height},
+			m_stride {stride}
+	{
+		if (stride < width)
+			throw std::invalid_argument("image view stride cannot be less than its width");
+	}
+
+	image_view(pixel_type * pixels, uint const width, uint const height) :
+			image_view(pixels, width, height, width)
+	{
+	}
+
+	/**
+	 * @brief View of an entire image
+	 */
+	template <class color_map_t, class allocator_t>
+	image_view(image<std::remove_const_t<pixel_type>, color_map_t, allocator_t> & source) :
+			image_view(source.pixel_map(), source.width(), source.height(), source.width())
+	{
+	}
+
+	/**
+	 * @brief Read only view of an entire image
+	 */
+	template <class color_map_t,
+		class allocator_t,
+		class T = pixel_type,
+		typename = std::enable_if_t<std::is_const_v<T>>>
+	image_view(image<std::remove_const_t<pixel_type>, color_map_t, allocator_t> const & source) :
+			image_view(source.pixel_map(), source.width(), source.height(), source.width())
+	{
+	}
+
+	/**
+	 * @brief Read only view from a writable view
+	 */
+	template <class T = pixel_type, typename = std::enable_if_t<std::is_const_v<T>>>
+	image_view(image_view<std::remove_const_t<pixel_type>> const & other) :
+			image_view(other.pixel_map(), other.width(), other.height(), other.stride())
+	{
+	}
+
+	[[nodiscard]] uint width() const
+	{
+		return m_width;
+	}
+
+	[[nodiscard]] uint height() const
+	{
+		return m_height;
+	}
+
+	/**
+	 * @brief Distance between the start of each row, in pixels
+	 */
+	[[nodiscard]] size_t stride() const
+	{
+		return m_stride;
+	}
+
+	/**
+	 * @brief Whether the rows follow one another in memory with no gaps
+	 */
+	[[nodiscard]] bool contiguous() const
+	{
+		return m_stride == m_width || m_height <= 1;
+	}
+
+	pixel_type * pixel_map() const
+	{
+		return m_pixels;
+	}
+
+	pixel_type * pixel_map_row(size_t const row_index) const
+	{
+		return m_pixels + (m_stride * row_index);
+	}
+
+	/**
+	 * @brief View of a region within this view
+	 */
+	[[nodiscard]] image_view subview(uint const x, uint const y, uint const width, uint const height) const
+	{
+		if (x + width > m_width || y + height > m_height)
+			throw std::out_of_range("image subview extends beyond the source");
+		return image_view(m_pixels + (m_stride * y) + x, width, height, m_stride);
+	}
+};
+
+template <class pixel_type>
+using const_image_view = image_view<pixel_type const>;
+
 /**
  * @brief Represents a self-contained viewable image (pixel data and color table) in a "standard" intermediate format
+ * @details Pixel rows are stored contiguously, with no padding between them. The start of the pixel data is aligned
+ * according to the allocator, which by default aligns to IMAGE_ALIGNMENT. A custom allocator (e.g. one backed by a pool
+ * or arena) may be provided. Images can be moved cheaply; copies are deep.
  *
  * @warning does not do bounds checking on the pixel_buffer for the given width/height
  *
  */
-template <class pixel_type, class color_map_t = color_map_8bpp>
+template <class pixel_type, class color_map_t, class allocator_t>
 class image
 {
+public:
+	using allocator_type = allocator_t;
+
 private:
-	uint m_width;
-	uint m_height;
-	size_t m_datasize;
+	using alloc_traits = std::allocator_traits<allocator_t>;
+
+	allocator_t m_allocator;
+	uint m_width {0};
+	uint m_height {0};
+	size_t m_datasize {0};
 	pixel_type * m_pixmap {nullptr};
-	color_map_t * m_colormap {nullptr};
+	std::optional<color_map_t> m_colormap;
+
+	void allocate()
+	{
+		m_pixmap = alloc_traits::allocate(m_allocator, m_datasize);
+	}
+
+	void release() noexcept
+	{
+		if (m_pixmap == nullptr)
+			return;
+		std::destroy_n(m_pixmap, m_datasize);
+		alloc_traits::deallocate(m_allocator, m_pixmap, m_datasize);
+		m_pixmap = nullptr;
+	}
+
+	void steal(image & other) noexcept
+	{
+		m_width = std::exchange(other.m_width, 0);
+		m_height = std::exchange(other.m_height, 0);
+		m_datasize = std::exchange(other.m_datasize, 0);
+		m_pixmap = std::exchange(other.m_pixmap, nullptr);
+		m_colormap = std::move(other.m_colormap);
+		other.m_colormap.reset();
+	}
 
 public:
-	image(uint const width, uint const height) :
+	/**
+	 * @brief Create an image with all pixels value initialized (i.e. zero for indexed pixels)
+	 */
+	image(uint const width, uint const height, allocator_t const & allocator = allocator_t()) :
+			m_allocator {allocator},
 			m_width {width},
 			m_height {height},
-			m_datasize {width * height}
+			m_datasize {(size_t) width * height}
 	{
 		if (m_datasize == 0)
 			throw std::runtime_error("invalid width and/or height specified for pixmap");
 
-		m_pixmap = new pixel_type[m_datasize];
+		allocate();
+		std::uninitialized_value_construct_n(m_pixmap, m_datasize);
+	}
+
+	image(image const & other) :
+			m_allocator {alloc_traits::select_on_container_copy_construction(other.m_allocator)},
+			m_width {other.m_width},
+			m_height {other.m_height},
+			m_datasize {other.m_datasize},
+			m_colormap {other.m_colormap}
+	{
+		if (other.m_pixmap == nullptr)
+			return;
+		allocate();
+		std::uninitialized_copy_n(other.m_pixmap, m_datasize, m_pixmap);
+	}
+
+	image(image && other) noexcept :
+			m_allocator {std::move(other.m_allocator)}
+	{
+		steal(other);
+	}
+
+	image & operator=(image const & other)
+	{
+		if (this != &other)
+		{
+			image copy(other);
+			*this = std::move(copy);
+		}
+		return *this;
+	}
+
+	image & operator=(image && other) noexcept(
+		alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value)
+	{
+		if (this == &other)
+			return *this;
+
+		if constexpr (alloc_traits::propagate_on_container_move_assignment::value)
+		{
+			release();
+			m_allocator = std::move(other.m_allocator);
+			steal(other);
+		}
+		else
+		{
+			if (m_allocator == other.m_allocator)
+			{
+				release();
+				steal(other);
+			}
+			else
+			{
+				// the other image's storage cannot be freed by our allocator, so the pixels must be copied
+				release();
+				m_width = other.m_width;
+				m_height = other.m_height;
+				m_datasize = other.m_datasize;
+				m_colormap = other.m_colormap;
+				if (other.m_pixmap != nullptr)
+				{
+					allocate();
+					std::uninitialized_move_n(other.m_pixmap, m_datasize, m_pixmap);
+				}
+			}
+		}
+		return *this;
+	}
+
+	~image()
+	{
+		release();
 	}
 
 	[[nodiscard]] uint width() const
@@ -117,6 +433,19 @@ public:
 		return m_height;
 	}
 
+	/**
+	 * @brief Number of pixels in the image
+	 */
+	[[nodiscard]] size_t datasize() const
+	{
+		return m_datasize;
+	}
+
+	[[nodiscard]] allocator_t get_allocator() const
+	{
+		return m_allocator;
+	}
+
 	pixel_type const * pixel_map_row(size_t row_index) const
 	{
 		return m_pixmap + (m_width * row_index);
@@ -139,24 +468,40 @@ public:
 
 	[[nodiscard]] color_map_t const * color_map() const
 	{
-		return m_colormap;
+		return m_colormap ? &*m_colormap : nullptr;
 	}
 
 	color_map_t * color_map()
 	{
-		return m_colormap;
+		return m_colormap ? &*m_colormap : nullptr;
 	}
 
 	void set_color_map(color_map_t const & color_map)
 	{
-		delete m_colormap;
-		m_colormap = new color_map_t(color_map);
+		m_colormap = color_map;
 	}
 
-	~image()
+	/**
+	 * @brief View of the whole image, or of a region within it
+	 */
+	image_view<pixel_type> view()
+	{
+		return *this;
+	}
+
+	const_image_view<pixel_type> view() const
+	{
+		return *this;
+	}
+
+	image_view<pixel_type> view(uint const x, uint const y, uint const width, uint const height)
+	{
+		return view().subview(x, y, width, height);
+	}
+
+	const_image_view<pixel_type> view(uint const x, uint const y, uint const width, uint const height) const
 	{
-		delete[] m_pixmap;
-		delete m_colormap;
+		return view().subview(x, y, width, height);
 	}
 };
 
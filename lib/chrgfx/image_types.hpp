@@ -10,10 +10,16 @@ namespace chrgfx
 
 using rgb_color = motoi::pixel_type::rgb;
 
+using rgba_color = motoi::pixel_type::rgba;
+
 using pixel = motoi::pixel_type::index;
 
 using palette = motoi::color_map_8bpp;
 
 using image = motoi::image<pixel>;
 
+using image_view = motoi::image_view<pixel>;
+
+using const_image_view = motoi::const_image_view<pixel>;
+
 } // namespace chrgfx
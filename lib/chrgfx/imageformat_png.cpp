@@ -1,4 +1,5 @@
 #include "imageformat_png.hpp"
+#include <zlib.h>
 
 using namespace std;
 
@@ -29,23 +30,50 @@ image from_png(png::image<png::index_pixel> const & png_image)
 	return basic_img;
 }
 
+image from_png(png::image<png::rgba_pixel> const & png_image, coldef const * coldef, quantize_config const & quantize_cfg)
+{
+	auto png_pixbuf = png_image.get_pixbuf();
+	auto height {png_pixbuf.get_height()}, width {png_pixbuf.get_width()};
+	vector<byte_t> rgba_data((size_t) width * height * 4);
+	byte_t * ptr = rgba_data.data();
+	for (uint i_row {0}; i_row < height; ++i_row)
+	{
+		for (auto const & png_pixel : png_pixbuf.get_row(i_row))
+		{
+			*ptr++ = png_pixel.red;
+			*ptr++ = png_pixel.green;
+			*ptr++ = png_pixel.blue;
+			*ptr++ = png_pixel.alpha;
+		}
+	}
+
+	return quantize_image(coldef, rgba_data.data(), width, height, quantize_cfg);
+}
+
 png::image<png::index_pixel> to_png(image const & basic_image, optional<uint8> trns_index)
 {
-	if (basic_image.color_map()->size() < 256)
+	if (! basic_image.color_map())
+		throw invalid_argument("Image has no palette for PNG export");
+	return to_png(basic_image, *basic_image.color_map(), trns_index);
+}
+
+png::image<png::index_pixel> to_png(const_image_view const & region, palette const & pal, optional<uint8> trns_index)
+{
+	if (pal.size() < 256)
 		throw invalid_argument("Palette must contain a full 256 entries for PNG export");
 
-	png::pixel_buffer<png::index_pixel> png_pixbuf(basic_image.width(), basic_image.height());
-	for (uint i_pixel_row {0}; i_pixel_row < basic_image.height(); ++i_pixel_row)
+	png::pixel_buffer<png::index_pixel> png_pixbuf(region.width(), region.height());
+	for (uint i_pixel_row {0}; i_pixel_row < region.height(); ++i_pixel_row)
 	{
-		auto * ptr = (png::index_pixel *) (basic_image.pixel_map() + i_pixel_row * basic_image.width());
-		vector<png::index_pixel> pxlrow_work(ptr, ptr + basic_image.width());
+		auto * ptr = (png::index_pixel *) region.pixel_map_row(i_pixel_row);
+		vector<png::index_pixel> pxlrow_work(ptr, ptr + region.width());
 		png_pixbuf.put_row(i_pixel_row, pxlrow_work);
 	}
-	png::image<png::index_pixel> outimg(basic_image.width(), basic_image.height());
+	png::image<png::index_pixel> outimg(region.width(), region.height());
 	outimg.set_pixbuf(png_pixbuf);
 
 	vector<png::color> png_pal;
-	for (auto const & color : *basic_image.color_map())
+	for (auto const & color : pal)
 		png_pal.emplace_back(color.red, color.green, color.blue);
 	outimg.set_palette(png_pal);
 
@@ -60,4 +88,371 @@ png::image<png::index_pixel> to_png(image const & basic_image, optional<uint8> t
 	return outimg;
 }
 
-} // namespace chrgfx
\ No newline at end of file
+/*
+	The image data is compressed in blocks of roughly this size. Each block is compressed as raw deflate data primed with
+	the end of the previous block as its dictionary, so there is little loss in compression compared to a single
+	stream. All but the last block end on a byte boundary (via a sync flush), allowing them to simply be concatenated.
+*/
+static size_t constexpr COMPRESS_BLOCK_SIZE {0x20000};
+static size_t constexpr DICTIONARY_SIZE {0x8000};
+
+struct png_row_writer::compressed_block
+{
+	vector<byte_t> data;
+	uint32 adler;
+	size_t uncompressed_size;
+};
+
+static int zlib_strategy(png_strategy const strategy)
+{
+	switch (strategy)
+	{
+		case png_strategy::filtered:
+			return Z_FILTERED;
+		case png_strategy::huffman_only:
+			return Z_HUFFMAN_ONLY;
+		case png_strategy::rle:
+			return Z_RLE;
+		default:
+			return Z_DEFAULT_STRATEGY;
+	}
+}
+
+png_row_writer::compressed_block png_row_writer::compress_block(
+	vector<byte_t> const & input, vector<byte_t> const & dictionary, png_compression const & compression, bool const last)
+{
+	z_stream stream {};
+	if (deflateInit2(&stream, compression.level, Z_DEFLATED, -15, 8, zlib_strategy(compression.strategy)) != Z_OK)
+		throw runtime_error("Could not initialize PNG compression");
+
+	compressed_block block;
+	block.uncompressed_size = input.size();
+	block.adler = static_cast<uint32>(adler32(adler32(0, nullptr, 0), input.data(), input.size()));
+
+	if (! dictionary.empty())
+		deflateSetDictionary(&stream, dictionary.data(), dictionary.size());
+
+	// the sync flush marker and final block add a few bytes beyond deflateBound
+	block.data.resize(deflateBound(&stream, input.size()) + 16);
+	stream.next_in = const_cast<byte_t *>(input.data());
+	stream.avail_in = input.size();
+	stream.next_out = block.data.data();
+	stream.avail_out = block.data.size();
+
+	int const flush {last ? Z_FINISH : Z_SYNC_FLUSH};
+	int result;
+	while (true)
+	{
+		result = deflate(&stream, flush);
+		if (result == Z_STREAM_ERROR)
+			break;
+		if (stream.avail_in == 0 && stream.avail_out != 0 && (! last || result == Z_STREAM_END))
+			break;
+
+		// out of space; grow the output and continue
+		auto const used {block.data.size() - stream.avail_out};
+		block.data.resize(block.data.size() * 2);
+		stream.next_out = block.data.data() + used;
+		stream.avail_out = block.data.size() - used;
+	}
+	block.data.resize(block.data.size() - stream.avail_out);
+	deflateEnd(&stream);
+
+	if (result == Z_STREAM_ERROR)
+		throw runtime_error("PNG compression failed");
+
+	return block;
+}
+
+static byte_t paeth_predictor(int const a, int const b, int const c)
+{
+	int const p {a + b - c}, pa {abs(p - a)}, pb {abs(p - b)}, pc {abs(p - c)};
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+/**
+ * @brief Filter a row of pixels, writing the filter type byte followed by the filtered data
+ * @param datasize Size of the row in bytes
+ * @param pixel_size Bytes per pixel; the sub, average and paeth filters predict each byte from the same byte of the
+ * pixel to the left
+ */
+static void filter_row(png_filter const filter,
+	byte_t const * row,
+	byte_t const * prev,
+	size_t const datasize,
+	size_t const pixel_size,
+	byte_t * out)
+{
+	*out++ = static_cast<byte_t>(filter);
+	switch (filter)
+	{
+		case png_filter::none:
+			copy(row, row + datasize, out);
+			break;
+		case png_filter::sub:
+			copy(row, row + pixel_size, out);
+			for (size_t i {pixel_size}; i < datasize; ++i)
+				out[i] = row[i] - row[i - pixel_size];
+			break;
+		case png_filter::up:
+			for (size_t i {0}; i < datasize; ++i)
+				out[i] = row[i] - prev[i];
+			break;
+		case png_filter::average:
+			for (size_t i {0}; i < pixel_size; ++i)
+				out[i] = row[i] - (prev[i] >> 1);
+			for (size_t i {pixel_size}; i < datasize; ++i)
+				out[i] = row[i] - ((row[i - pixel_size] + prev[i]) >> 1);
+			break;
+		case png_filter::paeth:
+			for (size_t i {0}; i < pixel_size; ++i)
+				out[i] = row[i] - paeth_predictor(0, prev[i], 0);
+			for (size_t i {pixel_size}; i < datasize; ++i)
+				out[i] = row[i] - paeth_predictor(row[i - pixel_size], prev[i], prev[i - pixel_size]);
+			break;
+		default:
+			throw invalid_argument("Invalid PNG filter");
+	}
+}
+
+png_row_writer::png_row_writer(ostream & out,
+	uint const width,
+	uint const height,
+	palette const & pal,
+	optional<uint8> trns_index,
+	png_compression const & compression) :
+		m_out {out},
+		m_width {width},
+		m_height {height},
+		m_pixel_size {1},
+		m_compression {compression},
+		m_adler {static_cast<uint32>(adler32(0, nullptr, 0))}
+{
+	// 8 bit indexed color
+	write_header(3);
+
+	byte_t plte[256 * 3];
+	for (size_t i {0}; i < pal.size(); ++i)
+	{
+		plte[i * 3] = pal[i].red;
+		plte[i * 3 + 1] = pal[i].green;
+		plte[i * 3 + 2] = pal[i].blue;
+	}
+	write_chunk("PLTE", plte, sizeof(plte));
+
+	if (trns_index)
+	{
+		byte_t trns[256];
+		fill(trns, trns + 256, 255);
+		trns[trns_index.value()] = 0;
+		write_chunk("tRNS", trns, sizeof(trns));
+	}
+}
+
+png_row_writer::png_row_writer(
+	ostream & out, uint const width, uint const height, png_compression const & compression) :
+		m_out {out},
+		m_width {width},
+		m_height {height},
+		m_pixel_size {4},
+		m_compression {compression},
+		m_adler {static_cast<uint32>(adler32(0, nullptr, 0))}
+{
+	// 8 bit per channel RGBA
+	write_header(6);
+}
+
+void png_row_writer::write_header(byte_t const color_type)
+{
+	if (m_width == 0 || m_height == 0)
+		throw invalid_argument("Invalid PNG image dimensions");
+	if (m_compression.level < 0 || m_compression.level > 9)
+		throw invalid_argument("Invalid PNG compression level");
+	if (m_compression.threads == 0)
+		m_compression.threads = 1;
+
+	size_t const row_datasize {(size_t) m_width * m_pixel_size};
+	m_prev_row.assign(row_datasize, 0);
+	m_block.reserve(COMPRESS_BLOCK_SIZE + row_datasize + 1);
+
+	static byte_t const signature[] {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	m_out.write(reinterpret_cast<char const *>(signature), sizeof(signature));
+
+	// 8 bit depth, default compression & filter method, no interlace
+	byte_t const ihdr[] {byte_t(m_width >> 24),
+		byte_t(m_width >> 16),
+		byte_t(m_width >> 8),
+		byte_t(m_width),
+		byte_t(m_height >> 24),
+		byte_t(m_height >> 16),
+		byte_t(m_height >> 8),
+		byte_t(m_height),
+		8,
+		color_type,
+		0,
+		0,
+		0};
+	write_chunk("IHDR", ihdr, sizeof(ihdr));
+}
+
+png_row_writer::~png_row_writer()
+{
+	// wait for any blocks still being compressed if we are unwinding from an error
+	for (auto & pending : m_pending)
+		if (pending.valid())
+			pending.wait();
+}
+
+void png_row_writer::write_chunk(char const * type, byte_t const * data, size_t const length)
+{
+	byte_t header[8] {byte_t(length >> 24), byte_t(length >> 16), byte_t(length >> 8), byte_t(length)};
+	copy(type, type + 4, header + 4);
+
+	auto crc {static_cast<uint32>(crc32(crc32(0, nullptr, 0), header + 4, 4))};
+	// (zlib treats a null pointer as a request for the initial value)
+	if (length > 0)
+		crc = static_cast<uint32>(crc32(crc, data, length));
+	byte_t const footer[4] {byte_t(crc >> 24), byte_t(crc >> 16), byte_t(crc >> 8), byte_t(crc)};
+
+	m_out.write(reinterpret_cast<char const *>(header), sizeof(header));
+	m_out.write(reinterpret_cast<char const *>(data), length);
+	m_out.write(reinterpret_cast<char const *>(footer), sizeof(footer));
+	if (! m_out.good())
+		throw runtime_error("Failed to write PNG data to stream");
+}
+
+void png_row_writer::submit_block(bool const last)
+{
+	// the end of this block's input is the dictionary for the next
+	vector<byte_t> next_dictionary(
+		m_block.end() - min(m_block.size(), DICTIONARY_SIZE), m_block.end());
+
+	// with a single thread, blocks are compressed when their output is needed rather than in the background
+	auto const policy {m_compression.threads > 1 ? launch::async : launch::deferred};
+	m_pending.push_back(
+		async(policy, compress_block, std::move(m_block), std::move(m_dictionary), m_compression, last));
+
+	m_dictionary = std::move(next_dictionary);
+	m_block.clear();
+	m_block.reserve(COMPRESS_BLOCK_SIZE + m_prev_row.size() + 1);
+
+	// write out finished blocks in order so that no more than one block per thread is held
+	while (m_pending.size() >= m_compression.threads && ! last)
+	{
+		auto block {m_pending.front().get()};
+		m_pending.pop_front();
+		write_block(block);
+	}
+}
+
+void png_row_writer::write_block(compressed_block const & block)
+{
+	m_adler = static_cast<uint32>(adler32_combine(m_adler, block.adler, block.uncompressed_size));
+
+	vector<byte_t> idat;
+	if (! m_header_written)
+	{
+		// zlib stream header: deflate with 32K window, plus the level hint and check bits
+		byte_t const cmf {0x78};
+		byte_t flg = (m_compression.level < 2 ? 0 : m_compression.level < 6 ? 1 : m_compression.level == 6 ? 2 : 3) << 6;
+		flg += 31 - ((cmf * 256 + flg) % 31);
+		idat.push_back(cmf);
+		idat.push_back(flg);
+		m_header_written = true;
+	}
+	idat.insert(idat.end(), block.data.begin(), block.data.end());
+	write_chunk("IDAT", idat.data(), idat.size());
+}
+
+void png_row_writer::write_rows(const_image_view const & rows)
+{
+	if (rows.width() != m_width)
+		throw invalid_argument("Image width does not match PNG width");
+	for (size_t i_row {0}; i_row < rows.height(); ++i_row)
+		write_row(rows.pixel_map_row(i_row));
+}
+
+void png_row_writer::write_rows(motoi::const_image_view<rgba_color> const & rows)
+{
+	if (rows.width() != m_width)
+		throw invalid_argument("Image width does not match PNG width");
+	for (size_t i_row {0}; i_row < rows.height(); ++i_row)
+		write_row(rows.pixel_map_row(i_row));
+}
+
+void png_row_writer::write_row(pixel const * row)
+{
+	if (m_pixel_size != 1)
+		throw logic_error("Indexed color row written to an RGBA PNG");
+	write_row_data(row);
+}
+
+void png_row_writer::write_row(rgba_color const * row)
+{
+	if (m_pixel_size != 4)
+		throw logic_error("RGBA row written to an indexed color PNG");
+	write_row_data(reinterpret_cast<byte_t const *>(row));
+}
+
+void png_row_writer::write_row_data(byte_t const * row)
+{
+	if (m_rows_written == m_height)
+		throw out_of_range("All PNG rows have already been written");
+
+	size_t const row_datasize {m_prev_row.size()};
+	auto const offset {m_block.size()};
+	m_block.resize(offset + row_datasize + 1);
+	auto * out {m_block.data() + offset};
+
+	if (m_compression.filter == png_filter::adaptive)
+	{
+		// use the filter giving the smallest sum of absolute values, as suggested by the PNG spec
+		vector<byte_t> trial(row_datasize + 1);
+		uint64_t best_sum {UINT64_MAX};
+		for (auto filter : {png_filter::none, png_filter::sub, png_filter::up, png_filter::average, png_filter::paeth})
+		{
+			filter_row(filter, row, m_prev_row.data(), row_datasize, m_pixel_size, trial.data());
+			uint64_t sum {0};
+			for (size_t i {1}; i <= row_datasize; ++i)
+				sum += abs(static_cast<int8>(trial[i]));
+			if (sum < best_sum)
+			{
+				best_sum = sum;
+				copy(trial.begin(), trial.end(), out);
+			}
+		}
+	}
+	else
+	{
+		filter_row(m_compression.filter, row, m_prev_row.data(), row_datasize, m_pixel_size, out);
+	}
+
+	copy(row, row + row_datasize, m_prev_row.begin());
+	++m_rows_written;
+
+	if (m_block.size() >= COMPRESS_BLOCK_SIZE)
+		submit_block(false);
+}
+
+void png_row_writer::finish()
+{
+	if (m_rows_written != m_height)
+		throw logic_error("Not all PNG rows have been written");
+
+	submit_block(true);
+	while (! m_pending.empty())
+	{
+		auto block {m_pending.front().get()};
+		m_pending.pop_front();
+		write_block(block);
+	}
+
+	byte_t const adler[4] {byte_t(m_adler >> 24), byte_t(m_adler >> 16), byte_t(m_adler >> 8), byte_t(m_adler)};
+	write_chunk("IDAT", adler, sizeof(adler));
+	write_chunk("IEND", nullptr, 0);
+	m_out.flush();
+}
+
+} // namespace chrgfx
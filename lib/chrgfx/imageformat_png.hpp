@@ -9,17 +9,168 @@
 #define __CHRGFX__IMAGEFORMAT_PNG_HPP
 
 #include "image_types.hpp"
+#include "quantize.hpp"
 #include "types.hpp"
+#include <deque>
+#include <future>
 #include <optional>
+#include <ostream>
 #include <png++/pixel_buffer.hpp>
 #include <png++/png.hpp>
+#include <vector>
 
 namespace chrgfx
 {
 image from_png(png::image<png::index_pixel> const & png_image);
 
+/**
+ * @brief Convert a direct color PNG image to indexed color, choosing a palette with quantize_image
+ */
+image from_png(png::image<png::rgba_pixel> const & png_image, coldef const * coldef, quantize_config const & quantize_cfg);
+
 png::image<png::index_pixel> to_png(image const & basic_image, std::optional<uint8> trns_index = std::nullopt);
 
+/**
+ * @brief Encode a region of an image, such as a view of part of a larger image
+ */
+png::image<png::index_pixel> to_png(
+	const_image_view const & region, palette const & pal, std::optional<uint8> trns_index = std::nullopt);
+
+/**
+ * @brief Scanline filter applied before compression
+ * @details none is recommended for indexed color images and is the fastest; adaptive picks the best filter for each
+ * row, which can give smaller output at the cost of speed
+ */
+enum class png_filter
+{
+	none,
+	sub,
+	up,
+	average,
+	paeth,
+	adaptive
+};
+
+/**
+ * @brief zlib compression strategy
+ */
+enum class png_strategy
+{
+	standard,
+	filtered,
+	huffman_only,
+	rle
+};
+
+/**
+ * @brief PNG compression settings
+ */
+struct png_compression
+{
+	/**
+	 * @brief zlib compression level, from 0 (none) to 9 (best)
+	 */
+	int level {6};
+
+	png_filter filter {png_filter::none};
+
+	png_strategy strategy {png_strategy::standard};
+
+	/**
+	 * @brief Number of threads used for compression
+	 */
+	uint threads {1};
+};
+
+/**
+ * @brief Writes an indexed color or RGBA PNG one pixel row at a time
+ * @details Output begins as soon as enough rows have been written to fill a compression block, so an image can be
+ * encoded while later parts of it are still being rendered. The image data is split into blocks which are compressed
+ * in parallel (in the manner of pigz) and joined into a single valid zlib stream.
+ */
+class png_row_writer
+{
+private:
+	struct compressed_block;
+
+	std::ostream & m_out;
+	uint m_width;
+	uint m_height;
+	// bytes per pixel: 1 for indexed color, 4 for RGBA
+	uint m_pixel_size;
+	uint m_rows_written {0};
+	png_compression m_compression;
+
+	// the previous (unfiltered) row, needed by most filters
+	std::vector<byte_t> m_prev_row;
+	// filtered rows waiting to be compressed
+	std::vector<byte_t> m_block;
+	// the end of the previous block, used as the dictionary for the next one
+	std::vector<byte_t> m_dictionary;
+	std::deque<std::future<compressed_block>> m_pending;
+	uint32 m_adler;
+	bool m_header_written {false};
+
+	static compressed_block compress_block(std::vector<byte_t> const & input,
+		std::vector<byte_t> const & dictionary,
+		png_compression const & compression,
+		bool const last);
+	void write_header(byte_t const color_type);
+	void write_chunk(char const * type, byte_t const * data, size_t const length);
+	void write_row_data(byte_t const * row);
+	void submit_block(bool const last);
+	void write_block(compressed_block const & block);
+
+public:
+	/**
+	 * @param out Stream to write the PNG data to
+	 * @param width Image width in pixels
+	 * @param height Image height in pixels; exactly this many rows must be written
+	 * @param pal Color palette
+	 * @param trns_index Palette entry to use for transparency
+	 * @param compression Compression settings
+	 */
+	png_row_writer(std::ostream & out,
+		uint const width,
+		uint const height,
+		palette const & pal,
+		std::optional<uint8> trns_index = std::nullopt,
+		png_compression const & compression = {});
+
+	/**
+	 * @brief Writes a direct color PNG with alpha, for rows of RGBA pixels
+	 */
+	png_row_writer(std::ostream & out, uint const width, uint const height, png_compression const & compression = {});
+
+	png_row_writer(png_row_writer const &) = delete;
+	png_row_writer & operator=(png_row_writer const &) = delete;
+
+	~png_row_writer();
+
+	/**
+	 * @brief Write the next row of pixels
+	 * @param row Pointer to one row (width pixels) of image data
+	 */
+	void write_row(pixel const * row);
+
+	/**
+	 * @brief Write the next row of pixels to an RGBA PNG
+	 */
+	void write_row(rgba_color const * row);
+
+	/**
+	 * @brief Write each row of an image or image region in turn
+	 */
+	void write_rows(const_image_view const & rows);
+
+	void write_rows(motoi::const_image_view<rgba_color> const & rows);
+
+	/**
+	 * @brief Complete the PNG after all rows have been written
+	 */
+	void finish();
+};
+
 } // namespace chrgfx
 
 #endif
@@ -1,112 +1,219 @@
 #include "imaging.hpp"
 #include "image.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #ifdef DEBUG
 #include <iostream>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 using namespace std;
 
 namespace chrgfx
 {
 
-image render_tileset(
-	chrdef const & chrdef, byte_t const * in_tileset, size_t const in_tileset_datasize, render_config const & render_cfg)
+/*
+	Copies each tile to its position in the output. Tile rows are copied whole, with the common 8 pixel width handled
+	as a single word so that the copy is inlined.
+*/
+static void blit_tiles(
+	chrdef const & chrdef, byte_t const * in_tileset, tile_layout const & layout, image_view const & out_view)
 {
-	auto const chr_width {chrdef.width()}, chr_height {chrdef.height()};
-	size_t const chr_datasize {chr_width * chr_height};
+	size_t const chr_width {chrdef.width()}, chr_height {chrdef.height()}, stride {out_view.stride()};
+
+#ifdef DEBUG
+	cerr << dec;
+	cerr << "TILESET RENDERING REPORT:\n";
+	cerr << "\tTile count: " << layout.positions.size() << '\n';
+	cerr << "\tOut tile data size: " << chr_width * chr_height << '\n';
+	cerr << "\tPixel dimensions: " << layout.width << 'x' << layout.height << '\n';
+#endif
+
+	auto ptr_in_pxlrow {in_tileset};
+	for (auto const & position : layout.positions)
+	{
+		pixel * ptr_out_pxlrow {out_view.pixel_map_row(position.y) + position.x};
+		for (size_t i_chr_pxlrow {0}; i_chr_pxlrow < chr_height; ++i_chr_pxlrow)
+		{
+			if (chr_width == 8)
+				memcpy(ptr_out_pxlrow, ptr_in_pxlrow, 8);
+			else
+				copy_n(ptr_in_pxlrow, chr_width, ptr_out_pxlrow);
+			ptr_in_pxlrow += chr_width;
+			ptr_out_pxlrow += stride;
+		}
+	}
+}
+
+/*
+	Validates the input and works out the position of each tile in the rendered tileset; shared by all forms of
+	render_tileset
+*/
+static tile_layout layout_tileset(
+	chrdef const & chrdef, size_t const in_tileset_datasize, render_config const & render_cfg)
+{
+	size_t const chr_datasize {chrdef.width() * chrdef.height()};
 
 	if (chr_datasize == 0)
 		throw invalid_argument("Invalid tile dimension(s)");
 
+	if (render_cfg.row_size == 0)
+		throw invalid_argument("Invalid row size");
+
 	if (in_tileset_datasize < chr_datasize)
 		throw invalid_argument("Not enough data in buffer to render a single tile");
 
-	size_t const
-		// number of tiles in the final image
-		chr_count {in_tileset_datasize / chr_datasize},
-		// number of excess chrs that make up the final row
-		chr_excess_count {chr_count % render_cfg.row_size},
-		// final image dimensions (in tiles)
-		// we don't consider the excess tile row, if present, when calculating the
-		// outimg_chrheight value so that it can be used in the first processing loop
-		outimg_chrwidth {render_cfg.row_size}, outimg_chrheight {chr_count / outimg_chrwidth},
-		// data size of one full row of chrs
-		// (used for pointer offsetting)
-		chrrow_datasize {chr_datasize * outimg_chrwidth},
-		// final image dimensions (in pixels)
-		// (for processing purposes, outimg_pxlwidth is synonymous with stride)
-		outimg_pxlwidth {outimg_chrwidth * chr_width},
-		outimg_pxlheight {(outimg_chrheight + (chr_excess_count > 0 ? 1 : 0)) * chr_height};
-
-	image out_image(outimg_pxlwidth, outimg_pxlheight);
-
-	// iters and cached values and such for processing
-	size_t
-		// number of tiles in the current chr row; this will be constant until the
-		// final row if there was a chr excess
-		this_chrrow_chrcount {outimg_chrwidth},
-		// offset to start of the pixel row in the next chr from the end of the
-		// previous
-		next_chr {chr_datasize - chr_width};
-
-	// input ptrs
-	byte_t const
-		// pointer to start of current tile row
-		*ptr_in_chrrow {in_tileset},
-		// pointer to start of the current pixel row within the current tile row
-		*ptr_in_pxlrow {ptr_in_chrrow},
-		// pointer to the start of the current pixel row within the current tile
-		*ptr_in_chrpxlrow {ptr_in_pxlrow};
-
-	// output ptrs
-	pixel * ptr_out_pxl {out_image.pixel_map()};
+	return layout_tiles(
+		render_cfg.arrangement, chrdef.width(), chrdef.height(), render_cfg.row_size, in_tileset_datasize / chr_datasize);
+}
 
-#ifdef DEBUG
-	cerr << dec;
-	cerr << "TILESET RENDERING REPORT:\n";
-	cerr << "\tTile count: " << chr_count << '\n';
-	cerr << "\tFinal row excess tiles: " << chr_excess_count << '\n';
-	cerr << "\tOut tile data size: " << chr_datasize << '\n';
-	cerr << "\tPixel dimensions: " << outimg_pxlwidth << 'x' << outimg_pxlheight << '\n';
-	cerr << "\tTile dimensions: " << outimg_chrwidth << 'x' << outimg_chrheight << '\n';
+pair<uint, uint> tileset_dimensions(
+	chrdef const & chrdef, size_t const in_tileset_datasize, render_config const & render_cfg)
+{
+	auto const layout {layout_tileset(chrdef, in_tileset_datasize, render_cfg)};
+	return {layout.width, layout.height};
+}
+
+image render_tileset(
+	chrdef const & chrdef, byte_t const * in_tileset, size_t const in_tileset_datasize, render_config const & render_cfg)
+{
+	auto const layout {layout_tileset(chrdef, in_tileset_datasize, render_cfg)};
+	image out_image(layout.width, layout.height);
+	blit_tiles(chrdef, in_tileset, layout, out_image);
+	return out_image;
+}
+
+void render_tileset(chrdef const & chrdef,
+	byte_t const * in_tileset,
+	size_t const in_tileset_datasize,
+	render_config const & render_cfg,
+	image_view const & out_view)
+{
+	auto const layout {layout_tileset(chrdef, in_tileset_datasize, render_cfg)};
+
+	if (out_view.width() < layout.width || out_view.height() < layout.height)
+		throw invalid_argument("Output region too small for rendered tileset");
+
+	blit_tiles(chrdef, in_tileset, layout, out_view);
+}
+
+/*
+	Each palette line used is expanded to a table holding the color of every pixel value, so that rendering is a single
+	lookup per pixel, straight from the tileset to the output image.
+
+	With SSSE3, tiles of up to 4bpp are looked up 8 pixels at a time: each channel of the first 16 entries of a table
+	fits in one register, and a byte shuffle with the pixel values as the indices selects from all 16 at once. The four
+	channels are then interleaved into RGBA pixels.
+*/
+struct line_table
+{
+	array<rgba_color, 256> colors;
+#ifdef __SSSE3__
+	__m128i red, green, blue, alpha;
 #endif
+};
 
-	// for each tile row...
-	for (uint i_chrrow = 0; i_chrrow < outimg_chrheight; ++i_chrrow)
+static void expand_pixels(
+	byte_t const * in, rgba_color * out, size_t const count, line_table const & table, [[maybe_unused]] bool const shuffle)
+{
+	size_t i {0};
+#ifdef __SSSE3__
+	if (shuffle)
 	{
-		// for each pixel row within the tile row...
-		for (auto i_chr_pxlrow = 0; i_chr_pxlrow < chr_height; ++i_chr_pxlrow)
+		for (; i + 8 <= count; i += 8)
 		{
-			// for each tile within the pixel row...
-			for (auto i_chrcol = 0; i_chrcol < this_chrrow_chrcount; ++i_chrcol)
-			{
-				// for each [tile-width] pixel...
-				for (auto i = 0; i < chr_width; ++i)
-					*ptr_out_pxl++ = *ptr_in_chrpxlrow++;
-				ptr_in_chrpxlrow += next_chr;
-			}
-			ptr_in_chrpxlrow = ptr_in_pxlrow += chr_width;
+			auto const indices {_mm_loadl_epi64(reinterpret_cast<__m128i const *>(in + i))};
+			auto const red_green {
+				_mm_unpacklo_epi8(_mm_shuffle_epi8(table.red, indices), _mm_shuffle_epi8(table.green, indices))},
+				blue_alpha {
+					_mm_unpacklo_epi8(_mm_shuffle_epi8(table.blue, indices), _mm_shuffle_epi8(table.alpha, indices))};
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi16(red_green, blue_alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 4), _mm_unpackhi_epi16(red_green, blue_alpha));
 		}
-		ptr_in_chrpxlrow = ptr_in_pxlrow = ptr_in_chrrow += chrrow_datasize;
 	}
+#endif
+	for (; i < count; ++i)
+		out[i] = table.colors[in[i]];
+}
+
+motoi::image<rgba_color> render_tileset_rgba(chrdef const & chrdef,
+	byte_t const * in_chrset,
+	size_t const in_chrset_datasize,
+	render_config const & render_cfg,
+	vector<rgb_color> const & bank,
+	uint const line_size,
+	uint8 const * tile_lines,
+	size_t const tile_lines_count)
+{
+	auto const layout {layout_tileset(chrdef, in_chrset_datasize, render_cfg)};
+
+	if (line_size == 0)
+		throw invalid_argument("Invalid palette line size");
+	if (bank.empty())
+		throw invalid_argument("Palette bank is empty");
+
+	size_t const chr_width {chrdef.width()}, chr_height {chrdef.height()}, chr_datasize {chr_width * chr_height},
+		bank_lines {(bank.size() + line_size - 1) / line_size},
+		chr_count {layout.positions.size()}, listed_count {min(tile_lines_count, chr_count)};
 
-	// output the remaining row if there are excess tiles
-	// TODO maybe someday: Do Not Repeat Yourself with this code and the above, somehow
-	if (chr_excess_count > 0)
+	// tables are only made for the lines up to the highest one used
+	size_t const used_lines {
+		listed_count == 0 ? 1u : (size_t) *max_element(tile_lines, tile_lines + listed_count) + 1};
+	if (used_lines > bank_lines)
+		throw out_of_range("Tile palette line is beyond the end of the palette bank");
+
+	vector<line_table> tables(used_lines);
+	for (size_t i_line {0}; i_line < used_lines; ++i_line)
 	{
-		auto next_row = (outimg_pxlwidth - (chr_excess_count * chr_width));
-		for (auto i_chr_pxlrow = 0; i_chr_pxlrow < chr_height; ++i_chr_pxlrow)
+		auto & table {tables[i_line]};
+		for (size_t i_entry {0}; i_entry < table.colors.size(); ++i_entry)
+		{
+			size_t const bank_index {(i_line * line_size) + i_entry};
+			bool const transparent {render_cfg.trns_index && i_entry == *render_cfg.trns_index};
+			table.colors[i_entry] = bank_index < bank.size() ? rgba_color(bank[bank_index], transparent ? 0 : 255)
+																											 : rgba_color(0, 0, 0, transparent ? 0 : 255);
+		}
+#ifdef __SSSE3__
+		byte_t channels[4][16];
+		for (size_t i_entry {0}; i_entry < 16; ++i_entry)
 		{
-			for (auto i_chrcol = 0; i_chrcol < chr_excess_count; ++i_chrcol)
-			{
-				for (auto i = 0; i < chr_width; ++i)
-					*ptr_out_pxl++ = *ptr_in_chrpxlrow++;
-				ptr_in_chrpxlrow += next_chr;
-			}
-			ptr_out_pxl += next_row;
-			ptr_in_chrpxlrow = ptr_in_pxlrow += chr_width;
+			channels[0][i_entry] = table.colors[i_entry].red;
+			channels[1][i_entry] = table.colors[i_entry].green;
+			channels[2][i_entry] = table.colors[i_entry].blue;
+			channels[3][i_entry] = table.colors[i_entry].alpha;
 		}
+		table.red = _mm_loadu_si128(reinterpret_cast<__m128i const *>(channels[0]));
+		table.green = _mm_loadu_si128(reinterpret_cast<__m128i const *>(channels[1]));
+		table.blue = _mm_loadu_si128(reinterpret_cast<__m128i const *>(channels[2]));
+		table.alpha = _mm_loadu_si128(reinterpret_cast<__m128i const *>(channels[3]));
+#endif
+	}
+
+	// pixel values in a tileset are always within the bit depth, so a 16 entry shuffle covers them up to 4bpp
+	bool const shuffle {chrdef.bpp() <= 4};
+
+	// value initialized, so areas not covered by tiles are transparent
+	motoi::image<rgba_color> out_image(layout.width, layout.height);
+	auto ptr_in_chr {in_chrset};
+	for (size_t i_chr {0}; i_chr < chr_count; ++i_chr)
+	{
+		auto const & table {tables[i_chr < listed_count ? tile_lines[i_chr] : 0]};
+		auto const & position {layout.positions[i_chr]};
+		for (size_t i_pxlrow {0}; i_pxlrow < chr_height; ++i_pxlrow)
+			expand_pixels(ptr_in_chr + (i_pxlrow * chr_width),
+				out_image.pixel_map_row(position.y + i_pxlrow) + position.x,
+				chr_width,
+				table,
+				shuffle);
+		ptr_in_chr += chr_datasize;
 	}
 
 	return out_image;
@@ -117,13 +224,23 @@ static uint const swatch_size {32};
 
 image render_palette(paldef const & paldef, coldef const & coldef, byte_t const * in_palette)
 {
-	auto const row_width {paldef.length() * swatch_size};
-	image out_image(row_width, swatch_size);
-
-	auto ptr_out_palstart {out_image.pixel_map()}, ptr_out_swatchpixel {ptr_out_palstart};
+	image out_image(paldef.length() * swatch_size, swatch_size);
 
 	palette workpal;
 	decode_pal(paldef, coldef, in_palette, &workpal);
+	render_palette(paldef, out_image);
+	out_image.set_color_map(workpal);
+
+	return out_image;
+}
+
+void render_palette(paldef const & paldef, image_view const & out_view)
+{
+	auto const row_width {paldef.length() * swatch_size};
+	if (out_view.width() < row_width || out_view.height() < swatch_size)
+		throw invalid_argument("Output region too small for rendered palette");
+
+	auto ptr_out_palstart {out_view.pixel_map()}, ptr_out_swatchpixel {ptr_out_palstart};
 
 	// fill one line...
 	for (auto iter_color_index {0}; iter_color_index < paldef.length(); ++iter_color_index)
@@ -134,11 +251,8 @@ image render_palette(paldef const & paldef, coldef const & coldef, byte_t const
 	// duplicate that line
 	for (auto iter_pixel_row {1}; iter_pixel_row < swatch_size; ++iter_pixel_row)
 	{
-		copy(ptr_out_palstart, ptr_out_palstart + row_width, ptr_out_palstart + (iter_pixel_row * row_width));
+		copy(ptr_out_palstart, ptr_out_palstart + row_width, out_view.pixel_map_row(iter_pixel_row));
 	}
-	out_image.set_color_map(workpal);
-
-	return out_image;
 }
 
 motoi::image<rgb_color> render_palette_full(
@@ -176,82 +290,108 @@ motoi::image<rgb_color> render_palette_full(
 	return out_image;
 }
 
-void make_tileset(chrdef const & chrdef, image const & in_image, byte_t * out_tileset)
+void make_tileset(
+	chrdef const & chrdef, const_image_view const & in_image, byte_t * out_tileset, tile_arrangement const & arrangement)
 {
-	// pseudo:
-	// - get dimensions, divide by tile width
-	// - width in chrs, height in chrs
-	// - chrw * chrh = total tile count, provision vector<chr>
-	// - src image pixel row counter = 0
-	// - for each chr row
-	// -- for each pixel row (tile height pixel rows)
-	// --- curr pixel row = get_row(src image pixel row counter ++)
-	// --- for each chr column
-	// ---- read curr pixel row 8 pixels, store into output vector of chrs
-
-	// clang-format off
-	size_t const
-		tile_width {chrdef.width()},
-		tile_height {chrdef.height()},
-		image_width {in_image.width()},
-		image_height {in_image.height()};
-	// clang-format on
+	size_t const tile_width {chrdef.width()}, tile_height {chrdef.height()};
 
 	if (tile_width == 0 || tile_height == 0)
 		throw invalid_argument("Invalid tile dimensions");
 
-	if (image_width < tile_width || image_height < tile_height)
+	if (in_image.width() < tile_width || in_image.height() < tile_height)
 		throw invalid_argument("Source image too small to form a tile");
 
-	// clang-format off
-	size_t const
-		tile_datasize {tile_width * tile_height},
-		// input image dimensions (in tiles)
-		image_tilewidth {image_width / tile_width},
-		image_tileheight {image_height / tile_height},
-		tilerow_datasize {tile_datasize * image_tilewidth},
-		// offset to start of the same pixel row in the next tile from the end of the current tile's pixel row
-		next_tile {tile_datasize - tile_width};
-
-	// iters and counters
-	size_t 
-		i_tile_row {0},
-		i_tile_pixelrow {0},
-		i_tile_column {0};
-
-	// input ptrs
-	byte_t const
-		// pointer to current pixel
-		* ptr_in_pixel {in_image.pixel_map()};
-
-	// output ptrs
-	byte_t
-		// pointer to start of current tile row
-		*ptr_out_tilerow {out_tileset},
-		// pointer to start of the current pixel row within the current tile row
-		*ptr_out_pixelrow {ptr_out_tilerow},
-		// pointer to current pixel
-		*ptr_out_pixel {ptr_out_pixelrow};
-	// clang-format on
-
-	// for each tile row...
-	for (i_tile_row = 0; i_tile_row < image_tileheight; ++i_tile_row)
+	/*
+		The inverse of blit_tiles: each tile is gathered from its position in the image, so the output is written in tile
+		order in a single pass, whatever the arrangement
+	*/
+	auto const layout {layout_image_tiles(arrangement, tile_width, tile_height, in_image.width(), in_image.height())};
+	size_t const stride {in_image.stride()};
+
+	auto ptr_out_pxlrow {out_tileset};
+	for (auto const & position : layout.positions)
 	{
-		// for each pixel row within the tile row...
-		for (i_tile_pixelrow = 0; i_tile_pixelrow < tile_height; ++i_tile_pixelrow)
+		pixel const * ptr_in_pxlrow {in_image.pixel_map_row(position.y) + position.x};
+		for (size_t i_tile_pxlrow {0}; i_tile_pxlrow < tile_height; ++i_tile_pxlrow)
 		{
-			// for each tile within the pixel row...
-			for (i_tile_column = 0; i_tile_column < image_tilewidth; ++i_tile_column)
-			{
-				// for each [tile-width] pixel...
-				for (auto i {0}; i < tile_width; ++i)
-					*ptr_out_pixel++ = *ptr_in_pixel++;
-				ptr_out_pixel += next_tile;
-			}
-			ptr_out_pixel = ptr_out_pixelrow += tile_width;
+			if (tile_width == 8)
+				memcpy(ptr_out_pxlrow, ptr_in_pxlrow, 8);
+			else
+				copy_n(ptr_in_pxlrow, tile_width, ptr_out_pxlrow);
+			ptr_in_pxlrow += stride;
+			ptr_out_pxlrow += tile_width;
 		}
-		ptr_out_pixel = ptr_out_pixelrow = ptr_out_tilerow += tilerow_datasize;
 	}
 }
 
+vector<uint64_t> hash_tileset(chrdef const & chrdef, byte_t const * in_chrset, size_t const in_chrset_datasize)
+{
+	size_t const tile_datasize {chrdef.width() * chrdef.height()};
+	if (tile_datasize == 0)
+		throw invalid_argument("Invalid tile dimensions");
+
+	vector<uint64_t> out(in_chrset_datasize / tile_datasize);
+	for (auto & hash : out)
+	{
+		hash = fnv1a_64(in_chrset, tile_datasize);
+		in_chrset += tile_datasize;
+	}
+	return out;
+}
+
+/*
+	Returns true if any byte is greater than max_value, using SSE2 max/compare on the bulk of the data
+*/
+static bool exceeds(byte_t const * data, size_t const datasize, byte_t const max_value)
+{
+	size_t i {0};
+#ifdef __SSE2__
+	if (datasize >= 16)
+	{
+		auto const limit {_mm_set1_epi8(static_cast<char>(max_value))};
+		auto acc {limit};
+		for (; i + 16 <= datasize; i += 16)
+			acc = _mm_max_epu8(acc, _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i)));
+		// every lane is still equal to the limit only if no byte was larger
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, limit)) != 0xffff)
+			return true;
+	}
+#endif
+	for (; i < datasize; ++i)
+		if (data[i] > max_value)
+			return true;
+	return false;
+}
+
+vector<size_t> find_out_of_range_tiles(chrdef const & chrdef, byte_t const * in_chrset, size_t const in_chrset_datasize)
+{
+	size_t const tile_datasize {chrdef.width() * chrdef.height()};
+	if (tile_datasize == 0)
+		throw invalid_argument("Invalid tile dimensions");
+
+	vector<size_t> out;
+	// every byte value is a valid pixel at 8bpp and above
+	if (chrdef.bpp() >= 8)
+		return out;
+
+	byte_t const max_value {static_cast<byte_t>((1u << chrdef.bpp()) - 1)};
+	size_t const tile_count {in_chrset_datasize / tile_datasize},
+		// out of range pixels are rare, so large groups of tiles are checked at once and only a group which fails is
+		// checked tile by tile
+		group_size {max<size_t>(1, 4096 / tile_datasize)};
+
+	for (size_t i_group {0}; i_group < tile_count; i_group += group_size)
+	{
+		size_t const group_count {min(group_size, tile_count - i_group)};
+		auto const ptr_group {in_chrset + (i_group * tile_datasize)};
+		if (! exceeds(ptr_group, group_count * tile_datasize, max_value))
+			continue;
+
+		for (size_t i_tile {0}; i_tile < group_count; ++i_tile)
+			if (exceeds(ptr_group + (i_tile * tile_datasize), tile_datasize, max_value))
+				out.push_back(i_group + i_tile);
+	}
+	return out;
+}
+
 } // namespace chrgfx
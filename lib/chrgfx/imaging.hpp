@@ -5,6 +5,7 @@
  * @brief Tileset conversion functions
  */
 
+#include "arrangement.hpp"
 #include "chrdef.hpp"
 #include "coldef.hpp"
 #include "image_types.hpp"
@@ -12,6 +13,8 @@
 #include "paldef.hpp"
 #include "types.hpp"
 #include <optional>
+#include <utility>
+#include <vector>
 
 #ifndef __CHRGFX__IMAGING_HPP
 #define __CHRGFX__IMAGING_HPP
@@ -33,6 +36,12 @@ public:
 	 */
 	uint row_size {DEFAULT_ROW_SIZE};
 
+	/**
+	 * @brief Placement of the tiles within the output image
+	 *
+	 */
+	tile_arrangement arrangement;
+
 	/**
 	 * @brief Palette entry to use for transparency
 	 *
@@ -51,6 +60,50 @@ public:
 image render_tileset(
 	chrdef const & chrdef, byte_t const * in_chrset, size_t const in_chrset_datasize, render_config const & render_cfg);
 
+/**
+ * @brief Renders a basic tileset into an existing image region
+ * @details Only the pixels covered by tiles are written; the rest of the region is left untouched. This allows rendering
+ * directly into part of a larger image.
+ *
+ * @param out_view Region to render into; must be at least the size returned by tileset_dimensions
+ */
+void render_tileset(chrdef const & chrdef,
+	byte_t const * in_chrset,
+	size_t const in_chrset_datasize,
+	render_config const & render_cfg,
+	image_view const & out_view);
+
+/**
+ * @brief Renders a basic tileset to a direct color image, with each tile drawn in its own palette line
+ * @details As on hardware where each tile or sprite selects a palette line, the color of a pixel is entry (line *
+ * line_size + pixel value) of the palette bank. This allows a sprite bank using several palettes to be viewed with the
+ * correct colors. If a transparent entry is set in render_cfg, that entry within every line is transparent, as are
+ * any pixels not covered by tiles.
+ *
+ * @param chrdef Tile encoding definition
+ * @param in_chrset Pointer to input basic tileset
+ * @param in_chrset_datasize Size of input basic tileset in bytes
+ * @param render_cfg Tileset rendering options
+ * @param bank Colors of all palette lines, one line after another
+ * @param line_size Number of entries in each palette line
+ * @param tile_lines Palette line of each tile; tiles beyond the end of the list use line 0
+ * @param tile_lines_count Number of entries in tile_lines
+ */
+motoi::image<rgba_color> render_tileset_rgba(chrdef const & chrdef,
+	byte_t const * in_chrset,
+	size_t const in_chrset_datasize,
+	render_config const & render_cfg,
+	std::vector<rgb_color> const & bank,
+	uint const line_size,
+	uint8 const * tile_lines,
+	size_t const tile_lines_count);
+
+/**
+ * @brief Returns the width and height in pixels of a rendered tileset
+ */
+std::pair<uint, uint> tileset_dimensions(
+	chrdef const & chrdef, size_t const in_chrset_datasize, render_config const & render_cfg);
+
 /**
  * @brief Renders a palette as color swatches in an indexed bitmap image
  *
@@ -60,6 +113,14 @@ image render_tileset(
  */
 image render_palette(paldef const & paldef, coldef const & coldef, byte_t const * in_palette);
 
+/**
+ * @brief Renders palette swatches into an existing image region
+ * @details The swatches use the palette indices directly, so the palette itself is not needed here
+ *
+ * @param out_view Region to render into; must be at least (palette length * 32) x 32 pixels
+ */
+void render_palette(paldef const & paldef, image_view const & out_view);
+
 /**
  * @brief Renders an arbitrary collection of palette lines as color swatches in a direct color bitmap image
  *
@@ -72,13 +133,46 @@ motoi::image<rgb_color> render_palette_full(
 
 /**
  * @brief Returns a collection of basic tiles (tileset) from the given bitmap image
+ * @details Pixels to the right and below the last full tile are ignored. Either a whole image or a view of a region
+ * within one may be passed.
+ *
+ * With an arrangement, the tiles are taken in the order described by it, as rendered by render_tileset, so that a sheet
+ * laid out in groups is stored in the order the hardware expects. Only whole groups are taken, and gutters are
+ * skipped; the number of tiles is the size of the layout returned by layout_image_tiles.
  *
  * @param chrdef Tile encoding definition
  * @param in_bitmap Input bitmap image
  * @param out_chrset Pointer to output basic tileset
+ * @param arrangement Placement of the tiles within the image
+ *
+ */
+void make_tileset(chrdef const & chrdef,
+	const_image_view const & in_bitmap,
+	byte_t * out_chrset,
+	tile_arrangement const & arrangement = {});
+
+/**
+ * @brief Returns a hash of each tile in a basic tileset
+ * @details The hashes depend only on the pixels of each tile and are the same on every platform, so they can be kept
+ * and compared with those from a later run to find the tiles which have changed
  *
+ * @param chrdef Tile encoding definition
+ * @param in_chrset Pointer to input basic tileset
+ * @param in_chrset_datasize Size of input basic tileset in bytes
+ */
+std::vector<uint64_t> hash_tileset(chrdef const & chrdef, byte_t const * in_chrset, size_t const in_chrset_datasize);
+
+/**
+ * @brief Returns the index of each tile in a basic tileset with a pixel value too large for the tile format
+ * @details encode_chr keeps only the low bpp bits of each pixel, so such tiles would be silently corrupted. The check
+ * runs at close to memory speed, and is cheap enough to make before every encode.
+ *
+ * @param chrdef Tile encoding definition
+ * @param in_chrset Pointer to input basic tileset
+ * @param in_chrset_datasize Size of input basic tileset in bytes
  */
-void make_tileset(chrdef const & chrdef, image const & in_bitmap, byte_t * out_chrset);
+std::vector<size_t> find_out_of_range_tiles(
+	chrdef const & chrdef, byte_t const * in_chrset, size_t const in_chrset_datasize);
 
 } // namespace chrgfx
 
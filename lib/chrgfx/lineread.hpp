@@ -12,8 +12,10 @@
 #ifndef __MOTOI__LINEREAD_HPP
 #define __MOTOI__LINEREAD_HPP
 
-#include "filesys.hpp"
+#include <cerrno>
+#include <fstream>
 #include <string>
+#include <system_error>
 
 namespace motoi
 {
@@ -32,7 +34,11 @@ public:
 	linereader() = delete;
 	linereader(std::string const filepath) :
 			m_filepath {filepath},
-			m_ifstream {motoi::ifstream_checked(m_filepath)} {};
+			m_ifstream {m_filepath}
+	{
+		if (! m_ifstream.good())
+			throw std::system_error(errno, std::generic_category(), "Could not open \"" + m_filepath + "\" for read");
+	}
 
 	/**
 	 * @return size_t The current line number.
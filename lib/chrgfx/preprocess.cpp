@@ -0,0 +1,202 @@
+#include "preprocess.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace chrgfx
+{
+
+/*
+	Each transform has an SSE2 loop for the bulk of the data, with a scalar loop for the remainder (and for platforms
+	without SSE2, where the compiler is left to vectorize the scalar loop as it can).
+*/
+
+static void byteswap16(byte_t * data, size_t const datasize)
+{
+	size_t i {0};
+#ifdef __SSE2__
+	for (; i + 16 <= datasize; i += 16)
+	{
+		auto v {_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i))};
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), v);
+	}
+#endif
+	for (; i + 2 <= datasize; i += 2)
+		swap(data[i], data[i + 1]);
+}
+
+static void byteswap32(byte_t * data, size_t const datasize)
+{
+	size_t i {0};
+#ifdef __SSE2__
+	for (; i + 16 <= datasize; i += 16)
+	{
+		auto v {_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i))};
+		// swap the bytes within each word, then the words within each dword
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(_mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), v);
+	}
+#endif
+	for (; i + 4 <= datasize; i += 4)
+	{
+		swap(data[i], data[i + 3]);
+		swap(data[i + 1], data[i + 2]);
+	}
+}
+
+static byte_t reverse_bits(byte_t b)
+{
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	return b;
+}
+
+static void bitreverse(byte_t * data, size_t const datasize)
+{
+	size_t i {0};
+#ifdef __SSE2__
+	// the same swaps as reverse_bits; the masks keep bits from crossing into the neighbouring byte of each 16 bit lane
+	auto const mask4 {_mm_set1_epi8(0x0f)}, mask2 {_mm_set1_epi8(0x33)}, mask1 {_mm_set1_epi8(0x55)};
+	for (; i + 16 <= datasize; i += 16)
+	{
+		auto v {_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i))};
+		v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), mask4), _mm_slli_epi16(_mm_and_si128(v, mask4), 4));
+		v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 2), mask2), _mm_slli_epi16(_mm_and_si128(v, mask2), 2));
+		v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), mask1), _mm_slli_epi16(_mm_and_si128(v, mask1), 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), v);
+	}
+#endif
+	for (; i < datasize; ++i)
+		data[i] = reverse_bits(data[i]);
+}
+
+static void deinterleave(byte_t * data, size_t const datasize, uint const ways)
+{
+	size_t const way_size {datasize / ways};
+	vector<byte_t> work(way_size * ways);
+	size_t i {0};
+#ifdef __SSE2__
+	if (ways == 2)
+	{
+		auto const low_bytes {_mm_set1_epi16(0x00ff)};
+		auto * out_even {work.data()};
+		auto * out_odd {work.data() + way_size};
+		for (; i + 16 <= way_size; i += 16)
+		{
+			auto const a {_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i * 2))},
+				b {_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i * 2 + 16))};
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out_even + i),
+				_mm_packus_epi16(_mm_and_si128(a, low_bytes), _mm_and_si128(b, low_bytes)));
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(out_odd + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+		}
+	}
+#endif
+	for (; i < way_size; ++i)
+		for (uint way {0}; way < ways; ++way)
+			work[way * way_size + i] = data[i * ways + way];
+	copy(work.begin(), work.end(), data);
+}
+
+static void interleave(byte_t * data, size_t const datasize, uint const ways)
+{
+	size_t const way_size {datasize / ways};
+	vector<byte_t> work(way_size * ways);
+	size_t i {0};
+#ifdef __SSE2__
+	if (ways == 2)
+	{
+		auto const * in_even {data};
+		auto const * in_odd {data + way_size};
+		for (; i + 16 <= way_size; i += 16)
+		{
+			auto const even {_mm_loadu_si128(reinterpret_cast<__m128i const *>(in_even + i))},
+				odd {_mm_loadu_si128(reinterpret_cast<__m128i const *>(in_odd + i))};
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(work.data() + i * 2), _mm_unpacklo_epi8(even, odd));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(work.data() + i * 2 + 16), _mm_unpackhi_epi8(even, odd));
+		}
+	}
+#endif
+	for (; i < way_size; ++i)
+		for (uint way {0}; way < ways; ++way)
+			work[i * ways + way] = data[way * way_size + i];
+	copy(work.begin(), work.end(), data);
+}
+
+void apply_transform(data_transform const & transform, byte_t * data, size_t const datasize)
+{
+	switch (transform.op)
+	{
+		case transform_op::byteswap16:
+			byteswap16(data, datasize);
+			break;
+		case transform_op::byteswap32:
+			byteswap32(data, datasize);
+			break;
+		case transform_op::bitreverse:
+			bitreverse(data, datasize);
+			break;
+		case transform_op::deinterleave:
+		case transform_op::interleave:
+			if (transform.ways < 2)
+				throw invalid_argument("Interleave must have at least two ways");
+			if (transform.op == transform_op::deinterleave)
+				deinterleave(data, datasize, transform.ways);
+			else
+				interleave(data, datasize, transform.ways);
+			break;
+	}
+}
+
+void apply_transforms(transform_chain const & chain, byte_t * data, size_t const datasize)
+{
+	for (auto const & transform : chain)
+		apply_transform(transform, data, datasize);
+}
+
+transform_chain inverse_transforms(transform_chain const & chain)
+{
+	transform_chain inverse(chain.rbegin(), chain.rend());
+	for (auto & transform : inverse)
+	{
+		if (transform.op == transform_op::deinterleave)
+			transform.op = transform_op::interleave;
+		else if (transform.op == transform_op::interleave)
+			transform.op = transform_op::deinterleave;
+	}
+	return inverse;
+}
+
+size_t transform_block_size(transform_chain const & chain)
+{
+	size_t block_size {1};
+	for (auto const & transform : chain)
+	{
+		switch (transform.op)
+		{
+			case transform_op::byteswap16:
+				block_size = lcm(block_size, (size_t) 2);
+				break;
+			case transform_op::byteswap32:
+				block_size = lcm(block_size, (size_t) 4);
+				break;
+			case transform_op::bitreverse:
+				break;
+			case transform_op::deinterleave:
+			case transform_op::interleave:
+				return 0;
+		}
+	}
+	return block_size;
+}
+
+} // namespace chrgfx
@@ -0,0 +1,77 @@
+/**
+ * @file preprocess.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Byte level transforms for preparing raw data for a chrdef
+ *
+ * Dumps are not always in the form a chrdef expects: data from a big endian bus may need byte swapping, or data from
+ * several chips may have been merged with its bytes alternating. The transforms here convert such data in place, at
+ * close to memory speed, so that it can be decoded directly.
+ */
+
+#ifndef __CHRGFX__PREPROCESS_HPP
+#define __CHRGFX__PREPROCESS_HPP
+
+#include "types.hpp"
+#include <vector>
+
+namespace chrgfx
+{
+
+enum class transform_op
+{
+	// swap the byte order of each 16 bit word
+	byteswap16,
+	// swap the byte order of each 32 bit word
+	byteswap32,
+	// reverse the order of the bits in each byte
+	bitreverse,
+	// gather every Nth byte together: for 2 ways, the even bytes followed by the odd bytes
+	deinterleave,
+	// the inverse of deinterleave
+	interleave
+};
+
+struct data_transform
+{
+	transform_op op;
+
+	/**
+	 * @brief Number of ways for (de)interleave; unused by the other operations
+	 */
+	uint ways {2};
+};
+
+/**
+ * @brief A series of transforms, applied in order
+ */
+using transform_chain = std::vector<data_transform>;
+
+/**
+ * @brief Apply a transform to data in place
+ * @note Any trailing bytes which do not form a whole word (or, for (de)interleave, a whole group of ways) are left
+ * unchanged
+ */
+void apply_transform(data_transform const & transform, byte_t * data, size_t const datasize);
+
+/**
+ * @brief Apply each transform in a chain to data in place
+ */
+void apply_transforms(transform_chain const & chain, byte_t * data, size_t const datasize);
+
+/**
+ * @brief Returns the chain which undoes the given chain
+ */
+transform_chain inverse_transforms(transform_chain const & chain);
+
+/**
+ * @brief Returns the block size at which a chain can be applied piecewise
+ * @details Transforms such as byte swapping only affect bytes within the same word, so applying them to each block of
+ * a multiple of this size gives the same result as applying them to all the data at once. (De)interleaving moves bytes
+ * across the whole buffer, and for a chain containing it, 0 is returned.
+ */
+size_t transform_block_size(transform_chain const & chain);
+
+} // namespace chrgfx
+
+#endif
@@ -0,0 +1,1045 @@
+#include "quantize.hpp"
+#include "colconv.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace chrgfx
+{
+
+/*
+	Quantization is done in a few passes:
+	- the distinct colors in each band of rows are sorted and counted by separate threads, then combined
+	- each distinct color is reduced to the color the color format would actually store for it, and the counts of colors
+		which become the same are combined
+	- the reduced colors are split by median cut into one box per palette entry, and each entry is the (reduced) average
+		of its box
+	- each reduced color is matched with its nearest palette entry, and the pixels are mapped through that table in bands
+	Only the first and last passes touch every pixel; the rest work on the distinct colors, of which there are usually
+	far fewer.
+
+	When dithering, pixels no longer map to one entry per distinct color, so they are instead matched through a table
+	over a grid of colors (inverse_color_map).
+*/
+
+struct color_count
+{
+	uint32 color;
+	uint64_t count;
+};
+
+struct color_box
+{
+	size_t first;
+	size_t last;
+	// sum of squared distances from the mean, over all of the pixels
+	double error;
+	// the channel with the widest spread, along which the box is split
+	uint axis;
+};
+
+static uint32 pack_rgb(rgb_color const & color)
+{
+	return (color.red << 16) | (color.green << 8) | color.blue;
+}
+
+static rgb_color unpack_rgb(uint32 const color)
+{
+	return rgb_color((uint8) (color >> 16), (uint8) (color >> 8), (uint8) color);
+}
+
+static uint8 channel(uint32 const color, uint const axis)
+{
+	return (uint8) (color >> (16 - (axis * 8)));
+}
+
+/**
+ * @brief Gives the color a color format will store in place of any other
+ */
+class color_reducer
+{
+private:
+	coldef const * m_coldef;
+	// the channels of an RGB color format are independent, so each can be reduced with a table
+	array<array<uint8, 256>, 3> m_channels;
+
+public:
+	explicit color_reducer(coldef const * coldef) :
+			m_coldef {coldef}
+	{
+		if (m_coldef == nullptr || m_coldef->type() != coldef_type::rgb)
+			return;
+
+		auto const & rgbcoldef {static_cast<chrgfx::rgbcoldef const &>(*m_coldef)};
+		for (uint value {0}; value < 256; ++value)
+		{
+			rgb_color const in_color((uint8) value, (uint8) value, (uint8) value);
+			rgb_color out_color;
+			uint32 encoded;
+			encode_col(rgbcoldef, &in_color, &encoded);
+			decode_col(rgbcoldef, &encoded, &out_color);
+			m_channels[0][value] = out_color.red;
+			m_channels[1][value] = out_color.green;
+			m_channels[2][value] = out_color.blue;
+		}
+	}
+
+	[[nodiscard]] rgb_color reduce(rgb_color const & color) const
+	{
+		if (m_coldef == nullptr)
+			return color;
+		if (m_coldef->type() == coldef_type::rgb)
+			return rgb_color(m_channels[0][color.red], m_channels[1][color.green], m_channels[2][color.blue]);
+
+		auto const & refcoldef {static_cast<chrgfx::refcoldef const &>(*m_coldef)};
+		return refcoldef.by_value(refcoldef.by_color(color));
+	}
+
+	/**
+	 * @brief Whether each channel is reduced without regard to the others, with reduce_channel
+	 */
+	[[nodiscard]] bool independent_channels() const
+	{
+		return m_coldef != nullptr && m_coldef->type() == coldef_type::rgb;
+	}
+
+	[[nodiscard]] uint8 reduce_channel(uint const axis, uint8 const value) const
+	{
+		return m_channels[axis][value];
+	}
+};
+
+/**
+ * @brief Sort colors and merge the counts of duplicates
+ */
+static void combine_counts(vector<color_count> & counts)
+{
+	sort(counts.begin(), counts.end(), [](color_count const & a, color_count const & b) { return a.color < b.color; });
+
+	size_t out {0};
+	for (size_t i {0}; i < counts.size(); ++i)
+	{
+		if (out > 0 && counts[out - 1].color == counts[i].color)
+			counts[out - 1].count += counts[i].count;
+		else
+			counts[out++] = counts[i];
+	}
+	counts.resize(out);
+}
+
+/**
+ * @brief Run a function over bands of rows, with each band on its own thread
+ * @param band_fn Called with the band index and the first and last (exclusive) rows of the band
+ */
+template <typename BandFn>
+static void for_each_band(uint const height, uint const threads, BandFn && band_fn)
+{
+	uint const band_count {max(1u, min(threads, height))};
+	auto band_row = [&](uint const i_band) { return (uint) (((uint64_t) height * i_band) / band_count); };
+
+	vector<future<void>> helpers;
+	for (uint i_band {1}; i_band < band_count; ++i_band)
+		helpers.push_back(
+			async(launch::async, [&, i_band]() { band_fn(i_band, band_row(i_band), band_row(i_band + 1)); }));
+	band_fn(0, 0, band_row(1));
+	for (auto & helper : helpers)
+		helper.get();
+}
+
+static color_box measure_box(vector<color_count> const & colors, size_t const first, size_t const last)
+{
+	double count {0};
+	array<double, 3> sum {}, sum_sq {};
+	for (size_t i {first}; i < last; ++i)
+	{
+		double const weight = colors[i].count;
+		count += weight;
+		for (uint axis {0}; axis < 3; ++axis)
+		{
+			double const value {(double) channel(colors[i].color, axis)};
+			sum[axis] += value * weight;
+			sum_sq[axis] += value * value * weight;
+		}
+	}
+
+	color_box box {first, last, 0, 0};
+	double widest {-1};
+	for (uint axis {0}; axis < 3; ++axis)
+	{
+		double const spread {sum_sq[axis] - ((sum[axis] * sum[axis]) / count)};
+		box.error += spread;
+		if (spread > widest)
+		{
+			widest = spread;
+			box.axis = axis;
+		}
+	}
+	return box;
+}
+
+static rgb_color box_mean(vector<color_count> const & colors, color_box const & box)
+{
+	uint64_t count {0};
+	array<uint64_t, 3> sum {};
+	for (size_t i {box.first}; i < box.last; ++i)
+	{
+		count += colors[i].count;
+		for (uint axis {0}; axis < 3; ++axis)
+			sum[axis] += channel(colors[i].color, axis) * colors[i].count;
+	}
+	return rgb_color((uint8) ((sum[0] + (count / 2)) / count),
+		(uint8) ((sum[1] + (count / 2)) / count),
+		(uint8) ((sum[2] + (count / 2)) / count));
+}
+
+/**
+ * @brief Choose up to max_entries colors to represent the given colors
+ * @note Reorders the colors
+ */
+static vector<rgb_color> median_cut(vector<color_count> & colors, size_t const max_entries, color_reducer const & reducer)
+{
+	vector<rgb_color> entries;
+	if (colors.size() <= max_entries)
+	{
+		// few enough to use every color as it is
+		for (auto const & color : colors)
+			entries.push_back(unpack_rgb(color.color));
+		return entries;
+	}
+
+	vector<color_box> boxes {measure_box(colors, 0, colors.size())};
+	while (boxes.size() < max_entries)
+	{
+		// split whichever box is represented worst by its mean
+		auto split_box {boxes.end()};
+		for (auto it {boxes.begin()}; it != boxes.end(); ++it)
+			if (it->last - it->first > 1 && it->error > 0 && (split_box == boxes.end() || it->error > split_box->error))
+				split_box = it;
+		if (split_box == boxes.end())
+			break;
+
+		auto const box {*split_box};
+		sort(colors.begin() + box.first, colors.begin() + box.last, [&box](color_count const & a, color_count const & b) {
+			return channel(a.color, box.axis) < channel(b.color, box.axis);
+		});
+
+		// split at the median pixel, rather than the median color, so that common colors are given more entries
+		uint64_t total {0}, running {0};
+		for (size_t i {box.first}; i < box.last; ++i)
+			total += colors[i].count;
+		size_t split {box.first};
+		while (split < box.last - 1 && (running + colors[split].count) * 2 <= total)
+			running += colors[split++].count;
+		split = max(split, box.first + 1);
+
+		*split_box = measure_box(colors, box.first, split);
+		boxes.push_back(measure_box(colors, split, box.last));
+	}
+
+	for (auto const & box : boxes)
+		entries.push_back(reducer.reduce(box_mean(colors, box)));
+	return entries;
+}
+
+/**
+ * @brief Squared distance between two colors
+ */
+static int color_distance(rgb_color const & a, rgb_color const & b)
+{
+	int const red {a.red - b.red}, green {a.green - b.green}, blue {a.blue - b.blue};
+	return (red * red) + (green * green) + (blue * blue);
+}
+
+static size_t nearest_entry(vector<rgb_color> const & entries, rgb_color const & color)
+{
+	size_t nearest {0};
+	int nearest_distance {INT32_MAX};
+	for (size_t i {0}; i < entries.size(); ++i)
+	{
+		int const distance {color_distance(entries[i], color)};
+		if (distance < nearest_distance)
+		{
+			nearest_distance = distance;
+			nearest = i;
+		}
+	}
+	return nearest;
+}
+
+/**
+ * @brief Finds the nearest palette entry for any color, through a table over a grid of colors
+ * @details Where the color format has few enough levels in each channel, the grid is made of exactly those levels, so
+ * that every color the format can store is matched precisely. Otherwise, the grid has 64 levels per channel.
+ */
+class inverse_color_map
+{
+private:
+	static size_t constexpr MAX_LEVELS {64};
+
+	// the grid position of each channel value, and the value at each grid position
+	array<array<uint8, 256>, 3> m_position;
+	array<vector<uint8>, 3> m_levels;
+	bool m_exact {true};
+	vector<pixel> m_map;
+
+public:
+	inverse_color_map(
+		color_reducer const & reducer, vector<rgb_color> const & entries, vector<pixel> const & slots, uint const threads)
+	{
+		for (uint axis {0}; axis < 3; ++axis)
+		{
+			auto & levels {m_levels[axis]};
+			if (reducer.independent_channels())
+			{
+				for (uint value {0}; value < 256; ++value)
+					levels.push_back(reducer.reduce_channel(axis, (uint8) value));
+				sort(levels.begin(), levels.end());
+				levels.erase(unique(levels.begin(), levels.end()), levels.end());
+			}
+			if (levels.empty() || levels.size() > MAX_LEVELS)
+			{
+				m_exact = false;
+				levels.clear();
+				for (uint level {0}; level < MAX_LEVELS; ++level)
+					levels.push_back((uint8) ((level * (256 / MAX_LEVELS)) + (128 / MAX_LEVELS)));
+			}
+
+			// each value belongs to the nearest level
+			uint8 level {0};
+			for (uint value {0}; value < 256; ++value)
+			{
+				while (level + 1u < levels.size() && abs(levels[level + 1] - (int) value) < abs(levels[level] - (int) value))
+					++level;
+				m_position[axis][value] = level;
+			}
+		}
+
+		size_t const green_count {m_levels[1].size()}, blue_count {m_levels[2].size()};
+		m_map.resize(m_levels[0].size() * green_count * blue_count);
+		for_each_band(m_levels[0].size(), threads, [&](uint, uint const first_red, uint const last_red) {
+			for (uint red {first_red}; red < last_red; ++red)
+				for (size_t green {0}; green < green_count; ++green)
+					for (size_t blue {0}; blue < blue_count; ++blue)
+						m_map[(((red * green_count) + green) * blue_count) + blue] = slots[nearest_entry(
+							entries, rgb_color(m_levels[0][red], m_levels[1][green], m_levels[2][blue]))];
+		});
+	}
+
+	[[nodiscard]] pixel nearest(uint8 const red, uint8 const green, uint8 const blue) const
+	{
+		return m_map[(((m_position[0][red] * m_levels[1].size()) + m_position[1][green]) * m_levels[2].size()) +
+								 m_position[2][blue]];
+	}
+
+	/**
+	 * @brief Whether the grid is made of the levels of the color format
+	 */
+	[[nodiscard]] bool exact() const
+	{
+		return m_exact;
+	}
+
+	/**
+	 * @brief Average distance between the levels of a channel
+	 */
+	[[nodiscard]] double level_spacing(uint const axis) const
+	{
+		return m_levels[axis].size() > 1 ? 255.0 / (m_levels[axis].size() - 1) : 0;
+	}
+};
+
+// thresholds for ordered dithering, from 0 to 63
+static uint8 constexpr BAYER_8X8[8][8] {{0, 32, 8, 40, 2, 34, 10, 42},
+	{48, 16, 56, 24, 50, 18, 58, 26},
+	{12, 44, 4, 36, 14, 46, 6, 38},
+	{60, 28, 52, 20, 62, 30, 54, 22},
+	{3, 35, 11, 43, 1, 33, 9, 41},
+	{51, 19, 59, 27, 49, 17, 57, 25},
+	{15, 47, 7, 39, 13, 45, 5, 37},
+	{63, 31, 55, 23, 61, 29, 53, 21}};
+
+/**
+ * @brief Apply a repeating pattern of offsets to RGBA data, saturating at 0 and 255
+ * @param raise Values to add to each byte of 8 pixels (32 bytes)
+ * @param lower Values to subtract from each byte of 8 pixels; only one of raise and lower is non-zero for any byte
+ */
+static void offset_row(
+	byte_t const * in_data, byte_t * out_data, size_t const datasize, byte_t const * raise, byte_t const * lower)
+{
+	size_t i {0};
+#ifdef __SSE2__
+	auto const raise_lo {_mm_loadu_si128(reinterpret_cast<__m128i const *>(raise))},
+		raise_hi {_mm_loadu_si128(reinterpret_cast<__m128i const *>(raise + 16))},
+		lower_lo {_mm_loadu_si128(reinterpret_cast<__m128i const *>(lower))},
+		lower_hi {_mm_loadu_si128(reinterpret_cast<__m128i const *>(lower + 16))};
+	for (; i + 32 <= datasize; i += 32)
+	{
+		auto lo {_mm_loadu_si128(reinterpret_cast<__m128i const *>(in_data + i))},
+			hi {_mm_loadu_si128(reinterpret_cast<__m128i const *>(in_data + i + 16))};
+		lo = _mm_subs_epu8(_mm_adds_epu8(lo, raise_lo), lower_lo);
+		hi = _mm_subs_epu8(_mm_adds_epu8(hi, raise_hi), lower_hi);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out_data + i), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out_data + i + 16), hi);
+	}
+#endif
+	for (; i < datasize; ++i)
+		out_data[i] = (byte_t) clamp(in_data[i] + raise[i % 32] - lower[i % 32], 0, 255);
+}
+
+/**
+ * @param amplitude Range of the offsets applied to each channel
+ */
+static void ordered_dither(inverse_color_map const & inverse,
+	array<double, 3> const & amplitude,
+	byte_t const * in_rgba,
+	image & out,
+	optional<pixel> const trns_index,
+	uint const threads)
+{
+	uint const width {out.width()};
+	size_t const row_datasize {(size_t) width * 4};
+
+	// the offsets for each row of the matrix, laid out as RGBA so they can be added to the pixel data directly
+	array<array<byte_t, 32>, 8> raise {}, lower {};
+	for (uint i_row {0}; i_row < 8; ++i_row)
+	{
+		for (uint i_pixel {0}; i_pixel < 8; ++i_pixel)
+		{
+			double const threshold {((BAYER_8X8[i_row][i_pixel] + 0.5) / 64) - 0.5};
+			for (uint axis {0}; axis < 3; ++axis)
+			{
+				auto const offset {(int) lround(threshold * amplitude[axis])};
+				raise[i_row][(i_pixel * 4) + axis] = (byte_t) clamp(offset, 0, 255);
+				lower[i_row][(i_pixel * 4) + axis] = (byte_t) clamp(-offset, 0, 255);
+			}
+		}
+	}
+
+	for_each_band(out.height(), threads, [&](uint, uint const first_row, uint const last_row) {
+		vector<byte_t> offset_data(row_datasize);
+		for (uint i_row {first_row}; i_row < last_row; ++i_row)
+		{
+			auto const ptr_in {in_rgba + (i_row * row_datasize)};
+			offset_row(ptr_in, offset_data.data(), row_datasize, raise[i_row % 8].data(), lower[i_row % 8].data());
+
+			auto ptr_out {out.pixel_map_row(i_row)};
+			for (uint i_pixel {0}; i_pixel < width; ++i_pixel)
+			{
+				auto const ptr_offset {offset_data.data() + (i_pixel * 4)};
+				ptr_out[i_pixel] = (trns_index && ptr_in[(i_pixel * 4) + 3] < 128)
+														 ? *trns_index
+														 : inverse.nearest(ptr_offset[0], ptr_offset[1], ptr_offset[2]);
+			}
+		}
+	});
+}
+
+/*
+	Floyd-Steinberg error diffusion passes error along each row and down into the next, so the rows can't simply be
+	split between threads. Instead they are pipelined: each thread takes every nth row, and works along it only as far
+	as the row above has been completed, less one pixel, since each pixel takes error from the three pixels above it.
+*/
+static void diffusion_dither(inverse_color_map const & inverse,
+	palette const & pal,
+	byte_t const * in_rgba,
+	image & out,
+	optional<pixel> const trns_index,
+	uint const threads)
+{
+	uint const width {out.width()}, height {out.height()}, thread_count {max(1u, min(threads, height))};
+	size_t const row_datasize {(size_t) width * 4};
+
+	// error passed down into each row, in 16ths, with a pixel of padding on either side
+	// each thread works on one row at a time and the row below is written as each is read, so one more row than there
+	// are threads is enough
+	size_t const ring_rows {thread_count + 1u}, error_row_size {((size_t) width + 2) * 3};
+	vector<int32> errors(ring_rows * error_row_size);
+
+	// the number of pixels completed in each row
+	vector<atomic<uint>> progress(height);
+	uint constexpr PROGRESS_INTERVAL {16};
+
+	auto worker = [&](uint const first_row) {
+		for (uint i_row {first_row}; i_row < height; i_row += thread_count)
+		{
+			int32 const * incoming {errors.data() + ((i_row % ring_rows) * error_row_size)};
+			int32 * outgoing {errors.data() + (((i_row + 1) % ring_rows) * error_row_size)};
+			fill(outgoing, outgoing + error_row_size, 0);
+
+			auto const ptr_in {in_rgba + (i_row * row_datasize)};
+			auto ptr_out {out.pixel_map_row(i_row)};
+			uint ready {i_row == 0 ? width : 0};
+			array<int32, 3> carry {};
+			for (uint i_pixel {0}; i_pixel < width; ++i_pixel)
+			{
+				uint const needed {min(i_pixel + 2, width)};
+				while (ready < needed)
+				{
+					ready = progress[i_row - 1].load(memory_order_acquire);
+					if (ready < needed)
+						this_thread::yield();
+				}
+
+				auto const pixel_in {ptr_in + (i_pixel * 4)};
+				if (trns_index && pixel_in[3] < 128)
+				{
+					ptr_out[i_pixel] = *trns_index;
+					carry = {};
+				}
+				else
+				{
+					array<int32, 3> value;
+					for (uint axis {0}; axis < 3; ++axis)
+						value[axis] = clamp(
+							pixel_in[axis] + ((incoming[((i_pixel + 1) * 3) + axis] + carry[axis] + 8) >> 4), 0, 255);
+
+					auto const index {inverse.nearest((uint8) value[0], (uint8) value[1], (uint8) value[2])};
+					ptr_out[i_pixel] = index;
+
+					array<int32, 3> const error {
+						value[0] - pal[index].red, value[1] - pal[index].green, value[2] - pal[index].blue};
+					auto const below {outgoing + (i_pixel * 3)};
+					for (uint axis {0}; axis < 3; ++axis)
+					{
+						carry[axis] = error[axis] * 7;
+						below[axis] += error[axis] * 3;
+						below[3 + axis] += error[axis] * 5;
+						below[6 + axis] += error[axis];
+					}
+				}
+
+				if ((i_pixel + 1) % PROGRESS_INTERVAL == 0)
+					progress[i_row].store(i_pixel + 1, memory_order_release);
+			}
+			progress[i_row].store(width, memory_order_release);
+		}
+	};
+
+	vector<future<void>> helpers;
+	for (uint i_thread {1}; i_thread < thread_count; ++i_thread)
+		helpers.push_back(async(launch::async, worker, i_thread));
+	worker(0);
+	for (auto & helper : helpers)
+		helper.get();
+}
+
+image quantize_image(coldef const * coldef,
+	byte_t const * in_rgba,
+	uint const width,
+	uint const height,
+	quantize_config const & quantize_cfg)
+{
+	if (quantize_cfg.colors == 0 || quantize_cfg.colors > 256)
+		throw invalid_argument("Invalid palette size for quantization");
+	if (quantize_cfg.trns_index && *quantize_cfg.trns_index >= quantize_cfg.colors)
+		throw invalid_argument("Transparent palette entry is outside of the palette");
+
+	image out(width, height);
+	size_t const row_datasize {(size_t) width * 4};
+	bool const use_alpha {quantize_cfg.trns_index.has_value()};
+	auto const is_transparent = [use_alpha](byte_t const * rgba) { return use_alpha && rgba[3] < 128; };
+	auto const pack_pixel = [](byte_t const * rgba) { return (uint32) ((rgba[0] << 16) | (rgba[1] << 8) | rgba[2]); };
+
+	// count the distinct colors
+	vector<vector<color_count>> band_counts(max(1u, quantize_cfg.threads));
+	vector<char> band_has_transparency(band_counts.size(), 0);
+	for_each_band(height, quantize_cfg.threads, [&](uint const i_band, uint const first_row, uint const last_row) {
+		vector<uint32> band_colors;
+		band_colors.reserve((size_t) width * (last_row - first_row));
+		for (uint i_row {first_row}; i_row < last_row; ++i_row)
+		{
+			auto ptr_in {in_rgba + (i_row * row_datasize)};
+			for (uint i_pixel {0}; i_pixel < width; ++i_pixel, ptr_in += 4)
+			{
+				if (is_transparent(ptr_in))
+					band_has_transparency[i_band] = 1;
+				else
+					band_colors.push_back(pack_pixel(ptr_in));
+			}
+		}
+
+		sort(band_colors.begin(), band_colors.end());
+		auto & counts {band_counts[i_band]};
+		for (auto const color : band_colors)
+		{
+			if (counts.empty() || counts.back().color != color)
+				counts.push_back({color, 1});
+			else
+				++counts.back().count;
+		}
+	});
+
+	vector<color_count> colors;
+	for (auto const & counts : band_counts)
+		colors.insert(colors.end(), counts.begin(), counts.end());
+	combine_counts(colors);
+	bool const has_transparency {
+		any_of(band_has_transparency.begin(), band_has_transparency.end(), [](char const flag) { return flag != 0; })};
+
+	vector<uint32> distinct_colors(colors.size());
+	for (size_t i {0}; i < colors.size(); ++i)
+		distinct_colors[i] = colors[i].color;
+
+	// the entries available for opaque colors, in palette order
+	vector<pixel> slots;
+	for (uint i_entry {0}; i_entry < quantize_cfg.colors; ++i_entry)
+		if (! (has_transparency && i_entry == *quantize_cfg.trns_index))
+			slots.push_back((pixel) i_entry);
+	if (slots.empty() && ! colors.empty())
+		throw invalid_argument("Palette size leaves no entries for opaque colors");
+
+	// choose the palette from the colors as the color format will store them
+	color_reducer const reducer(coldef);
+	vector<uint32> color_reduced(colors.size());
+	vector<color_count> reduced_colors(colors.size());
+	for (size_t i {0}; i < colors.size(); ++i)
+	{
+		color_reduced[i] = pack_rgb(reducer.reduce(unpack_rgb(colors[i].color)));
+		reduced_colors[i] = {color_reduced[i], colors[i].count};
+	}
+	combine_counts(reduced_colors);
+
+	vector<color_count> cut_colors {reduced_colors};
+	auto const entries {median_cut(cut_colors, slots.size(), reducer)};
+
+	palette pal {};
+	for (size_t i_entry {0}; i_entry < entries.size(); ++i_entry)
+		pal[slots[i_entry]] = entries[i_entry];
+	out.set_color_map(pal);
+
+	if (quantize_cfg.dither != dither_mode::none && ! entries.empty())
+	{
+		optional<pixel> const trns_index {use_alpha ? quantize_cfg.trns_index : nullopt};
+		inverse_color_map const inverse(reducer, entries, slots, quantize_cfg.threads);
+		if (quantize_cfg.dither == dither_mode::diffusion)
+		{
+			diffusion_dither(inverse, pal, in_rgba, out, trns_index, quantize_cfg.threads);
+			return out;
+		}
+
+		// when dithering to the levels of the color format, colors it can store exactly are left as they are; otherwise
+		// the pattern needs to span the distance between palette entries
+		array<double, 3> amplitude;
+		if (inverse.exact())
+		{
+			for (uint axis {0}; axis < 3; ++axis)
+				amplitude[axis] = inverse.level_spacing(axis);
+		}
+		else
+		{
+			double spacing {0};
+			for (size_t i {0}; i < entries.size() && entries.size() > 1; ++i)
+			{
+				int nearest_distance {INT32_MAX};
+				for (size_t j {0}; j < entries.size(); ++j)
+					if (j != i)
+						nearest_distance = min(nearest_distance, color_distance(entries[i], entries[j]));
+				spacing += sqrt((double) nearest_distance) / entries.size();
+			}
+			amplitude.fill(spacing);
+		}
+		ordered_dither(inverse, amplitude, in_rgba, out, trns_index, quantize_cfg.threads);
+		return out;
+	}
+
+	// match each distinct color with its palette entry, by way of its reduced color
+	vector<pixel> reduced_index(reduced_colors.size());
+	for (size_t i {0}; i < reduced_colors.size(); ++i)
+		reduced_index[i] = slots[nearest_entry(entries, unpack_rgb(reduced_colors[i].color))];
+
+	vector<pixel> color_index(colors.size());
+	for (size_t i {0}; i < colors.size(); ++i)
+	{
+		auto const found {lower_bound(reduced_colors.begin(), reduced_colors.end(), color_reduced[i],
+			[](color_count const & a, uint32 const b) { return a.color < b; })};
+		color_index[i] = reduced_index[found - reduced_colors.begin()];
+	}
+
+	// map the pixels
+	for_each_band(height, quantize_cfg.threads, [&](uint, uint const first_row, uint const last_row) {
+		// neighbouring pixels are often the same color, so remember the last lookup
+		uint32 last_color {0};
+		pixel last_index {colors.empty() ? (pixel) 0 : color_index[0]};
+		if (! colors.empty())
+			last_color = distinct_colors[0];
+
+		for (uint i_row {first_row}; i_row < last_row; ++i_row)
+		{
+			auto ptr_in {in_rgba + (i_row * row_datasize)};
+			auto ptr_out {out.pixel_map_row(i_row)};
+			for (uint i_pixel {0}; i_pixel < width; ++i_pixel, ptr_in += 4)
+			{
+				if (is_transparent(ptr_in))
+				{
+					*ptr_out++ = *quantize_cfg.trns_index;
+					continue;
+				}
+
+				auto const color {pack_pixel(ptr_in)};
+				if (color != last_color)
+				{
+					last_color = color;
+					last_index = color_index[lower_bound(distinct_colors.begin(), distinct_colors.end(), color) -
+																	 distinct_colors.begin()];
+				}
+				*ptr_out++ = last_index;
+			}
+		}
+	});
+
+	return out;
+}
+
+/*
+	Palette lines are solved by first packing the tiles, those with the most colors first, each into the line which
+	needs the fewest new colors to hold it. If every line ends up with no more colors than it has entries, each line's
+	palette is simply its colors and no pixel is changed. Otherwise, the grouping is refined in the manner of k-means:
+	each line's palette is chosen by median cut from the colors of its tiles, then every tile moves to the line which
+	represents it with the least error, until no tile moves. The tiles are split between threads for the error
+	calculations, and each line's error for a tile is abandoned as soon as it exceeds the best found so far.
+*/
+
+/**
+ * @brief Number of colors in the union of a line's colors and a tile's colors (both sorted)
+ */
+static size_t union_size(vector<uint32> const & line_colors, vector<color_count> const & tile_colors)
+{
+	size_t count {0}, i {0}, j {0};
+	while (i < line_colors.size() || j < tile_colors.size())
+	{
+		if (j == tile_colors.size() || (i < line_colors.size() && line_colors[i] < tile_colors[j].color))
+			++i;
+		else if (i == line_colors.size() || tile_colors[j].color < line_colors[i])
+			++j;
+		else
+		{
+			++i;
+			++j;
+		}
+		++count;
+	}
+	return count;
+}
+
+/**
+ * @brief Total squared error of a tile's pixels when each is given the nearest palette entry
+ * @param limit The calculation stops once the error reaches this
+ */
+static uint64_t tile_error(vector<color_count> const & tile_colors, vector<rgb_color> const & entries, uint64_t const limit)
+{
+	uint64_t error {0};
+	for (auto const & color : tile_colors)
+	{
+		auto const rgb {unpack_rgb(color.color)};
+		int nearest_distance {INT32_MAX};
+		for (auto const & entry : entries)
+			nearest_distance = min(nearest_distance, color_distance(entry, rgb));
+		error += (uint64_t) nearest_distance * color.count;
+		if (error >= limit)
+			break;
+	}
+	return error;
+}
+
+palette_line_result quantize_tile_lines(coldef const * coldef,
+	byte_t const * in_rgba,
+	uint const width,
+	uint const height,
+	palette_line_config const & line_cfg)
+{
+	if (line_cfg.tile_width == 0 || line_cfg.tile_height == 0)
+		throw invalid_argument("Invalid tile dimensions");
+	if (line_cfg.lines == 0 || line_cfg.line_colors == 0 || line_cfg.lines * line_cfg.line_colors > 256)
+		throw invalid_argument("Invalid palette line count or size");
+	if (line_cfg.trns_index && *line_cfg.trns_index >= line_cfg.line_colors)
+		throw invalid_argument("Transparent palette entry is outside of the palette line");
+
+	uint const tile_columns {width / line_cfg.tile_width}, tile_rows {height / line_cfg.tile_height};
+	size_t const tile_count {(size_t) tile_columns * tile_rows}, row_datasize {(size_t) width * 4};
+	bool const use_alpha {line_cfg.trns_index.has_value()};
+	color_reducer const reducer(coldef);
+
+	// the reduced colors of each tile
+	vector<vector<color_count>> tiles(tile_count);
+	vector<char> tile_row_has_transparency(tile_rows, 0);
+	for_each_band(tile_rows, line_cfg.threads, [&](uint, uint const first_tile_row, uint const last_tile_row) {
+		vector<uint32> tile_pixels;
+		// neighbouring pixels are often the same color, so remember the last reduction
+		uint32 last_color {0}, last_reduced {pack_rgb(reducer.reduce(rgb_color()))};
+
+		for (uint i_tile_row {first_tile_row}; i_tile_row < last_tile_row; ++i_tile_row)
+		{
+			for (uint i_tile_column {0}; i_tile_column < tile_columns; ++i_tile_column)
+			{
+				tile_pixels.clear();
+				for (uint i_row {0}; i_row < line_cfg.tile_height; ++i_row)
+				{
+					auto ptr_in {in_rgba + (((i_tile_row * line_cfg.tile_height) + i_row) * row_datasize) +
+											 (i_tile_column * line_cfg.tile_width * 4)};
+					for (uint i_pixel {0}; i_pixel < line_cfg.tile_width; ++i_pixel, ptr_in += 4)
+					{
+						if (use_alpha && ptr_in[3] < 128)
+						{
+							tile_row_has_transparency[i_tile_row] = 1;
+							continue;
+						}
+						uint32 const color {(uint32) ((ptr_in[0] << 16) | (ptr_in[1] << 8) | ptr_in[2])};
+						if (color != last_color)
+						{
+							last_color = color;
+							last_reduced = pack_rgb(reducer.reduce(unpack_rgb(color)));
+						}
+						tile_pixels.push_back(last_reduced);
+					}
+				}
+
+				sort(tile_pixels.begin(), tile_pixels.end());
+				auto & colors {tiles[((size_t) i_tile_row * tile_columns) + i_tile_column]};
+				for (auto const color : tile_pixels)
+				{
+					if (colors.empty() || colors.back().color != color)
+						colors.push_back({color, 1});
+					else
+						++colors.back().count;
+				}
+			}
+		}
+	});
+
+	bool const has_transparency {any_of(tile_row_has_transparency.begin(), tile_row_has_transparency.end(),
+		[](char const flag) { return flag != 0; })};
+
+	// the entries available for opaque colors within each line
+	vector<pixel> slots;
+	for (uint i_entry {0}; i_entry < line_cfg.line_colors; ++i_entry)
+		if (! (has_transparency && i_entry == *line_cfg.trns_index))
+			slots.push_back((pixel) i_entry);
+	if (slots.empty() && any_of(tiles.begin(), tiles.end(), [](auto const & colors) { return ! colors.empty(); }))
+		throw invalid_argument("Palette line size leaves no entries for opaque colors");
+
+	// pack the tiles into lines, most colorful first; tiles with no opaque pixels are left on the first line
+	vector<size_t> order(tile_count);
+	for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+		order[i_tile] = i_tile;
+	stable_sort(order.begin(), order.end(), [&tiles](size_t const a, size_t const b) {
+		return tiles[a].size() > tiles[b].size();
+	});
+
+	vector<uint8> assignment(tile_count, 0);
+	vector<vector<uint32>> line_sets;
+	for (auto const i_tile : order)
+	{
+		auto const & colors {tiles[i_tile]};
+		if (colors.empty())
+			break;
+
+		size_t best_line {SIZE_MAX}, best_added {SIZE_MAX};
+		for (size_t i_line {0}; i_line < line_sets.size(); ++i_line)
+		{
+			auto const combined {union_size(line_sets[i_line], colors)};
+			if (combined <= slots.size() && combined - line_sets[i_line].size() < best_added)
+			{
+				best_added = combined - line_sets[i_line].size();
+				best_line = i_line;
+			}
+		}
+		if (best_line == SIZE_MAX)
+		{
+			if (line_sets.size() < line_cfg.lines)
+			{
+				best_line = line_sets.size();
+				line_sets.emplace_back();
+			}
+			else
+			{
+				// nothing fits, so overfill the line which grows the least
+				size_t best_combined {SIZE_MAX};
+				for (size_t i_line {0}; i_line < line_sets.size(); ++i_line)
+				{
+					auto const combined {union_size(line_sets[i_line], colors)};
+					if (combined < best_combined)
+					{
+						best_combined = combined;
+						best_line = i_line;
+					}
+				}
+			}
+		}
+
+		assignment[i_tile] = (uint8) best_line;
+		auto & line {line_sets[best_line]};
+		vector<uint32> merged;
+		merged.reserve(line.size() + colors.size());
+		size_t i_color {0};
+		for (auto const color : line)
+		{
+			while (i_color < colors.size() && colors[i_color].color < color)
+				merged.push_back(colors[i_color++].color);
+			if (i_color < colors.size() && colors[i_color].color == color)
+				++i_color;
+			merged.push_back(color);
+		}
+		for (; i_color < colors.size(); ++i_color)
+			merged.push_back(colors[i_color].color);
+		line = std::move(merged);
+	}
+
+	vector<vector<rgb_color>> line_entries(line_cfg.lines);
+	bool const exact {
+		all_of(line_sets.begin(), line_sets.end(), [&slots](auto const & line) { return line.size() <= slots.size(); })};
+	if (exact)
+	{
+		for (size_t i_line {0}; i_line < line_sets.size(); ++i_line)
+			for (auto const color : line_sets[i_line])
+				line_entries[i_line].push_back(unpack_rgb(color));
+	}
+	else
+	{
+		auto const build_palettes = [&]() {
+			vector<vector<size_t>> members(line_cfg.lines);
+			for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+				if (! tiles[i_tile].empty())
+					members[assignment[i_tile]].push_back(i_tile);
+
+			for_each_band(line_cfg.lines, line_cfg.threads, [&](uint, uint const first_line, uint const last_line) {
+				for (uint i_line {first_line}; i_line < last_line; ++i_line)
+				{
+					vector<color_count> colors;
+					for (auto const i_tile : members[i_line])
+						colors.insert(colors.end(), tiles[i_tile].begin(), tiles[i_tile].end());
+					combine_counts(colors);
+					line_entries[i_line] = median_cut(colors, slots.size(), reducer);
+				}
+			});
+		};
+
+		vector<uint64_t> tile_cost(tile_count);
+		for (uint pass {0}; pass < line_cfg.max_passes; ++pass)
+		{
+			build_palettes();
+
+			atomic<size_t> moved {0};
+			for_each_band((uint) tile_count, line_cfg.threads, [&](uint, uint const first_tile, uint const last_tile) {
+				size_t band_moved {0};
+				for (size_t i_tile {first_tile}; i_tile < last_tile; ++i_tile)
+				{
+					if (tiles[i_tile].empty())
+						continue;
+
+					auto const current {assignment[i_tile]};
+					uint64_t best_cost {tile_error(tiles[i_tile], line_entries[current], UINT64_MAX)};
+					uint8 best_line {current};
+					for (uint i_line {0}; i_line < line_cfg.lines && best_cost > 0; ++i_line)
+					{
+						if (i_line == current || line_entries[i_line].empty())
+							continue;
+						auto const cost {tile_error(tiles[i_tile], line_entries[i_line], best_cost)};
+						if (cost < best_cost)
+						{
+							best_cost = cost;
+							best_line = (uint8) i_line;
+						}
+					}
+
+					tile_cost[i_tile] = best_cost;
+					if (best_line != current)
+					{
+						assignment[i_tile] = best_line;
+						++band_moved;
+					}
+				}
+				moved += band_moved;
+			});
+
+			// a line left with no tiles is given the one represented worst, so that no line goes unused
+			vector<size_t> line_sizes(line_cfg.lines, 0);
+			for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+				if (! tiles[i_tile].empty())
+					++line_sizes[assignment[i_tile]];
+			for (uint i_line {0}; i_line < line_cfg.lines; ++i_line)
+			{
+				if (line_sizes[i_line] > 0)
+					continue;
+				size_t worst_tile {SIZE_MAX};
+				for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+					if (! tiles[i_tile].empty() && line_sizes[assignment[i_tile]] > 1 && tile_cost[i_tile] > 0 &&
+							(worst_tile == SIZE_MAX || tile_cost[i_tile] > tile_cost[worst_tile]))
+						worst_tile = i_tile;
+				if (worst_tile == SIZE_MAX)
+					break;
+				--line_sizes[assignment[worst_tile]];
+				assignment[worst_tile] = (uint8) i_line;
+				line_sizes[i_line] = 1;
+				tile_cost[worst_tile] = 0;
+				++moved;
+			}
+
+			if (moved == 0)
+				break;
+		}
+		build_palettes();
+	}
+
+	palette pal {};
+	for (uint i_line {0}; i_line < line_cfg.lines; ++i_line)
+		for (size_t i_entry {0}; i_entry < line_entries[i_line].size(); ++i_entry)
+			pal[(i_line * line_cfg.line_colors) + slots[i_entry]] = line_entries[i_line][i_entry];
+
+	palette_line_result result {image(width, height), std::move(assignment)};
+	auto & out {result.bitmap};
+	out.set_color_map(pal);
+
+	// pixels beyond the last whole tile are given the first line
+	for_each_band(height, line_cfg.threads, [&](uint, uint const first_row, uint const last_row) {
+		uint32 last_color {0};
+		size_t last_line {SIZE_MAX};
+		pixel last_index {0};
+
+		for (uint i_row {first_row}; i_row < last_row; ++i_row)
+		{
+			uint const i_tile_row {i_row / line_cfg.tile_height};
+			auto ptr_in {in_rgba + (i_row * row_datasize)};
+			auto ptr_out {out.pixel_map_row(i_row)};
+			for (uint i_pixel {0}; i_pixel < width; ++i_pixel, ptr_in += 4)
+			{
+				uint const i_tile_column {i_pixel / line_cfg.tile_width};
+				size_t const i_line {(i_tile_row < tile_rows && i_tile_column < tile_columns)
+															 ? (size_t) result.tile_lines[((size_t) i_tile_row * tile_columns) + i_tile_column]
+															 : 0u};
+				pixel const line_base {(pixel) (i_line * line_cfg.line_colors)};
+
+				if (use_alpha && ptr_in[3] < 128)
+				{
+					*ptr_out++ = line_base + *line_cfg.trns_index;
+					continue;
+				}
+
+				uint32 const color {(uint32) ((ptr_in[0] << 16) | (ptr_in[1] << 8) | ptr_in[2])};
+				if (color != last_color || i_line != last_line)
+				{
+					last_color = color;
+					last_line = i_line;
+					auto const & entries {line_entries[i_line]};
+					last_index = line_base +
+											 (entries.empty() ? 0 : slots[nearest_entry(entries, reducer.reduce(unpack_rgb(color)))]);
+				}
+				*ptr_out++ = last_index;
+			}
+		}
+	});
+
+	return result;
+}
+
+} // namespace chrgfx
@@ -0,0 +1,146 @@
+/**
+ * @file quantize.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Reduce direct color images to indexed color
+ *
+ * The palette is chosen by median cut from the colors that the target color format can actually represent, so that
+ * entries are not wasted on shades which would become identical once encoded (e.g. to the 9 bit color of the Mega
+ * Drive).
+ *
+ * Dithering can be used to hide the banding that results from reducing smooth gradients to few colors: ordered
+ * dithering applies a fixed pattern, which keeps flat areas and repeating tiles stable, while error diffusion spreads the
+ * difference from each pixel to its neighbours, which is more accurate but noisier.
+ */
+
+#ifndef __CHRGFX__QUANTIZE_HPP
+#define __CHRGFX__QUANTIZE_HPP
+
+#include "coldef.hpp"
+#include "image_types.hpp"
+#include "types.hpp"
+#include <optional>
+#include <vector>
+
+namespace chrgfx
+{
+
+enum class dither_mode
+{
+	none,
+	// 8x8 Bayer matrix
+	ordered,
+	// Floyd-Steinberg
+	diffusion
+};
+
+struct quantize_config
+{
+	/**
+	 * @brief Number of palette entries to use, including the transparent entry (1 to 256)
+	 */
+	uint colors {256};
+
+	/**
+	 * @brief Palette entry given to transparent pixels (alpha below 128)
+	 * @details If not set, alpha is ignored. The entry is only reserved if there are transparent pixels.
+	 */
+	std::optional<pixel> trns_index;
+
+	dither_mode dither {dither_mode::none};
+
+	/**
+	 * @brief Number of threads to use
+	 */
+	uint threads {1};
+};
+
+/**
+ * @brief Convert direct color pixel data to an indexed image
+ *
+ * @param coldef Color encoding the palette will be stored with; the palette is made up only of colors it can represent.
+ * If null, any 24 bit color may be used.
+ * @param in_rgba Pointer to input pixel data, as four bytes (red, green, blue, alpha) per pixel
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @return Indexed image with the chosen palette as its color map
+ */
+image quantize_image(coldef const * coldef,
+	byte_t const * in_rgba,
+	uint const width,
+	uint const height,
+	quantize_config const & quantize_cfg);
+
+/**
+ * @brief Settings for dividing an image between several palette lines
+ */
+struct palette_line_config
+{
+	/**
+	 * @brief Width and height of each tile in pixels; all pixels in a tile share a palette line
+	 */
+	uint tile_width {8};
+	uint tile_height {8};
+
+	/**
+	 * @brief Number of palette lines available
+	 */
+	uint lines {8};
+
+	/**
+	 * @brief Number of entries in each line, including the transparent entry; lines * line_colors may not exceed 256
+	 */
+	uint line_colors {16};
+
+	/**
+	 * @brief Entry within each line given to transparent pixels (alpha below 128)
+	 * @details If not set, alpha is ignored. The entry is only reserved if there are transparent pixels.
+	 */
+	std::optional<pixel> trns_index;
+
+	/**
+	 * @brief Maximum number of refinement passes; refinement ends sooner once no tile changes line
+	 */
+	uint max_passes {16};
+
+	/**
+	 * @brief Number of threads to use
+	 */
+	uint threads {1};
+};
+
+struct palette_line_result
+{
+	/**
+	 * @brief Indexed image; each pixel is its tile's line * line_colors + the entry within the line
+	 */
+	image bitmap;
+
+	/**
+	 * @brief The palette line of each tile, left to right and top to bottom
+	 * @details Only whole tiles are counted, as with make_tileset
+	 */
+	std::vector<uint8> tile_lines;
+};
+
+/**
+ * @brief Convert direct color pixel data to an indexed image using several palette lines, as on consoles where each tile
+ * selects one of a number of small palettes
+ * @details Tiles with similar colors are grouped on the same line, and a palette is chosen for each line as with
+ * quantize_image. Where every tile's colors fit in the lines exactly, no color is changed; otherwise the grouping is
+ * refined by moving each tile to the line which represents it best.
+ *
+ * @param coldef Color encoding the palette will be stored with; may be null to use full 24 bit color
+ * @param in_rgba Pointer to input pixel data, as four bytes (red, green, blue, alpha) per pixel
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ */
+palette_line_result quantize_tile_lines(coldef const * coldef,
+	byte_t const * in_rgba,
+	uint const width,
+	uint const height,
+	palette_line_config const & line_cfg);
+
+} // namespace chrgfx
+
+#endif
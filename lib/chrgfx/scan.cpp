@@ -0,0 +1,219 @@
+#include "scan.hpp"
+#include "tile_decoder.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+scan_score score_tileset(chrdef const & chrdef, pixel const * in_chrset, size_t const tile_count)
+{
+	scan_score out;
+	if (tile_count == 0)
+		return out;
+
+	size_t const width {chrdef.width()}, height {chrdef.height()}, tile_pixels {width * height},
+		pixel_count {tile_pixels * tile_count};
+	uint const bpp {chrdef.bpp()};
+
+	array<size_t, 256> histogram {};
+	size_t equal_neighbours {0}, blank_tiles {0};
+	for (size_t i_tile {0}; i_tile < tile_count; ++i_tile)
+	{
+		auto const tile {in_chrset + (i_tile * tile_pixels)};
+		size_t matching_first {0};
+		for (size_t i_pixel {0}; i_pixel < tile_pixels; ++i_pixel)
+		{
+			++histogram[tile[i_pixel]];
+			matching_first += tile[i_pixel] == tile[0];
+		}
+		blank_tiles += matching_first == tile_pixels;
+
+		// kept as simple loops without branches so that they can be vectorized
+		for (size_t y {0}; y < height; ++y)
+		{
+			auto const row {tile + (y * width)};
+			for (size_t x {1}; x < width; ++x)
+				equal_neighbours += row[x] == row[x - 1];
+		}
+		for (size_t i_pixel {width}; i_pixel < tile_pixels; ++i_pixel)
+			equal_neighbours += tile[i_pixel] == tile[i_pixel - width];
+	}
+
+	/*
+		Everything else comes from the histogram. The bitplane agreement of each pixel depends only on its value, so it
+		is counted per value rather than per pixel.
+	*/
+	double entropy {0}, expected_equal {0}, plane_agreement {0};
+	uint const plane_pairs {bpp * (bpp - 1) / 2};
+	for (uint value {0}; value < histogram.size(); ++value)
+	{
+		if (histogram[value] == 0)
+			continue;
+		double const p {static_cast<double>(histogram[value]) / pixel_count};
+		entropy -= p * log2(p);
+		expected_equal += p * p;
+
+		uint agreeing_pairs {0};
+		for (uint plane_a {0}; plane_a < bpp; ++plane_a)
+			for (uint plane_b {plane_a + 1}; plane_b < bpp; ++plane_b)
+				agreeing_pairs += ((value >> plane_a) & 1) == ((value >> plane_b) & 1);
+		plane_agreement += p * agreeing_pairs;
+	}
+
+	size_t const neighbour_pairs {((width - 1) * height + width * (height - 1)) * tile_count};
+	double const observed_equal {neighbour_pairs > 0 ? static_cast<double>(equal_neighbours) / neighbour_pairs : 0};
+
+	out.entropy = static_cast<float>(bpp > 0 ? entropy / bpp : 0);
+	out.plane_correlation =
+		plane_pairs > 0 ? static_cast<float>(fabs((2 * plane_agreement / plane_pairs) - 1)) : 0;
+	out.blank_ratio = static_cast<float>(blank_tiles) / tile_count;
+	// as with Cohen's kappa, matches which are expected from the value frequencies alone do not count
+	out.coherence =
+		expected_equal < 1 ? static_cast<float>(max(0.0, (observed_equal - expected_equal) / (1 - expected_equal))) : 0;
+
+	// data which is nearly noise is penalised further, as a little coherence is found in noise by chance
+	float const noise_factor {out.entropy > 0.9F ? (1 - out.entropy) * 10 : 1};
+	// graphics often include some blank tiles, so only windows which are mostly blank are penalised
+	float const blank_factor {out.blank_ratio > 0.75F ? (1 - out.blank_ratio) * 4 : 1};
+	out.score = out.coherence * (0.9F + (0.1F * out.plane_correlation)) * noise_factor * blank_factor;
+	return out;
+}
+
+vector<scan_candidate> scan_tiles(
+	vector<chrdef const *> const & chrdefs, byte_t const * data, size_t const datasize, scan_config const & scan_cfg)
+{
+	// the chrdefs are only borrowed for the length of the scan
+	vector<shared_ptr<tile_decoder const>> decoders;
+	for (auto const chrdef : chrdefs)
+		decoders.push_back(make_shared<tile_decoder>(shared_ptr<chrgfx::chrdef const>(shared_ptr<void>(), chrdef)));
+	return scan_tiles(decoders, data, datasize, scan_cfg);
+}
+
+vector<scan_candidate> scan_tiles(vector<shared_ptr<tile_decoder const>> const & decoders,
+	byte_t const * data,
+	size_t const datasize,
+	scan_config const & scan_cfg)
+{
+	if (scan_cfg.window_tiles == 0)
+		throw invalid_argument("Scan window must contain at least one tile");
+	if (scan_cfg.alignment_step == 0)
+		throw invalid_argument("Invalid scan alignment step");
+
+	/*
+		Each format has a grid of cells, one window in size. Every alignment within a tile is tried for each cell, and
+		only the best is kept, so that memory use depends on the data size alone. The windows tried for a cell start
+		within its first tile, so they are all from (nearly) the same area of the data.
+	*/
+	struct format_grid
+	{
+		chrgfx::chrdef const * chrdef;
+		tile_decoder const * decoder;
+		size_t window_datasize;
+		vector<scan_candidate> cells;
+	};
+
+	vector<format_grid> grids;
+	for (auto const & decoder : decoders)
+	{
+		auto const chrdef {&decoder->chrdef()};
+		if (chrdef->datasize_bytes() == 0)
+			throw invalid_argument("Invalid tile data size");
+		size_t const window_datasize {static_cast<size_t>(chrdef->datasize_bytes()) * scan_cfg.window_tiles};
+		grids.push_back({chrdef, decoder.get(), window_datasize, vector<scan_candidate>(datasize / window_datasize)});
+	}
+
+	// cells are handed out to the threads in batches, which is fine grained enough to keep them evenly loaded
+	size_t constexpr BATCH_CELLS {64};
+	vector<pair<size_t, size_t>> batches;
+	for (size_t i_grid {0}; i_grid < grids.size(); ++i_grid)
+		for (size_t first_cell {0}; first_cell < grids[i_grid].cells.size(); first_cell += BATCH_CELLS)
+			batches.emplace_back(i_grid, first_cell);
+
+	atomic<size_t> next_batch {0};
+	auto worker = [&]() {
+		vector<pixel> tiles;
+		while (true)
+		{
+			auto const i_batch {next_batch.fetch_add(1)};
+			if (i_batch >= batches.size())
+				return;
+
+			auto & grid {grids[batches[i_batch].first]};
+			auto const & chrdef {*grid.chrdef};
+			size_t const tile_datasize {chrdef.datasize_bytes()}, tile_pixels {chrdef.width() * chrdef.height()};
+			tiles.resize(tile_pixels * scan_cfg.window_tiles);
+
+			auto const first_cell {batches[i_batch].second},
+				last_cell {min(first_cell + BATCH_CELLS, grid.cells.size())};
+			for (size_t i_cell {first_cell}; i_cell < last_cell; ++i_cell)
+			{
+				auto & best {grid.cells[i_cell]};
+				best = {i_cell * grid.window_datasize, grid.window_datasize, grid.chrdef, {}};
+				best.score.score = -1;
+
+				for (size_t alignment {0}; alignment < tile_datasize; alignment += scan_cfg.alignment_step)
+				{
+					size_t const offset {(i_cell * grid.window_datasize) + alignment};
+					if (offset + grid.window_datasize > datasize)
+						break;
+
+					auto ptr_in_tile {data + offset};
+					auto ptr_out_tile {tiles.data()};
+					for (size_t i_tile {0}; i_tile < scan_cfg.window_tiles; ++i_tile)
+					{
+						grid.decoder->decode(ptr_in_tile, ptr_out_tile);
+						ptr_in_tile += tile_datasize;
+						ptr_out_tile += tile_pixels;
+					}
+
+					auto const score {score_tileset(chrdef, tiles.data(), scan_cfg.window_tiles)};
+					if (score.score > best.score.score)
+					{
+						best.offset = offset;
+						best.score = score;
+					}
+				}
+			}
+		}
+	};
+
+	vector<future<void>> helpers;
+	for (uint i {1}; i < scan_cfg.threads; ++i)
+		helpers.push_back(async(launch::async, worker));
+	worker();
+	for (auto & helper : helpers)
+		helper.get();
+
+	vector<scan_candidate> ranked;
+	for (auto & grid : grids)
+		for (auto const & cell : grid.cells)
+			if (cell.score.score > 0)
+				ranked.push_back(cell);
+	sort(ranked.begin(), ranked.end(),
+		[](scan_candidate const & a, scan_candidate const & b) { return a.score.score > b.score.score; });
+
+	vector<scan_candidate> out;
+	for (auto const & candidate : ranked)
+	{
+		if (out.size() >= scan_cfg.max_results)
+			break;
+		bool const overlaps {any_of(out.begin(), out.end(), [&](scan_candidate const & accepted) {
+			return candidate.offset < accepted.offset + accepted.datasize &&
+						 accepted.offset < candidate.offset + candidate.datasize;
+		})};
+		if (! overlaps)
+			out.push_back(candidate);
+	}
+	return out;
+}
+
+} // namespace chrgfx
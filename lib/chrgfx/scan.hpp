@@ -0,0 +1,126 @@
+/**
+ * @file scan.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Search for tile graphics within unknown data
+ *
+ * Each tile format is tried on a grid of fixed size windows at every alignment within a tile, and each window is
+ * scored with a few cheap measures of how much the decoded pixels look like drawn graphics rather than code, sound or
+ * compressed data.
+ */
+
+#ifndef __CHRGFX__SCAN_HPP
+#define __CHRGFX__SCAN_HPP
+
+#include "chrdef.hpp"
+#include "image_types.hpp"
+#include "tile_decoder.hpp"
+#include "types.hpp"
+#include <memory>
+#include <vector>
+
+namespace chrgfx
+{
+
+/**
+ * @brief Measures of how closely a run of decoded tiles resembles graphics
+ */
+struct scan_score
+{
+	/**
+	 * @brief Shannon entropy of the pixel values, relative to the maximum for the bit depth (0 to 1)
+	 * @details Noise, including data decoded with the wrong format, is close to 1
+	 */
+	float entropy {0};
+
+	/**
+	 * @brief How often the bitplanes of a pixel agree, beyond what is expected by chance (0 to 1)
+	 * @details Always 0 for 1bpp tiles
+	 */
+	float plane_correlation {0};
+
+	/**
+	 * @brief Fraction of tiles which are a single solid color
+	 */
+	float blank_ratio {0};
+
+	/**
+	 * @brief How often neighbouring pixels within a tile match, beyond what is expected from the pixel value frequencies
+	 * (0 to 1)
+	 */
+	float coherence {0};
+
+	/**
+	 * @brief Overall score, combining the above; higher is more likely to be graphics
+	 */
+	float score {0};
+};
+
+/**
+ * @brief A window of data found by scan_tiles
+ */
+struct scan_candidate
+{
+	size_t offset;
+	size_t datasize;
+	chrgfx::chrdef const * chrdef;
+	scan_score score;
+};
+
+struct scan_config
+{
+	/**
+	 * @brief Number of tiles in each window that is scored
+	 */
+	uint window_tiles {64};
+
+	/**
+	 * @brief Distance in bytes between the alignments tried within each tile
+	 */
+	uint alignment_step {1};
+
+	/**
+	 * @brief Maximum number of candidates returned
+	 */
+	size_t max_results {20};
+
+	/**
+	 * @brief Number of threads to use
+	 */
+	uint threads {1};
+};
+
+/**
+ * @brief Score a run of decoded tiles
+ *
+ * @param chrdef Tile encoding definition the tiles were decoded with
+ * @param in_chrset Pointer to input basic tileset
+ * @param tile_count Number of tiles in the tileset
+ */
+scan_score score_tileset(chrdef const & chrdef, pixel const * in_chrset, size_t const tile_count);
+
+/**
+ * @brief Search data for windows which decode to likely graphics with any of the given tile formats
+ * @details Windows which overlap a better scoring candidate are not returned, so that one large block of graphics
+ * does not crowd out the rest of the results.
+ *
+ * @return Candidates, best first
+ */
+std::vector<scan_candidate> scan_tiles(std::vector<chrdef const *> const & chrdefs,
+	byte_t const * data,
+	size_t const datasize,
+	scan_config const & scan_cfg);
+
+/**
+ * @brief Search data for likely graphics, using already built decoders
+ * @details As above; decoders from gfxdef_registry are built once for each format and kept, which saves rebuilding
+ * their tables for every scan in a long running process.
+ */
+std::vector<scan_candidate> scan_tiles(std::vector<std::shared_ptr<tile_decoder const>> const & decoders,
+	byte_t const * data,
+	size_t const datasize,
+	scan_config const & scan_cfg);
+
+} // namespace chrgfx
+
+#endif
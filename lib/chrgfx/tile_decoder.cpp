@@ -0,0 +1,156 @@
+#include "tile_decoder.hpp"
+#include "chrconv.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+static size_t constexpr SPAN {sizeof(uint64_t)};
+static_assert(sizeof(pixel) == 1, "tile_decoder expects single byte pixels");
+
+tile_decoder::tile_decoder(shared_ptr<chrgfx::chrdef const> chrdef) :
+		tile_decoder(chrdef, chrdef->datasize_bytes())
+{
+}
+
+/*
+	The datasize is the number of bytes which may be read from the start of each tile; for sub-tiles interleaved with
+	their neighbours, this is more than the data size of the sub-tile itself
+*/
+tile_decoder::tile_decoder(shared_ptr<chrgfx::chrdef const> chrdef, size_t const datasize) :
+		m_chrdef {std::move(chrdef)},
+		m_tile_pixels {m_chrdef->width() * m_chrdef->height()}
+{
+	if (m_chrdef->subtile() != nullptr)
+		build_subtile_steps(datasize);
+	else
+		build_tables(datasize);
+}
+
+void tile_decoder::build_tables(size_t const datasize)
+{
+	auto const & chrdef {*m_chrdef};
+	if (m_tile_pixels < SPAN || chrdef.bpp() > 8)
+		return;
+
+	// the pixel and plane set by each bit of the encoded tile, from the most significant bit of each byte
+	struct bit_target
+	{
+		size_t pixel;
+		uint plane;
+	};
+	vector<vector<pair<uint, bit_target>>> targets(datasize);
+	for (uint y {0}; y < chrdef.height(); ++y)
+		for (uint x {0}; x < chrdef.width(); ++x)
+			for (uint plane {0}; plane < chrdef.bpp(); ++plane)
+			{
+				size_t const bitpos {chrdef.row_offsets()[y] + chrdef.pixel_offsets()[x] + chrdef.plane_offsets()[plane]};
+				if ((bitpos >> 3) >= datasize)
+					return;
+				targets[bitpos >> 3].push_back({(uint) (bitpos % 8), {(y * chrdef.width()) + x, plane}});
+			}
+
+	// bytes which set no pixels, such as those of an interleaved neighbour, are not looked up at all
+	size_t const table_count {static_cast<size_t>(
+		count_if(targets.begin(), targets.end(), [](auto const & byte_targets) { return ! byte_targets.empty(); }))};
+	m_tables.resize(table_count);
+	m_steps.reserve(table_count);
+	for (size_t i_byte {0}; i_byte < datasize; ++i_byte)
+	{
+		auto const & byte_targets {targets[i_byte]};
+		if (byte_targets.empty())
+			continue;
+
+		auto const [min_target, max_target] {minmax_element(byte_targets.begin(),
+			byte_targets.end(),
+			[](auto const & a, auto const & b) { return a.second.pixel < b.second.pixel; })};
+		if (max_target->second.pixel - min_target->second.pixel >= SPAN)
+		{
+			m_steps.clear();
+			return;
+		}
+		auto const first_pixel {min(min_target->second.pixel, m_tile_pixels - SPAN)};
+		auto & table {m_tables[m_steps.size()]};
+		m_steps.push_back({i_byte, &table, first_pixel});
+
+		for (uint value {0}; value < 256; ++value)
+		{
+			pixel span[SPAN] {};
+			for (auto const & [bit, target] : byte_targets)
+				if (((value << bit) & 0x80) != 0)
+					span[target.pixel - first_pixel] |= 1 << target.plane;
+			memcpy(&table[value], span, SPAN);
+		}
+	}
+	m_table_driven = true;
+}
+
+/*
+	Tiles made of sub-tiles use the tables of the sub-tile format for every sub-tile, with the lookups writing straight to
+	each sub-tile's place in the whole tile. The tables are then a fraction of the size of those for the whole tile, and
+	stay in cache.
+*/
+void tile_decoder::build_subtile_steps(size_t const datasize)
+{
+	auto const & chrdef {*m_chrdef};
+	auto const & subtile {*chrdef.subtile()};
+	auto const & offsets {chrdef.subtile_offsets()};
+	// the sub-tile chrdef belongs to this one, so keeping this one keeps it as well
+	m_subtile_decoder.reset(new tile_decoder(shared_ptr<chrgfx::chrdef const>(m_chrdef, &subtile),
+		datasize - *max_element(offsets.begin(), offsets.end())));
+
+	// the run of pixels for each lookup must stay within a row of the sub-tile to be moved to the whole tile
+	auto const & subtile_steps {m_subtile_decoder->m_steps};
+	size_t const subtile_width {subtile.width()}, subtile_height {subtile.height()};
+	if (! m_subtile_decoder->m_table_driven || m_subtile_decoder->m_subtile_decoder)
+		return;
+	for (auto const & step : subtile_steps)
+		if ((step.out_pixel % subtile_width) + SPAN > subtile_width)
+			return;
+
+	m_steps.reserve(offsets.size() * subtile_steps.size());
+	auto ptr_subtile_offset {offsets.data()};
+	for (size_t i_row {0}; i_row < chrdef.subtile_rows(); ++i_row)
+		for (size_t i_column {0}; i_column < chrdef.subtile_columns(); ++i_column, ++ptr_subtile_offset)
+			for (auto const & step : subtile_steps)
+			{
+				size_t const y {(i_row * subtile_height) + (step.out_pixel / subtile_width)},
+					x {(i_column * subtile_width) + (step.out_pixel % subtile_width)};
+				m_steps.push_back({*ptr_subtile_offset + step.in_byte, step.table, (y * chrdef.width()) + x});
+			}
+	m_table_driven = true;
+}
+
+void tile_decoder::decode(byte_t const * in_tile, pixel * out_tile) const
+{
+	if (! m_table_driven)
+	{
+		decode_chr(*m_chrdef, in_tile, out_tile);
+		return;
+	}
+
+	fill(out_tile, out_tile + m_tile_pixels, 0);
+	for (auto const & step : m_steps)
+	{
+		uint64_t bits;
+		memcpy(&bits, out_tile + step.out_pixel, SPAN);
+		bits |= (*step.table)[in_tile[step.in_byte]];
+		memcpy(out_tile + step.out_pixel, &bits, SPAN);
+	}
+}
+
+void tile_decoder::decode(byte_t const * in_tileset, size_t const count, pixel * out_tileset) const
+{
+	size_t const in_chunksize {m_chrdef->datasize_bytes()};
+	for (size_t i_tile {0}; i_tile < count; ++i_tile)
+	{
+		decode(in_tileset, out_tileset);
+		in_tileset += in_chunksize;
+		out_tileset += m_tile_pixels;
+	}
+}
+
+} // namespace chrgfx
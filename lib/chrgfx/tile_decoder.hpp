@@ -0,0 +1,93 @@
+/**
+ * @file tile_decoder.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Table driven tile decoding
+ */
+
+#ifndef __CHRGFX__TILE_DECODER_HPP
+#define __CHRGFX__TILE_DECODER_HPP
+
+#include "chrdef.hpp"
+#include "image_types.hpp"
+#include "types.hpp"
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace chrgfx
+{
+
+/**
+ * @brief Decoder for one tile format, with lookup tables built from its chrdef
+ * @details In all of the common formats, each byte of an encoded tile sets bits in only a few pixels close together.
+ * For each byte position, a table gives the bits that every possible value contributes to a run of eight pixels, so
+ * decoding takes one lookup per byte rather than one test per bit. Tiles made of sub-tiles share the tables of the
+ * sub-tile format for every sub-tile. Formats where a byte affects pixels further apart fall back to decode_chr.
+ *
+ * The tables take some time to build and can be a few hundred kilobytes in size, so a decoder is best built once and
+ * shared; see gfxdef_registry. A decoder is never changed after it is built, and can be used from any number of threads
+ * at once.
+ */
+class tile_decoder
+{
+private:
+	using lut = std::array<uint64_t, 256>;
+
+	// one lookup: the byte of the encoded tile, the table for it and the first of the eight pixels it affects
+	struct lut_step
+	{
+		size_t in_byte;
+		lut const * table;
+		size_t out_pixel;
+	};
+
+	std::shared_ptr<chrgfx::chrdef const> m_chrdef;
+	size_t m_tile_pixels;
+	std::vector<lut> m_tables;
+	std::vector<lut_step> m_steps;
+	std::unique_ptr<tile_decoder> m_subtile_decoder;
+	bool m_table_driven {false};
+
+	tile_decoder(std::shared_ptr<chrgfx::chrdef const> chrdef, size_t const datasize);
+
+	void build_tables(size_t const datasize);
+
+	void build_subtile_steps(size_t const datasize);
+
+public:
+	/**
+	 * @param chrdef Tile encoding definition; it is kept for the life of the decoder
+	 */
+	explicit tile_decoder(std::shared_ptr<chrgfx::chrdef const> chrdef);
+
+	tile_decoder(tile_decoder const &) = delete;
+	tile_decoder & operator=(tile_decoder const &) = delete;
+
+	[[nodiscard]] chrgfx::chrdef const & chrdef() const
+	{
+		return *m_chrdef;
+	}
+
+	/**
+	 * @return true if the format is decoded with lookup tables, or false if it falls back to decode_chr
+	 */
+	[[nodiscard]] bool table_driven() const
+	{
+		return m_table_driven;
+	}
+
+	/**
+	 * @brief Decode a single tile; the output is the same as from decode_chr
+	 */
+	void decode(byte_t const * in_tile, pixel * out_tile) const;
+
+	/**
+	 * @brief Decode a run of consecutive tiles
+	 */
+	void decode(byte_t const * in_tileset, size_t const count, pixel * out_tileset) const;
+};
+
+} // namespace chrgfx
+
+#endif
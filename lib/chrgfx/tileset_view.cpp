@@ -0,0 +1,76 @@
+#include "tileset_view.hpp"
+#include "chrconv.hpp"
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace chrgfx
+{
+
+tileset_view::tileset_view(chrgfx::chrdef const & chrdef, byte_t const * data, size_t const datasize) :
+		m_chrdef {&chrdef},
+		m_data {data},
+		m_count {chrdef.datasize_bytes() > 0 ? datasize / chrdef.datasize_bytes() : 0}
+{
+	if (chrdef.datasize_bytes() == 0)
+		throw invalid_argument("Invalid tile data size");
+}
+
+tileset_view::tileset_view(tile_decoder const & decoder, byte_t const * data, size_t const datasize) :
+		tileset_view(decoder.chrdef(), data, datasize)
+{
+	m_decoder = &decoder;
+}
+
+tileset_view tileset_view::subview(size_t const first, size_t const count) const
+{
+	if (first > m_count)
+		throw out_of_range("Tile index beyond end of tileset");
+
+	tileset_view out {*this};
+	out.m_data = encoded(first);
+	out.m_count = min(count, m_count - first);
+	return out;
+}
+
+void tileset_view::decode(size_t const index, pixel * out_tile) const
+{
+	if (index >= m_count)
+		throw out_of_range("Tile index beyond end of tileset");
+
+	if (m_decoder != nullptr)
+		m_decoder->decode(encoded(index), out_tile);
+	else
+		decode_chr(*m_chrdef, encoded(index), out_tile);
+}
+
+void tileset_view::decode(size_t const first, size_t const count, pixel * out_tileset) const
+{
+	if (first > m_count || count > m_count - first)
+		throw out_of_range("Tile range beyond end of tileset");
+
+	if (m_decoder != nullptr)
+	{
+		m_decoder->decode(encoded(first), count, out_tileset);
+		return;
+	}
+
+	size_t const out_chunksize {m_chrdef->width() * m_chrdef->height()};
+	auto ptr_in_tile {encoded(first)};
+	for (size_t i_tile {0}; i_tile < count; ++i_tile)
+	{
+		decode_chr(*m_chrdef, ptr_in_tile, out_tileset);
+		ptr_in_tile += m_chrdef->datasize_bytes();
+		out_tileset += out_chunksize;
+	}
+}
+
+image tileset_view::render(render_config const & render_cfg) const
+{
+	vector<pixel> tiles(m_count * m_chrdef->width() * m_chrdef->height());
+	decode(0, m_count, tiles.data());
+	return render_tileset(*m_chrdef, tiles.data(), tiles.size(), render_cfg);
+}
+
+} // namespace chrgfx
@@ -0,0 +1,111 @@
+/**
+ * @file tileset_view.hpp
+ * @author Damian Rogers / damian@motoi.pro
+ * @copyright ©2024 Motoi Productions / Released under MIT License
+ * @brief Random access to the tiles within a block of encoded data
+ */
+
+#ifndef __CHRGFX__TILESET_VIEW_HPP
+#define __CHRGFX__TILESET_VIEW_HPP
+
+#include "chrdef.hpp"
+#include "image_types.hpp"
+#include "imaging.hpp"
+#include "tile_decoder.hpp"
+#include "types.hpp"
+
+namespace chrgfx
+{
+
+/**
+ * @brief Non-owning view of a range of encoded tiles
+ * @details Nothing is decoded until asked for, and then only the tiles requested, so a view can be taken over a small
+ * window within a very large (or memory mapped) file at little cost. Creating and copying views never copies tile
+ * data; the data and the chrdef must outlive the view.
+ */
+class tileset_view
+{
+private:
+	chrgfx::chrdef const * m_chrdef;
+	tile_decoder const * m_decoder {nullptr};
+	byte_t const * m_data;
+	size_t m_count;
+
+public:
+	static size_t constexpr npos {static_cast<size_t>(-1)};
+
+	/**
+	 * @param chrdef Tile encoding definition
+	 * @param data Pointer to the first encoded tile
+	 * @param datasize Size of the data in bytes; a partial tile at the end is ignored
+	 */
+	tileset_view(chrgfx::chrdef const & chrdef, byte_t const * data, size_t const datasize);
+
+	/**
+	 * @brief View which decodes with a table driven decoder, such as one from gfxdef_registry
+	 * @details The decoder must outlive the view, as must the chrdef.
+	 */
+	tileset_view(tile_decoder const & decoder, byte_t const * data, size_t const datasize);
+
+	[[nodiscard]] chrgfx::chrdef const & chrdef() const
+	{
+		return *m_chrdef;
+	}
+
+	/**
+	 * @brief Number of tiles in the view
+	 */
+	[[nodiscard]] size_t size() const
+	{
+		return m_count;
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return m_count == 0;
+	}
+
+	/**
+	 * @brief Size of the encoded tiles in the view, in bytes
+	 */
+	[[nodiscard]] size_t datasize() const
+	{
+		return m_count * m_chrdef->datasize_bytes();
+	}
+
+	/**
+	 * @brief Pointer to an encoded tile
+	 * @warning No range checking performed
+	 */
+	[[nodiscard]] byte_t const * encoded(size_t const index) const
+	{
+		return m_data + (index * m_chrdef->datasize_bytes());
+	}
+
+	/**
+	 * @brief View of a range of tiles within this view
+	 * @param count Number of tiles; clamped to the end of this view
+	 */
+	[[nodiscard]] tileset_view subview(size_t const first, size_t const count = npos) const;
+
+	/**
+	 * @brief Decode a single tile
+	 * @param out_tile Pointer to output basic tile
+	 */
+	void decode(size_t const index, pixel * out_tile) const;
+
+	/**
+	 * @brief Decode a range of tiles
+	 * @param out_tileset Pointer to output basic tileset, with space for count tiles
+	 */
+	void decode(size_t const first, size_t const count, pixel * out_tileset) const;
+
+	/**
+	 * @brief Decode and render all tiles in the view
+	 */
+	[[nodiscard]] image render(render_config const & render_cfg) const;
+};
+
+} // namespace chrgfx
+
+#endif
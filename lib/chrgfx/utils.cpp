@@ -100,6 +100,17 @@ uint8 create_bitmask8(uint8 bitcount)
 	return bitmask;
 }
 
+uint64_t fnv1a_64(void const * data, size_t const datasize, uint64_t hash)
+{
+	auto ptr_in {static_cast<byte_t const *>(data)};
+	for (size_t i {0}; i < datasize; ++i)
+	{
+		hash ^= ptr_in[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
 palette make_pal_random()
 {
 	palette outpal;
@@ -71,6 +71,16 @@ uint8 create_bitmask8(uint8 bitcount);
  */
 palette make_pal_random();
 
+uint64_t const FNV1A_64_BASIS {0xcbf29ce484222325};
+
+/**
+ * @brief 64 bit FNV-1a hash of a block of data
+ * @details The result is the same on every platform, so it can be stored and compared between runs
+ *
+ * @param hash Hash of any preceding data, to hash several blocks as one
+ */
+uint64_t fnv1a_64(void const * data, size_t const datasize, uint64_t hash = FNV1A_64_BASIS);
+
 /**
  * @brief Determines the endianness of the local system
  * @note This is called on initialization of libchrgfx; use the @c